@@ -0,0 +1,586 @@
+//index_bench.c
+// Insert/lookup throughput and memory per entry of the digest index against
+// the chained table it replaced.  Build with "mingw32-make bench", then run:
+//
+//   index_bench.exe [entries] [legacy_lookups]
+//
+// index_bench_compact.exe is the same built with INDEX_DIGEST_BYTES=16, so
+// the two memory reports compare the full and the 128-bit group layout.
+//
+// The spilled-index rows insert the same files under a memory budget of a
+// quarter of what they took resident, so most spill to runs (written next
+// to the exe), and report lookup latency percentiles.
+//
+// The churn rows add and remove files while reader threads look up files
+// that stay indexed, so the compaction thread rebuilds name arenas under
+// lock-free readers; any lookup that misses is reported.
+//
+// entries defaults to 1000000; the 50M comparison is "index_bench.exe
+// 50000000" and needs roughly 8 GB free.  The legacy table walks chains of
+// entries/10007 nodes per lookup, so at large sizes only a sample of
+// legacy_lookups (default 100000) is timed and the rate extrapolated.
+#include "hash_table.h"
+#include "index_analytics.h"
+#include "ipc_pipe.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEGACY_BUCKETS 10007
+#define DUPLICATE_EVERY 64           // Every 64th file repeats its predecessor
+
+// hash_table.c reports through the IPC layer; the bench has no pipe
+BOOL send_alert_duplicate_detected(const FileInfo *trigger, const FileInfo *duplicates,
+                                   int count, const char *timestamp) { return TRUE; }
+BOOL send_alert_scan_complete(int files, int groups, const char *timestamp) { return TRUE; }
+BOOL send_alert_duplicate_directory(const char *const *paths, int count, uint64_t files,
+                                    uint64_t bytes, const char *timestamp) { return TRUE; }
+void remove_filepath_from_ipc_groups(const char *filepath) {}
+void get_iso8601_timestamp(char *buffer, size_t size) { buffer[0] = '\0'; }
+void get_file_modified_time(const char *filepath, char *buffer, size_t size) { buffer[0] = '\0'; }
+void format_file_time(uint64_t mtime, char *buffer, size_t size) { buffer[0] = '\0'; }
+uint64_t generate_file_index(const char *filepath) { return 0; }
+uint64_t path_file_index(const char *filepath) { return 0; }
+int file_full_digest(const char *filepath, char *hex_output) { return -1; }
+
+// The table as it was before the flat index: one malloc per node, a
+// strdup'd path, djb2 over the hex digest and a fixed bucket count
+typedef struct LegacyNode {
+    char hash[HASH_SIZE * 2 + 1];
+    char *filepath;
+    struct LegacyNode *next;
+} LegacyNode;
+
+typedef struct LegacyTable {
+    LegacyNode **buckets;
+    size_t size;
+    CRITICAL_SECTION lock;
+} LegacyTable;
+
+static unsigned int legacy_hash(const char *str, size_t table_size) {
+    unsigned int hash = 5381;
+    int c;
+    while ((c = *str++))
+        hash = ((hash << 5) + hash) + c;
+    return hash % table_size;
+}
+
+static void legacy_add(LegacyTable *table, const char *hash, const char *filepath) {
+    EnterCriticalSection(&table->lock);
+    unsigned int index = legacy_hash(hash, table->size);
+    LegacyNode *node = malloc(sizeof(LegacyNode));
+    strcpy(node->hash, hash);
+    node->filepath = _strdup(filepath);
+    node->next = table->buckets[index];
+    table->buckets[index] = node;
+    LeaveCriticalSection(&table->lock);
+}
+
+static int legacy_group_size(LegacyTable *table, const char *hash) {
+    int count = 0;
+    EnterCriticalSection(&table->lock);
+    for (LegacyNode *n = table->buckets[legacy_hash(hash, table->size)]; n; n = n->next) {
+        if (strcmp(n->hash, hash) == 0) count++;
+    }
+    LeaveCriticalSection(&table->lock);
+    return count;
+}
+
+static void legacy_free(LegacyTable *table) {
+    for (size_t i = 0; i < table->size; i++) {
+        LegacyNode *n = table->buckets[i];
+        while (n) {
+            LegacyNode *next = n->next;
+            free(n->filepath);
+            free(n);
+            n = next;
+        }
+    }
+    free(table->buckets);
+    DeleteCriticalSection(&table->lock);
+}
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Deterministic digest and path for file number i
+static void make_key(uint64_t i, char *hash, char *path) {
+    static const char digits[] = "0123456789abcdef";
+    uint64_t seed = (i % DUPLICATE_EVERY == DUPLICATE_EVERY - 1) ? i - 1 : i;
+    for (int w = 0; w < 4; w++) {
+        uint64_t word = splitmix64(seed * 4 + w);
+        for (int b = 0; b < 16; b++) {
+            hash[w * 16 + b] = digits[(word >> (b * 4)) & 0x0F];
+        }
+    }
+    hash[HASH_SIZE * 2] = '\0';
+
+    // C:\bench\dNNNNN\fNNNNNNNNNN.bin without the cost of snprintf
+    char *p = path;
+    memcpy(p, "C:\\bench\\d", 10);
+    p += 10;
+    uint64_t dir = i / 1000;
+    for (int d = 4; d >= 0; d--) { p[d] = '0' + dir % 10; dir /= 10; }
+    p += 5;
+    memcpy(p, "\\f", 2);
+    p += 2;
+    uint64_t file = i;
+    for (int d = 9; d >= 0; d--) { p[d] = '0' + file % 10; file /= 10; }
+    p += 10;
+    memcpy(p, ".bin", 5);
+}
+
+// Size and mtime of file number i; duplicates share their predecessor's
+// size, as real copies would
+static FileMeta bench_meta(uint64_t i) {
+    uint64_t seed = (i % DUPLICATE_EVERY == DUPLICATE_EVERY - 1) ? i - 1 : i;
+    FileMeta meta = { 4096 + splitmix64(seed) % (1024 * 1024), i, 0 };
+    return meta;
+}
+
+// A spilled file is checked before it comes back; every bench file is
+// still what bench_meta says
+int get_file_stat(const char *filepath, uint64_t *filesize, uint64_t *mtime) {
+    const char *name = strrchr(filepath, '\\');
+    if (!name || name[1] != 'f') return -1;
+    FileMeta meta = bench_meta(strtoull(name + 2, NULL, 10));
+    *filesize = meta.filesize;
+    *mtime = meta.mtime;
+    return 0;
+}
+
+#define BENCH_THREADS 4
+#define SPILL_LOOKUPS 200000        // Sampled: a spilled hit reads a run
+#define QUERY_REPEATS 1000          // Incremental queries are too fast to time once
+
+typedef struct InsertWork {
+    HashTable *table;
+    uint64_t first;
+    uint64_t count;
+} InsertWork;
+
+static DWORD WINAPI insert_thread(LPVOID param) {
+    InsertWork *work = (InsertWork*)param;
+    char hash[HASH_SIZE * 2 + 1];
+    char path[MAX_PATH];
+    for (uint64_t i = work->first; i < work->first + work->count; i++) {
+        make_key(i, hash, path);
+        add_file_hash(work->table, hash, path, NULL);
+        // Every hasher also checks for a duplicate before inserting
+        filepath_in_hash_table(work->table, path);
+    }
+    return 0;
+}
+
+#define CHURN_STABLE 20000          // Files the readers look up throughout
+#define CHURN_ROUNDS 20
+#define CHURN_BATCH 20000           // Added, then removed again, per round
+#define CHURN_READERS 3
+#define CHURN_BASE 50000000ULL      // File number of the first churned file
+
+typedef struct ChurnReader {
+    HashTable *table;
+    volatile LONG *done;
+    uint64_t lookups;
+    uint64_t missed;
+} ChurnReader;
+
+static DWORD WINAPI churn_reader(LPVOID param) {
+    ChurnReader *reader = (ChurnReader*)param;
+    char hash[HASH_SIZE * 2 + 1];
+    char path[MAX_PATH];
+    while (!*reader->done) {
+        for (uint64_t i = 0; i < CHURN_STABLE && !*reader->done; i++) {
+            make_key(i, hash, path);
+            if (!filepath_in_hash_table(reader->table, path)) reader->missed++;
+            if (hash_table_group_size(reader->table, hash) < 1) reader->missed++;
+            reader->lookups += 2;
+        }
+    }
+    return 0;
+}
+
+static double seconds_since(LARGE_INTEGER start) {
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (double)(now.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+}
+
+// Allocated bytes of a flat index's current table
+static uint64_t flat_bytes(const FlatIndex *index) {
+    size_t capacity = flat_index_capacity(index);
+    return capacity * (sizeof(uint32_t) + 1) + FLAT_GROUP_WIDTH + sizeof(FlatTable);
+}
+
+static uint64_t arena_bytes(const PathArena *arena) {
+    uint64_t bytes = 0;
+    for (const PathArenaBlock *b = arena->blocks; b; b = b->next) {
+        bytes += sizeof(PathArenaBlock) + b->size;
+    }
+    return bytes;
+}
+
+static uint64_t chunk_bytes(const ChunkTable *chunks, size_t chunk_size) {
+    return chunks ? sizeof(ChunkTable) + chunks->capacity * sizeof(void*) +
+                    (uint64_t)chunks->count * chunk_size : 0;
+}
+
+// What the index has allocated, split by what it grows with: digest
+// groups (one per distinct content), entries with their file names, and
+// the directory tree
+typedef struct IndexMemory {
+    uint64_t groups;
+    uint64_t entries;
+    uint64_t tree;
+} IndexMemory;
+
+static void measure_index(HashTable *table, IndexMemory *memory) {
+    memset(memory, 0, sizeof(IndexMemory));
+    for (int s = 0; s < INDEX_PATH_SHARDS; s++) {
+        IndexShard *shard = &table->shards[s];
+        memory->groups += chunk_bytes(shard->group_chunks, sizeof(DigestGroup) * SLOT_CHUNK_SIZE) +
+                          chunk_bytes(shard->group_columns, sizeof(GroupColumns)) +
+                          flat_bytes(&shard->digest_index) +
+                          content_filter_capacity(&shard->digest_filter) /
+                              FILTER_KEYS_PER_BLOCK * FILTER_BLOCK_BYTES;
+        if (shard->dup_heap) {
+            memory->groups += sizeof(GroupHeap) + shard->dup_heap->capacity * sizeof(uint32_t);
+        }
+        memory->entries += chunk_bytes(shard->entry_chunks, sizeof(FileEntry) * SLOT_CHUNK_SIZE) +
+                           chunk_bytes(shard->entry_columns, sizeof(EntryColumns)) +
+                           flat_bytes(&shard->path_index) + arena_bytes(&shard->names);
+    }
+    memory->tree = (uint64_t)table->tree.capacity * sizeof(PathNode) +
+                   flat_bytes(&table->tree.children) + arena_bytes(&table->tree.names);
+}
+
+static void report_bytes(const char *label, uint64_t bytes, uint64_t entries) {
+    printf("  %-28s %12llu bytes %8.1f bytes/entry\n", label, (unsigned long long)bytes,
+           entries ? (double)bytes / entries : 0.0);
+}
+
+static void report(const char *label, uint64_t ops, double seconds) {
+    printf("  %-28s %12llu ops %9.3f s %12.0f ops/s %8.1f ns/op\n",
+           label, (unsigned long long)ops, seconds,
+           seconds > 0 ? ops / seconds : 0.0,
+           ops ? seconds * 1e9 / ops : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t entries = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    uint64_t legacy_lookups = argc > 2 ? strtoull(argv[2], NULL, 10) : 100000;
+    if (legacy_lookups > entries) legacy_lookups = entries;
+
+    char hash[HASH_SIZE * 2 + 1];
+    char path[MAX_PATH];
+    LARGE_INTEGER start;
+    volatile int sink = 0;
+
+    printf("Index benchmark: %llu entries, %d-bit group digests\n\n",
+           (unsigned long long)entries, INDEX_DIGEST_BYTES * 8);
+
+    // Key generation cost is included in every row below
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < entries; i++) {
+        make_key(i, hash, path);
+        sink += hash[0] + path[20];
+    }
+    report("key generation", entries, seconds_since(start));
+
+    printf("\nFlat index (SIMD control bytes, side arrays)\n");
+    HashTable *table = create_hash_table(0);
+
+    // Growth is spread over later inserts, so no single insert should stall
+    double slowest = 0;
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < entries; i++) {
+        LARGE_INTEGER op_start;
+        make_key(i, hash, path);
+        QueryPerformanceCounter(&op_start);
+        add_file_hash(table, hash, path, NULL);
+        double op = seconds_since(op_start);
+        if (op > slowest) slowest = op;
+    }
+    report("insert (growing)", entries, seconds_since(start));
+    printf("  %-28s %12.1f us\n", "slowest single insert", slowest * 1e6);
+    free_hash_table(table);
+
+    table = create_hash_table(entries);
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < entries; i++) {
+        make_key(i, hash, path);
+        FileMeta meta = bench_meta(i);
+        add_file_hash(table, hash, path, &meta);
+    }
+    report("insert (pre-sized)", entries, seconds_since(start));
+
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < entries; i++) {
+        make_key(splitmix64(i) % entries, hash, path);
+        sink += hash_table_group_size(table, hash);
+    }
+    report("digest lookup (hit)", entries, seconds_since(start));
+
+    IndexStats before, after;
+    hash_table_get_stats(table, &before);
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < entries; i++) {
+        make_key(entries + i, hash, path);
+        sink += hash_table_group_size(table, hash);
+    }
+    report("digest lookup (miss)", entries, seconds_since(start));
+    hash_table_get_stats(table, &after);
+    LONGLONG passed = after.filter_false_positives - before.filter_false_positives;
+    printf("  %-28s %12lld answered by the filter, %lld false positives (%.2f%%)\n",
+           "content filter", (long long)(after.filter_rejects - before.filter_rejects),
+           (long long)passed, entries ? 100.0 * passed / entries : 0.0);
+
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < entries; i++) {
+        make_key(splitmix64(i) % entries, hash, path);
+        sink += filepath_in_hash_table(table, path);
+    }
+    report("path lookup (hit)", entries, seconds_since(start));
+
+    // Path bytes held by the index against one full string per entry
+    uint64_t full_bytes = 0;
+    for (uint64_t i = 0; i < entries; i++) {
+        make_key(i, hash, path);
+        full_bytes += strlen(path) + 1;
+    }
+    uint64_t tree_bytes = table->tree.names.live_bytes +
+                          (uint64_t)path_tree_count(&table->tree) * sizeof(PathNode);
+    for (int s = 0; s < INDEX_SHARD_COUNT; s++) {
+        tree_bytes += table->shards[s].names.live_bytes;
+    }
+    printf("  %-28s %12llu bytes (full paths %llu, %.1f%%)\n", "path storage",
+           (unsigned long long)tree_bytes, (unsigned long long)full_bytes,
+           full_bytes ? 100.0 * tree_bytes / full_bytes : 0.0);
+
+    // Whole chunks and table capacities, as allocated rather than as used
+    IndexMemory memory;
+    measure_index(table, &memory);
+    printf("  %-28s %12u bytes (DigestGroup), %u (FileEntry), %u (columns)\n", "layout",
+           (unsigned)sizeof(DigestGroup), (unsigned)sizeof(FileEntry),
+           (unsigned)(sizeof(EntryColumns) / SLOT_CHUNK_SIZE));
+    report_bytes("memory: digest groups", memory.groups, entries);
+    report_bytes("memory: entries + names", memory.entries, entries);
+    report_bytes("memory: directory tree", memory.tree, entries);
+    report_bytes("memory: total", memory.groups + memory.entries + memory.tree, entries);
+
+    // Column scans over every entry; ns/op is per indexed file
+    IndexTotals totals;
+    QueryPerformanceCounter(&start);
+    index_totals(table, &totals);
+    report("scan: totals", entries, seconds_since(start));
+    printf("  %-28s %12llu groups, %llu reclaimable bytes\n", "",
+           (unsigned long long)totals.duplicate_groups,
+           (unsigned long long)totals.reclaimable_bytes);
+
+    // Kept up to date by the index: ns/op is per query, not per file
+    WastedGroup top[10];
+    QueryPerformanceCounter(&start);
+    for (int q = 0; q < QUERY_REPEATS; q++) {
+        sink += hash_table_top_groups(table, top, 10);
+    }
+    report("query: top 10 wasted", QUERY_REPEATS, seconds_since(start));
+
+    PathRollup self, children[10];
+    QueryPerformanceCounter(&start);
+    for (int q = 0; q < QUERY_REPEATS; q++) {
+        sink += path_tree_rollup(&table->tree, "C:\\bench", 8, &self, children, 10);
+    }
+    report("query: directory rollup", QUERY_REPEATS, seconds_since(start));
+    printf("  %-28s %12llu duplicate files, %llu bytes under C:\\bench\n", "",
+           (unsigned long long)self.duplicate_files, (unsigned long long)self.duplicate_bytes);
+
+    // Sorts every directory's Merkle digest; ns/op is per directory
+    DirectoryDuplicates dirs;
+    QueryPerformanceCounter(&start);
+    if (path_tree_duplicate_directories(&table->tree, DIRECTORY_MIN_FILES, &dirs)) {
+        report("scan: duplicate directories", path_tree_count(&table->tree), seconds_since(start));
+        sink += dirs.group_count;
+        path_tree_free_duplicates(&dirs);
+    }
+
+    DuplicateRollup *rollups = NULL;
+    QueryPerformanceCounter(&start);
+    sink += index_duplicates_by_directory(table, &rollups);
+    report("scan: by directory", entries, seconds_since(start));
+    free(rollups);
+
+    QueryPerformanceCounter(&start);
+    sink += index_duplicates_by_extension(table, &rollups);
+    report("scan: by extension", entries, seconds_since(start));
+    free(rollups);
+
+    size_t resident = hash_table_memory(table);
+
+    // Whole arena blocks and entry chunks, not one free per file
+    QueryPerformanceCounter(&start);
+    free_hash_table(table);
+    report("teardown", entries, seconds_since(start));
+
+    // Hashing threads inserting at once into the sharded index
+    table = create_hash_table(entries);
+    InsertWork work[BENCH_THREADS];
+    HANDLE threads[BENCH_THREADS];
+    QueryPerformanceCounter(&start);
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        work[t].table = table;
+        work[t].first = entries / BENCH_THREADS * t;
+        work[t].count = t == BENCH_THREADS - 1 ? entries - work[t].first
+                                               : entries / BENCH_THREADS;
+        threads[t] = CreateThread(NULL, 0, insert_thread, &work[t], 0, NULL);
+    }
+    for (int t = 0; t < BENCH_THREADS; t++) {
+        WaitForSingleObject(threads[t], INFINITE);
+        CloseHandle(threads[t]);
+    }
+    report("insert+lookup (4 threads)", entries, seconds_since(start));
+
+    IndexStats stats;
+    hash_table_get_stats(table, &stats);
+    printf("  %-28s %12lld acquisitions, %lld contended; %lld reads, %lld retried, %lld locked\n",
+           "contention", (long long)stats.lock_acquisitions, (long long)stats.lock_contended,
+           (long long)stats.reads, (long long)stats.read_retries, (long long)stats.read_fallbacks);
+    free_hash_table(table);
+
+    // Files added and removed again leave dead name bytes behind, and the
+    // compaction thread moves the live names while readers hold none of
+    // the shard locks; a file that never left must never be missed
+    printf("\nChurn (%d readers, %d rounds of %d files added and removed)\n",
+           CHURN_READERS, CHURN_ROUNDS, CHURN_BATCH);
+    table = create_hash_table(CHURN_STABLE + CHURN_BATCH);
+    for (uint64_t i = 0; i < CHURN_STABLE; i++) {
+        make_key(i, hash, path);
+        add_file_hash(table, hash, path, NULL);
+    }
+    volatile LONG churn_done = 0;
+    ChurnReader readers[CHURN_READERS];
+    HANDLE reader_threads[CHURN_READERS];
+    for (int t = 0; t < CHURN_READERS; t++) {
+        readers[t].table = table;
+        readers[t].done = &churn_done;
+        readers[t].lookups = 0;
+        readers[t].missed = 0;
+        reader_threads[t] = CreateThread(NULL, 0, churn_reader, &readers[t], 0, NULL);
+    }
+    QueryPerformanceCounter(&start);
+    for (int round = 0; round < CHURN_ROUNDS; round++) {
+        for (uint64_t i = 0; i < CHURN_BATCH; i++) {
+            make_key(CHURN_BASE + i, hash, path);
+            add_file_hash(table, hash, path, NULL);
+        }
+        for (uint64_t i = 0; i < CHURN_BATCH; i++) {
+            make_key(CHURN_BASE + i, hash, path);
+            remove_file_from_table(table, path);
+        }
+    }
+    report("churn: add+remove", (uint64_t)CHURN_ROUNDS * CHURN_BATCH * 2, seconds_since(start));
+    // Keep reading while the compaction thread catches up with the last round
+    Sleep(500);
+    InterlockedExchange(&churn_done, 1);
+    uint64_t churn_lookups = 0, churn_missed = 0;
+    for (int t = 0; t < CHURN_READERS; t++) {
+        WaitForSingleObject(reader_threads[t], INFINITE);
+        CloseHandle(reader_threads[t]);
+        churn_lookups += readers[t].lookups;
+        churn_missed += readers[t].missed;
+    }
+    hash_table_get_stats(table, &stats);
+    printf("  %-28s %12llu lookups, %llu missed; %lld arena compactions\n", "readers",
+           (unsigned long long)churn_lookups, (unsigned long long)churn_missed,
+           (long long)stats.name_compactions);
+    free_hash_table(table);
+
+    // The same files under a quarter of the memory they took above: most
+    // spill to runs on disk, and a hit on one reads it back
+    g_index_memory_budget = resident / 4;
+    printf("\nSpilled index (%.1f MB budget, a quarter of the resident index)\n",
+           g_index_memory_budget / (1024.0 * 1024.0));
+    table = create_hash_table(entries);
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < entries; i++) {
+        make_key(i, hash, path);
+        FileMeta meta = bench_meta(i);
+        add_file_hash(table, hash, path, &meta);
+    }
+    // Inserts outrun the spilling thread; count until it has caught up
+    for (int wait = 0; wait < 6000 && hash_table_memory(table) > g_index_memory_budget; wait++) {
+        Sleep(10);
+    }
+    report("insert (budgeted)", entries, seconds_since(start));
+
+    uint64_t lookups = entries < SPILL_LOOKUPS ? entries : SPILL_LOOKUPS;
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < lookups; i++) {
+        make_key(splitmix64(i) % entries, hash, path);
+        sink += hash_table_group_size(table, hash);
+    }
+    report("digest lookup (hit)", lookups, seconds_since(start));
+
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < lookups; i++) {
+        make_key(entries + i, hash, path);
+        sink += hash_table_group_size(table, hash);
+    }
+    report("digest lookup (miss)", lookups, seconds_since(start));
+
+    hash_table_get_stats(table, &stats);
+    printf("  %-28s %12llu bytes in memory, %lld files in %lld runs\n", "spilled",
+           (unsigned long long)stats.memory_bytes, (long long)stats.spilled_files,
+           (long long)stats.spill_runs);
+    printf("  %-28s %12.1f us p50, %.1f us p99, %.1f us p99.9\n", "lookup latency",
+           stats.lookup_p50_ns / 1000.0, stats.lookup_p99_ns / 1000.0,
+           stats.lookup_p999_ns / 1000.0);
+    printf("  %-28s %12lld lookups read a run, %.1f us p99\n", "",
+           (long long)stats.spill_probes, stats.disk_p99_ns / 1000.0);
+    free_hash_table(table);
+    g_index_memory_budget = 0;
+
+    printf("\nLegacy chained table (%d buckets)\n", LEGACY_BUCKETS);
+    LegacyTable legacy;
+    legacy.size = LEGACY_BUCKETS;
+    legacy.buckets = calloc(LEGACY_BUCKETS, sizeof(LegacyNode*));
+    InitializeCriticalSection(&legacy.lock);
+
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < entries; i++) {
+        make_key(i, hash, path);
+        legacy_add(&legacy, hash, path);
+    }
+    report("insert", entries, seconds_since(start));
+
+    // One node (digest hex copy included) and one strdup'd path per file,
+    // before the allocator's own overhead on each
+    uint64_t legacy_bytes = (uint64_t)LEGACY_BUCKETS * sizeof(LegacyNode*) +
+                            entries * sizeof(LegacyNode) + full_bytes;
+    report_bytes("memory (FileHash layout)", legacy_bytes, entries);
+
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < legacy_lookups; i++) {
+        make_key(splitmix64(i) % entries, hash, path);
+        sink += legacy_group_size(&legacy, hash);
+    }
+    report("digest lookup (hit)", legacy_lookups, seconds_since(start));
+
+    QueryPerformanceCounter(&start);
+    for (uint64_t i = 0; i < legacy_lookups; i++) {
+        make_key(entries + i, hash, path);
+        sink += legacy_group_size(&legacy, hash);
+    }
+    report("digest lookup (miss)", legacy_lookups, seconds_since(start));
+
+    QueryPerformanceCounter(&start);
+    legacy_free(&legacy);
+    report("teardown", entries, seconds_since(start));
+
+    return sink == -1 || churn_missed > 0;
+}
@@ -0,0 +1,49 @@
+//batch_audit.h
+#ifndef BATCH_AUDIT_H
+#define BATCH_AUDIT_H
+
+#include "hash_table.h"
+#include <windows.h>
+#include <stdint.h>
+
+// Memory of an audit run without --memory-budget
+#define AUDIT_DEFAULT_BUDGET ((size_t)256 * 1024 * 1024)
+
+// Runs merged at once; more are merged in passes through intermediate runs
+#ifndef AUDIT_MERGE_WAYS
+#define AUDIT_MERGE_WAYS 64
+#endif
+
+// Threads hashing the size-collision candidates
+#ifndef AUDIT_HASH_THREADS
+#define AUDIT_HASH_THREADS 4
+#endif
+
+// One file as the audit's runs store it: this header, then path_len bytes
+// of path (not NUL-terminated on disk)
+typedef struct AuditRecord {
+    uint64_t filesize;
+    uint32_t path_len;
+    uint32_t reserved;
+    char hash[HASH_SIZE * 2];    // Hex from hash_file, no NUL; zero until hashed
+    char path[];
+} AuditRecord;
+
+// --audit: find every duplicate below the roots in memory bounded by
+// budget, whatever the file count, through sorted run files instead of
+// the index:
+//   1. every root is walked and its (size, path) records are written to
+//      runs sorted by size each time the record buffer fills
+//   2. the runs are merged; only files sharing their size with another
+//      are hashed (hash_file, on AUDIT_HASH_THREADS threads) and written
+//      to runs sorted by digest
+//   3. those are merged and every digest shared by two or more files is
+//      reported as a duplicate group
+// No index, digest store, monitor or IPC server is involved.  Runs are
+// written next to the engine and removed as they are merged.  The walk's
+// visited set and directory queue count against budget too, so a tree
+// whose directories alone outgrow it fails rather than going over.
+// Returns FALSE if a run could not be written (or the audit was stopped).
+BOOL run_batch_audit(char directories[][MAX_PATH], int count, size_t budget);
+
+#endif // BATCH_AUDIT_H
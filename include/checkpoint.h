@@ -0,0 +1,45 @@
+//checkpoint.h
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <windows.h>
+#include <stdint.h>
+
+// Save the scan frontier at most this often during a full scan
+#ifndef CHECKPOINT_INTERVAL_MS
+#define CHECKPOINT_INTERVAL_MS 30000
+#endif
+
+// Directories still to be enumerated plus the completed-directory watermark
+typedef struct ScanFrontier {
+    char **dirs;                 // LIFO stack of pending directories
+    int count;
+    int capacity;
+    uint64_t dirs_completed;
+    uint64_t files_processed;
+} ScanFrontier;
+
+void frontier_init(ScanFrontier *frontier);
+
+// Returns FALSE (and logs) if out of memory; the directory is then not queued
+BOOL frontier_push(ScanFrontier *frontier, const char *dir_path);
+
+// Pop the next directory; caller frees the returned string
+char* frontier_pop(ScanFrontier *frontier);
+
+void frontier_free(ScanFrontier *frontier);
+
+// Load the saved frontier for root_path.  Returns FALSE if none exists.
+BOOL checkpoint_load(const char *root_path, ScanFrontier *frontier);
+
+// Atomically persist the frontier.  deferred_links (may be NULL) are links
+// waiting for the real tree; they are saved below the frontier, so a
+// resumed scan still takes them last.  in_progress_dir (may be NULL) is the
+// directory being enumerated; it is saved as pending so it is redone.
+BOOL checkpoint_save(const char *root_path, const ScanFrontier *frontier,
+                     const ScanFrontier *deferred_links, const char *in_progress_dir);
+
+// Remove the checkpoint once a scan of root_path has completed
+void checkpoint_delete(const char *root_path);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,74 @@
+//content_filter.h
+#ifndef CONTENT_FILTER_H
+#define CONTENT_FILTER_H
+
+#include <windows.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// A key's counters all sit in one 64-byte block: 128 counters of 4 bits
+#define FILTER_BLOCK_BYTES 64
+#define FILTER_BLOCK_WORDS (FILTER_BLOCK_BYTES / 8)
+#define FILTER_BLOCK_COUNTERS (FILTER_BLOCK_BYTES * 2)
+#define FILTER_HASHES 4
+
+// Keys per block at the designed load (4 bytes per key, about 2.5% false
+// positives); the filter asks to be rebuilt larger beyond it
+#ifndef FILTER_KEYS_PER_BLOCK
+#define FILTER_KEYS_PER_BLOCK 16
+#endif
+
+// One allocation holding the geometry and the counters, so a reader that
+// loads the pointer once always sees a matching set
+typedef struct FilterTable {
+    size_t block_count;          // Power of two
+    uint64_t *words;             // FILTER_BLOCK_WORDS per block, cache-line aligned
+} FilterTable;
+
+// Counting Bloom filter over 64-bit key hashes, blocked so a lookup costs
+// one cache line.  "No" is definite; "maybe" is wrong for about one key in
+// forty at the designed load.  Unlike a plain Bloom filter it supports
+// removal: a key's counters go down again.  A counter that reaches 15
+// stays there until the next rebuild, so it can only cause a false "maybe".
+//
+// Writers must be serialized by the caller.  content_filter_may_contain
+// may run concurrently with a writer as long as the caller validates the
+// result (e.g. with a sequence counter) and frees a replaced table only
+// when no such reader is inside.
+typedef struct ContentFilter {
+    FilterTable *volatile table; // NULL: no filter, every key is a "maybe"
+    size_t keys;                 // Added and not removed
+} ContentFilter;
+
+// Size for expected keys.  FALSE when out of memory (the filter then
+// answers "maybe" to everything).
+BOOL content_filter_init(ContentFilter *filter, size_t expected);
+void content_filter_free(ContentFilter *filter);
+
+// FALSE only if key was never added, or was removed as often as added
+BOOL content_filter_may_contain(const ContentFilter *filter, uint64_t key);
+
+void content_filter_add(ContentFilter *filter, uint64_t key);
+
+// key must have been added
+void content_filter_remove(ContentFilter *filter, uint64_t key);
+
+// TRUE once the keys outgrow the table's designed load
+BOOL content_filter_wants_growth(const ContentFilter *filter);
+
+// Keys the current table is designed for
+size_t content_filter_capacity(const ContentFilter *filter);
+
+// An empty table sized for expected keys, to be filled beside the live
+// one with content_filter_table_add / _remove and put in place by
+// content_filter_swap.  NULL when out of memory.
+FilterTable* content_filter_table_alloc(size_t expected);
+void content_filter_table_add(FilterTable *table, uint64_t key);
+void content_filter_table_remove(FilterTable *table, uint64_t key);
+
+// Make table (holding every key added and not removed) the filter's.
+// Returns the replaced table (NULL if there was none) for the caller to
+// free once no reader can still hold it.
+FilterTable* content_filter_swap(ContentFilter *filter, FilterTable *table);
+
+#endif // CONTENT_FILTER_H
@@ -0,0 +1,91 @@
+//digest_store.h
+#ifndef DIGEST_STORE_H
+#define DIGEST_STORE_H
+
+#include "hash_table.h"
+#include <windows.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define DIGEST_STORE_FILENAME "ddas_digests.dat"
+
+// Persistent cache of file digests keyed by path.  A record is only
+// trusted while the file's size and last-write time still match.
+typedef struct DigestRecord {
+    char *filepath;
+    uint64_t filesize;
+    uint64_t mtime;                  // FILETIME as 100 ns ticks
+    char hash[HASH_SIZE * 2 + 1];    // Empty string for 0-byte files
+    struct DigestRecord *next;
+} DigestRecord;
+
+typedef struct DigestStore {
+    DigestRecord **buckets;
+    size_t size;
+    size_t count;
+    size_t journal_lines;            // Records in the journal, incl. superseded
+    FILE *journal;
+    char journal_path[MAX_PATH];
+    CRITICAL_SECTION lock;
+} DigestStore;
+
+// A record copied out of the store, to be used without its lock
+typedef struct DigestCopy {
+    char filepath[MAX_PATH];
+    uint64_t filesize;
+    uint64_t mtime;
+    char hash[HASH_SIZE * 2 + 1];
+} DigestCopy;
+
+// Where digest_store_copy_under resumes; zero it before the first call
+typedef struct DigestStoreCursor {
+    size_t base_size;                // Bucket count when the walk began
+    size_t next;                     // Next bucket (of base_size) to copy
+} DigestStoreCursor;
+
+typedef void (*DigestStoreVisitor)(const DigestRecord *record, void *ctx);
+
+// Global digest store (NULL when persistence is unavailable)
+extern DigestStore *g_digest_store;
+
+// Load the journal at store_path (created if missing)
+BOOL digest_store_open(const char *store_path);
+
+// Flush and release the store
+void digest_store_close(void);
+
+// Copy the cached digest into hash_out if size and mtime still match
+BOOL digest_store_lookup(const char *filepath, uint64_t filesize,
+                         uint64_t mtime, char *hash_out);
+
+// Record the digest of a freshly hashed file
+void digest_store_put(const char *filepath, uint64_t filesize,
+                      uint64_t mtime, const char *hash);
+
+// Forget a deleted or renamed file
+void digest_store_remove(const char *filepath);
+
+// Push buffered journal writes to disk
+void digest_store_flush(void);
+
+// Rewrite the journal with only the live records
+void digest_store_compact(void);
+
+// Visit every record whose path lies below dir_path (store lock held)
+void digest_store_for_each_under(const char *dir_path,
+                                 DigestStoreVisitor visit, void *ctx);
+
+// Copy the records below dir_path into *batch, resuming at cursor, so a
+// long walk holds the store's lock for one batch at a time.  Stops before
+// the batch (*capacity records) would overflow, except that *batch is
+// grown for a single bucket group that does not fit in it alone.
+// Returns the number copied; 0 once every record has been visited, or
+// with *failed set if the batch could not be grown.
+size_t digest_store_copy_under(const char *dir_path, DigestStoreCursor *cursor,
+                               DigestCopy **batch, size_t *capacity, BOOL *failed);
+
+// Re-key every record below old_dir to the same path below new_dir
+// (a directory was renamed; the files themselves are unchanged)
+void digest_store_rename_under(const char *old_dir, const char *new_dir);
+
+#endif // DIGEST_STORE_H
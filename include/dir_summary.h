@@ -0,0 +1,81 @@
+//dir_summary.h
+#ifndef DIR_SUMMARY_H
+#define DIR_SUMMARY_H
+
+#include "hash_table.h"
+#include <windows.h>
+#include <stdint.h>
+
+#define DIR_SUMMARY_FILENAME "ddas_dirs.dat"
+
+// File recorded in the digest store, attached to its parent summary while
+// a root is being reconciled
+typedef struct SummaryFile {
+    char *filepath;
+    uint64_t filesize;
+    uint64_t mtime;                  // As recorded in the digest store
+    char hash[HASH_SIZE * 2 + 1];    // Empty string for 0-byte files
+    struct SummaryFile *next;
+} SummaryFile;
+
+// Persisted state of one directory as of its last enumeration
+typedef struct DirSummary {
+    char *dirpath;
+    uint64_t mtime;                  // Directory last-write time (FILETIME ticks)
+    uint32_t entry_count;            // Indexed files + subdirectories
+    uint64_t child_hash;             // Order-independent hash of child names
+    BOOL seen;                       // Visited by the current scan
+    struct DirSummary *first_child;  // Reconcile links, valid between
+    struct DirSummary *next_sibling; //   dir_summary_prepare/release
+    SummaryFile *files;
+    struct DirSummary *next;         // Hash chain
+} DirSummary;
+
+typedef struct DirSummaryTable {
+    DirSummary **buckets;
+    size_t size;
+    size_t count;
+    char store_path[MAX_PATH];
+    CRITICAL_SECTION lock;
+} DirSummaryTable;
+
+typedef void (*DirReplayVisitor)(const char *path, uint64_t filesize,
+                                 uint64_t mtime, const char *hash, void *ctx);
+
+// Global summary table (NULL when disabled with --full-rescan)
+extern DirSummaryTable *g_dir_summaries;
+
+// Load summaries from store_path
+BOOL dir_summary_open(const char *store_path);
+
+// Release all summaries
+void dir_summary_close(void);
+
+// Attach digest-store files and child directories to root_path's summaries
+void dir_summary_prepare(const char *root_path);
+
+// Drop the reconcile links built by dir_summary_prepare
+void dir_summary_release(const char *root_path);
+
+// Hash contribution of one child entry; a directory's child_hash is the sum
+uint64_t dir_summary_child_hash(const char *name, BOOL is_dir);
+
+// If dir_path is unchanged since its summary was taken, replay its files
+// and subdirectories through the visitors and return TRUE.  Returns FALSE
+// if the directory must be enumerated.
+BOOL dir_summary_replay(const char *dir_path, uint64_t mtime,
+                        DirReplayVisitor on_file, DirReplayVisitor on_subdir,
+                        void *ctx);
+
+// TRUE if dir_path has a summary: a scan enumerated it to the end
+BOOL dir_summary_known(const char *dir_path);
+
+// Record the summary of a freshly enumerated directory
+void dir_summary_record(const char *dir_path, uint64_t mtime,
+                        uint32_t entry_count, uint64_t child_hash);
+
+// Forget directories under root_path the completed scan did not see, then
+// persist.  Pass NULL after an interrupted scan to persist without pruning.
+void dir_summary_save(const char *root_path);
+
+#endif // DIR_SUMMARY_H
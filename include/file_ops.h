@@ -2,6 +2,8 @@
 #ifndef FILE_OPS_H
 #define FILE_OPS_H
 
+#include <stdint.h>
+
 #define BUFFER_SIZE (1024 * 1024)
 
 // Check if file is empty (0 bytes)
@@ -11,11 +13,39 @@ int is_file_empty(const char *filepath);
 // Check if file should be ignored based on patterns
 int should_ignore_file(const char *filename);
 
+// What is known about a file when it is indexed, kept with its index
+// entry so alerts never have to go back to the file system
+typedef struct FileMeta {
+    uint64_t filesize;
+    uint64_t mtime;              // FILETIME ticks, 0 if unknown
+    uint64_t file_index;         // Volume serial + file index, 0 if unknown
+} FileMeta;
+
+// Size, last-write time and file index from one open of the file
+// Returns: 0 on success, -1 on error
+int get_file_meta(const char *filepath, FileMeta *meta);
+
+// Read size and last-write time (FILETIME ticks) without opening the file
+// Returns: 0 on success, -1 on error
+int get_file_stat(const char *filepath, uint64_t *filesize, uint64_t *mtime);
+
 // Compute BLAKE3 hash of a file
 // Returns: 0 on success, -1 on error
 int hash_file(const char *filepath, char *hex_output);
 
+// Full digest of a file: the digest store's while size and mtime still
+// match, else the file hashed again
+// Returns: 0 on success, -1 on error
+int file_full_digest(const char *filepath, char *hex_output);
+
+struct HashTable;
+
 // Process a single file (check, hash, add to table)
-void process_file(const char *full_path, const char *action);
+// Returns: PROCESS_HASHED, PROCESS_CACHED, PROCESS_EMPTY or PROCESS_FAILED
+#define PROCESS_FAILED -1
+#define PROCESS_HASHED  0   // Content was read and hashed
+#define PROCESS_CACHED  1   // Digest reused from the digest store
+#define PROCESS_EMPTY   2   // 0-byte file, nothing to hash
+int process_file(struct HashTable *table, const char *full_path, const char *action);
 
 #endif // FILE_OPS_H
\ No newline at end of file
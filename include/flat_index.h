@@ -0,0 +1,90 @@
+//flat_index.h
+#ifndef FLAT_INDEX_H
+#define FLAT_INDEX_H
+
+#include <windows.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Control bytes are probed a group at a time (one SSE2 compare)
+#define FLAT_GROUP_WIDTH 16
+#define FLAT_INDEX_NONE 0xFFFFFFFFu
+
+// Old-table slots moved to the new table by each insert/erase while a
+// resize is in progress
+#ifndef FLAT_MIGRATE_SLOTS
+#define FLAT_MIGRATE_SLOTS 64
+#endif
+
+// One allocation holding a table's geometry, payloads and control bytes,
+// so a reader that loads the pointer once always sees a matching set
+typedef struct FlatTable {
+    size_t capacity;             // Power of two, at least FLAT_GROUP_WIDTH
+    uint32_t *values;
+    uint8_t *ctrl;               // capacity + FLAT_GROUP_WIDTH bytes (tail mirrors head)
+    struct FlatTable *next_retired;
+} FlatTable;
+
+// Open-addressing table in the Swiss-table layout: one control byte per
+// slot (empty, deleted, or 7 bits of the key's hash) and a parallel array
+// of 32-bit payloads that index into a caller-owned side array.  Keys live
+// in the side array; the table never stores or compares them itself.
+//
+// Growing never rehashes everything at once.  The new table is allocated
+// and the old one kept; every later insert or erase moves the next
+// FLAT_MIGRATE_SLOTS old slots across, and lookups check both tables until
+// the old one is empty.
+//
+// Writers must be serialized by the caller.  flat_index_find may run
+// concurrently with a writer as long as the caller validates the result
+// (e.g. with a sequence counter) and only calls flat_index_reclaim, which
+// frees replaced tables, when no such reader is inside.
+typedef struct FlatIndex {
+    FlatTable *volatile table;
+    FlatTable *volatile old;     // Table being drained (NULL when not resizing)
+    size_t count;                // Live entries in both tables
+    size_t tombstones;           // Deleted slots in the current table
+    size_t old_count;            // Live entries not yet migrated
+    size_t migrate_pos;          // Next old slot to migrate
+    size_t reserve_capacity;     // Reserved while resizing: started once drained
+    FlatTable *retired;          // Drained tables awaiting flat_index_reclaim
+} FlatIndex;
+
+// Does the side-array element at value hold key?
+typedef BOOL (*FlatIndexMatch)(uint32_t value, const void *key, void *ctx);
+
+// 64-bit hash of the side-array element at value (used when rehashing)
+typedef uint64_t (*FlatIndexHash)(uint32_t value, void *ctx);
+
+// Size for at least expected entries without growing
+BOOL flat_index_init(FlatIndex *index, size_t expected);
+void flat_index_free(FlatIndex *index);
+
+// Returns the payload whose key matches, or FLAT_INDEX_NONE
+uint32_t flat_index_find(const FlatIndex *index, uint64_t hash,
+                         FlatIndexMatch match, const void *key, void *ctx);
+
+// Insert a payload whose key is known to be absent.  May start a resize.
+BOOL flat_index_insert(FlatIndex *index, uint64_t hash, uint32_t value,
+                       FlatIndexHash rehash, void *ctx);
+
+// Remove the slot holding value (found through its key's hash)
+BOOL flat_index_erase(FlatIndex *index, uint64_t hash, uint32_t value,
+                      FlatIndexHash rehash, void *ctx);
+
+// Start growing so expected entries fit; a no-op if they already do.  While
+// an earlier resize is still draining, the reserve waits for it to finish
+// rather than draining it in one step.
+BOOL flat_index_reserve(FlatIndex *index, size_t expected,
+                        FlatIndexHash rehash, void *ctx);
+
+// Current table capacity
+size_t flat_index_capacity(const FlatIndex *index);
+
+// TRUE if drained tables are waiting to be freed
+BOOL flat_index_has_retired(const FlatIndex *index);
+
+// Free drained tables (no lock-free reader may be inside)
+void flat_index_reclaim(FlatIndex *index);
+
+#endif // FLAT_INDEX_H
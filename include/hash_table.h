@@ -2,47 +2,319 @@
 #ifndef HASH_TABLE_H
 #define HASH_TABLE_H
 
+#include "content_filter.h"
+#include "file_ops.h"
+#include "flat_index.h"
+#include "path_arena.h"
+#include "path_tree.h"
 #include <windows.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #define HASH_SIZE 32
 
-typedef struct FileHash {
-    char hash[HASH_SIZE * 2 + 1];
-    char *filepath;
-    struct FileHash *next;
-} FileHash;
+// Digest bytes the index groups files by.  Built with
+// -DINDEX_DIGEST_BYTES=16 (COMPACT_DIGESTS=1) it keeps a 128-bit prefix,
+// 16 bytes less per group, and confirms every group against the full
+// digests before reporting it.
+#ifndef INDEX_DIGEST_BYTES
+#define INDEX_DIGEST_BYTES HASH_SIZE
+#endif
 
-typedef struct HashTable {
-    FileHash **buckets;
-    size_t size;
+// One indexed file (slot in its shard's entry chunks).  The path is stored
+// as its directory's node in the table's path tree plus the file name.
+// Size and mtime captured at hash time live in the entry columns.
+typedef struct FileEntry {
+    const char *name;            // In the shard's name arena; NULL while the slot is free
+    uint32_t dir;                // Path tree node (PATH_TREE_NONE: no directory part)
+    uint32_t group;              // Slot in the same shard's group chunks (FLAT_INDEX_NONE: empty file)
+    uint64_t path_hash;          // Of (dir, name)
+    uint32_t group_next;         // Member list of the group (FLAT_INDEX_NONE ends it)
+    uint32_t group_prev;
+    uint64_t file_index;         // Volume serial + file index, 0 if unknown
+} FileEntry;
+
+// Every file with one digest; a duplicate set when count > 1
+typedef struct DigestGroup {
+    uint8_t digest[INDEX_DIGEST_BYTES];
+    uint32_t members;            // First member, or next free slot when count == 0
+    uint32_t count;
+    uint32_t heap_pos;           // In the shard's duplicate heap; FLAT_INDEX_NONE when not there
+} DigestGroup;
+
+// Side arrays grow a chunk at a time, so existing slots never move and
+// growth never copies
+#define SLOT_CHUNK_BITS 14
+#define SLOT_CHUNK_SIZE (1u << SLOT_CHUNK_BITS)
+
+// The same slots column by column, one block per chunk, so whole-index
+// scans touch only the fields they aggregate in tight loops.  Written with
+// the FileEntry / DigestGroup of the same slot.
+typedef struct EntryColumns {
+    uint64_t sizes[SLOT_CHUNK_SIZE];
+    uint64_t mtimes[SLOT_CHUNK_SIZE];
+    uint64_t exts[SLOT_CHUNK_SIZE];      // Lowercased extension, up to 8 bytes packed little-endian; 0 for none
+    uint32_t groups[SLOT_CHUNK_SIZE];    // Group slot; FLAT_INDEX_NONE while the slot is free
+    uint32_t dirs[SLOT_CHUNK_SIZE];      // Path tree node
+} EntryColumns;
+
+typedef struct GroupColumns {
+    uint64_t sizes[SLOT_CHUNK_SIZE];     // File size, taken from the first member
+    uint32_t counts[SLOT_CHUNK_SIZE];    // Members; 0 while the slot is free
+} GroupColumns;
+
+// Chunk pointers with their count in one block, replaced (not realloc'd)
+// when full so a lock-free reader's copy stays valid
+typedef struct ChunkTable {
+    uint32_t count;
+    uint32_t capacity;
+    void *chunks[];
+} ChunkTable;
+
+// Groups with count > 1 as a binary max-heap on wasted bytes
+// ((count - 1) * size, from the group columns), largest at slots[0].
+// Replaced (not realloc'd) when full, like ChunkTable.
+typedef struct GroupHeap {
+    uint32_t capacity;
+    uint32_t slots[];
+} GroupHeap;
+
+// The index is split by the top bits of the digest's first byte; each
+// shard has its own lock, so inserts of different digests rarely collide
+#define INDEX_SHARD_BITS 4
+#define INDEX_SHARD_COUNT (1 << INDEX_SHARD_BITS)
+
+// One more shard after the digest shards holds zero-byte files: a size
+// class of their own, found by path only and in no digest group
+#define EMPTY_SHARD INDEX_SHARD_COUNT
+#define INDEX_PATH_SHARDS (INDEX_SHARD_COUNT + 1)
+
+// Lock-free reads retried this many times before taking the shard lock
+#define INDEX_READ_ATTEMPTS 4
+
+// Group slots a filter rebuild walks per hold of the shard lock
+#ifndef FILTER_REBUILD_BATCH
+#define FILTER_REBUILD_BATCH 4096
+#endif
+
+// Smaller identical directories are left to the file-level report
+#define DIRECTORY_MIN_FILES 2
+
+// Memory budget of every index, in bytes (0: none).  Over it, files whose
+// digest no other file shares are spilled to sorted runs on disk (see
+// index_spill.h) until the index is back under nine tenths of it; a file
+// with the same digest brings them back.  Set once, before any index is
+// created.
+extern size_t g_index_memory_budget;
+
+struct SpillStore;
+
+// Freed memory a lock-free reader might still be looking at
+typedef struct RetiredBlock {
+    void *ptr;
+    struct RetiredBlock *next;
+} RetiredBlock;
+
+// One shard of the index.  Writers hold lock and make seq odd while they
+// change anything; lookups run without the lock and retry if seq moved.
+// Memory a reader could still hold (replaced tables, chunk arrays, path
+// arena blocks) is retired and only freed once no reader is inside.
+typedef struct IndexShard {
     CRITICAL_SECTION lock;
+    volatile LONG seq;
+    volatile LONG readers;       // Lock-free readers inside the shard
+    FlatIndex digest_index;      // Binary digest -> group slot
+    ContentFilter digest_filter; // Digests of the live groups, asked before digest_index
+    FilterTable *filter_build;   // Larger filter being filled (compaction thread)
+    uint32_t filter_built;       // Group slots below this are in filter_build
+    FlatIndex path_index;        // Path -> entry slot
+    ChunkTable *volatile group_chunks;   // DigestGroup chunks
+    volatile uint32_t group_used;        // High-water mark
+    uint32_t group_free;                 // Free-list head
+    ChunkTable *volatile group_columns;  // GroupColumns, one per group chunk
+    ChunkTable *volatile entry_chunks;   // FileEntry chunks
+    ChunkTable *volatile entry_columns;  // EntryColumns, one per entry chunk
+    volatile uint32_t entry_used;
+    uint32_t entry_free;
+    GroupHeap *volatile dup_heap;        // Groups with count > 1
+    volatile uint32_t dup_groups;        // Groups in that heap
+    PathArena names;                     // Bytes of every entry's file name
+    RetiredBlock *retired;
+    uint32_t spill_cursor;               // Next group slot the budget looks at
+    // Contention statistics
+    volatile LONGLONG lock_acquisitions;
+    volatile LONGLONG lock_contended;    // Lock was held by another thread
+    volatile LONGLONG read_retries;      // Attempts that raced a writer
+    volatile LONGLONG read_fallbacks;    // Lookups that fell back to the lock
+    volatile LONGLONG filter_rejects;    // Digest probes the filter answered alone
+    volatile LONGLONG filter_false_positives; // Filter said maybe, no group there
+} IndexShard;
+
+// Digest and path lookups go through flat open-addressing indexes whose
+// payloads are slots in the entries/groups side arrays.  A file lives in
+// the shard of its digest; path lookups probe every shard.
+typedef struct HashTable {
+    IndexShard shards[INDEX_PATH_SHARDS];
+    PathTree tree;                       // Directories of every entry
+    volatile LONGLONG reads;             // Lock-free lookups (all shards)
+    volatile LONGLONG name_compactions;  // Shard name arenas rebuilt
+    HANDLE compact_thread;               // Rebuilds name arenas and outgrown filters, spills
+    HANDLE compact_event;                // Set when a shard may need it
+    volatile size_t filter_reserve;      // Per-shard filter size hash_table_reserve asked for
+    volatile BOOL stopping;
+    struct SpillStore *spill;            // What the memory budget pushed out (NULL: no budget)
+    size_t memory_budget;
+    volatile LONG budget_ticks;          // Adds, to check the budget every so many
 } HashTable;
 
-// Global hash table
+// Contention totals across all shards
+typedef struct IndexStats {
+    LONGLONG lock_acquisitions;
+    LONGLONG lock_contended;
+    LONGLONG reads;
+    LONGLONG read_retries;
+    LONGLONG read_fallbacks;
+    LONGLONG filter_rejects;
+    LONGLONG filter_false_positives;
+    LONGLONG name_compactions;
+    size_t memory_bytes;         // As hash_table_memory
+    // Only with a memory budget
+    LONGLONG spilled_files;      // Records on disk, stale ones included
+    LONGLONG spill_runs;
+    LONGLONG spill_probes;       // Lookups that read a run
+    uint64_t lookup_p50_ns;      // Digest lookups, spilled or not
+    uint64_t lookup_p99_ns;
+    uint64_t lookup_p999_ns;
+    uint64_t disk_p99_ns;        // Those that read a run
+} IndexStats;
+
+// One shard's columns as a scan sees them.  Slots below the used marks may
+// be free: groups[] is FLAT_INDEX_NONE, counts[] is 0.
+typedef struct ShardColumns {
+    int shard;
+    EntryColumns *const *entries;        // entry_used slots, SLOT_CHUNK_SIZE per block
+    uint32_t entry_used;
+    GroupColumns *const *groups;
+    DigestGroup *const *digests;         // Same slots, for the digest of a picked group
+    uint32_t group_used;
+} ShardColumns;
+
+// A duplicate group ranked by the space its extra copies take
+typedef struct WastedGroup {
+    char hash[HASH_SIZE * 2 + 1];  // INDEX_DIGEST_BYTES of it
+    uint64_t filesize;
+    uint32_t count;
+    uint64_t wasted_bytes;       // (count - 1) * filesize
+} WastedGroup;
+
+// Runs at least once per shard; a writer racing the scan makes it run
+// again, and the repeat must replace what the earlier run produced
+typedef void (*ColumnScan)(const ShardColumns *columns, void *ctx);
+
+// Global hash table: the live index.  Roots' threads use the table their
+// root feeds; other threads go through hash_table_acquire.
 extern HashTable *g_hash_table;
 
-// Create hash table
-HashTable* create_hash_table(size_t size);
+// g_hash_table, held so it cannot be swapped out and freed until
+// hash_table_release (for the IPC thread's queries; may be NULL)
+HashTable* hash_table_acquire(void);
+void hash_table_release(void);
+
+// Make next the live index once no acquirer holds the old one; returns the
+// old one for the caller to free
+HashTable* hash_table_swap(HashTable *next);
+
+// Create hash table sized for about expected_files entries; it grows
+// past that on its own
+HashTable* create_hash_table(size_t expected_files);
+
+// Grow ahead of time so expected_files entries fit (the move to the larger
+// index is spread over later operations; content filters are rebuilt at
+// the new size by the compaction thread)
+void hash_table_reserve(HashTable *table, size_t expected_files);
 
-// Add file hash to table
-void add_file_hash(HashTable *table, const char *hash, const char *filepath);
+// Add file hash to table; meta may be NULL when nothing is known
+void add_file_hash(HashTable *table, const char *hash, const char *filepath,
+                   const FileMeta *meta);
 
-// Remove file from table
+// Track a zero-byte file; FALSE if it already was, lies in a reference
+// root (or out of memory).  Only size class 0, so nothing is hashed and
+// no duplicate is reported.
+BOOL hash_table_add_empty(HashTable *table, const char *filepath, const FileMeta *meta);
+
+// Remove file from table (either size class)
 void remove_file_from_table(HashTable *table, const char *filepath);
 
-// Check if hash exists (for duplicate detection)
-int check_for_duplicate(HashTable *table, const char *hash, const char *new_filepath);
+// Remove every file below dir_path, empty ones included (used when a root
+// is removed)
+void remove_files_under_path(HashTable *table, const char *dir_path);
+
+// Copy every file below dir_path into dst with its digest and metadata, so
+// a new index reuses what src already knows.  Returns the number copied.
+size_t hash_table_copy_under(HashTable *dst, HashTable *src, const char *dir_path);
+
+// Make dir_path a reference root (or a plain one again).  Its files are
+// matched against like any other but are never the trigger of an alert,
+// and groups or directories found only inside reference roots are not
+// reported.  FALSE when out of memory.
+BOOL hash_table_set_reference(HashTable *table, const char *dir_path, BOOL reference);
+
+// Check if hash exists (for duplicate detection).  The alert is built from
+// the index and new_meta alone, without touching the file system.  A file
+// in a reference root is never checked (returns 0).
+int check_for_duplicate(HashTable *table, const char *hash, const char *new_filepath,
+                        const FileMeta *new_meta);
 
 // Print duplicates for a specific file
 void print_duplicates_for_file(HashTable *table, const char *hash, const char *new_filepath);
 
-// Find and report all duplicates
+// Report every duplicate group, streaming each to the console and IPC as
+// it is read; O(duplicate files), since only groups of two or more are
+// kept in each shard's duplicate heap.  Identical directory trees (matching
+// path tree digests) are reported first as one alert each, and file groups
+// lying wholly inside one such set of copies are not listed again.
 void find_duplicates(HashTable *table);
 
+typedef void (*EmptyFileVisitor)(const char *filepath, const FileMeta *meta, void *ctx);
+
+// Call visit for every zero-byte file, from a copy taken under the lock so
+// it may block; returns how many were visited
+int hash_table_visit_empty(HashTable *table, EmptyFileVisitor visit, void *ctx);
+
+// Print all empty files
+void print_empty_files(HashTable *table);
+
+// Scan every shard's columns.  Runs without the shard locks, falling back
+// to a shard's lock only if writers keep racing the scan.
+void hash_table_scan_columns(HashTable *table, ColumnScan scan, void *ctx);
+
+// Up to k groups wasting the most bytes, largest first; returns how many.
+// Read from the shards' duplicate heaps without their locks, in
+// O(k log k) per shard however many groups there are.
+int hash_table_top_groups(HashTable *table, WastedGroup *groups, int k);
+
+// Number of indexed files with this digest
+int hash_table_group_size(HashTable *table, const char *hash);
+
+// Number of indexed files
+size_t hash_table_count(HashTable *table);
+
+// Sum the shards' contention counters
+void hash_table_get_stats(HashTable *table, IndexStats *stats);
+
+// Memory the index holds in live entries, groups, names, filters and
+// directories (what the budget is held against).  Estimated from counts,
+// so freed slots waiting for reuse are not included.
+size_t hash_table_memory(HashTable *table);
+
 // Check if a filepath is already tracked in the table
 BOOL filepath_in_hash_table(HashTable *table, const char *filepath);
 
+// Move every entry below old_path to new_path in O(1) (one path tree
+// node is relinked).  FALSE if the index cannot follow the rename this
+// way; the caller then rescans new_path.
+BOOL hash_table_rename_directory(HashTable *table, const char *old_path, const char *new_path);
+
 // Free hash table
 void free_hash_table(HashTable *table);
 
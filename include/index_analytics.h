@@ -0,0 +1,41 @@
+//index_analytics.h
+#ifndef INDEX_ANALYTICS_H
+#define INDEX_ANALYTICS_H
+
+#include "hash_table.h"
+#include <windows.h>
+#include <stdint.h>
+
+// Whole-index aggregates.  Every query here scans the index columns
+// (hash_table_scan_columns), so none of them takes a shard lock unless
+// writers keep racing it.  The largest groups and per-directory subtree
+// totals are kept up to date by the index itself (hash_table_top_groups,
+// path_tree_rollup) and need no scan.
+
+typedef struct IndexTotals {
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t duplicate_groups;   // Digests held by two or more files
+    uint64_t duplicate_files;    // Files in those groups
+    uint64_t reclaimable_bytes;  // Freed by keeping one file per group
+} IndexTotals;
+
+// Duplicate files summed under one directory or extension
+typedef struct DuplicateRollup {
+    char label[MAX_PATH];        // Directory path, or ".ext" ("(none)" without one)
+    uint64_t files;
+    uint64_t bytes;
+} DuplicateRollup;
+
+void index_totals(HashTable *table, IndexTotals *totals);
+
+// Duplicate files per directory (files directly in it) or per extension,
+// most bytes first.  *rollups is allocated; the caller frees it.
+// Returns the number of rows, or -1 when out of memory.
+int index_duplicates_by_directory(HashTable *table, DuplicateRollup **rollups);
+int index_duplicates_by_extension(HashTable *table, DuplicateRollup **rollups);
+
+// Console report of the above (top rows only)
+void print_index_analytics(HashTable *table);
+
+#endif // INDEX_ANALYTICS_H
@@ -0,0 +1,142 @@
+//index_spill.h
+#ifndef INDEX_SPILL_H
+#define INDEX_SPILL_H
+
+#include "content_filter.h"
+#include "hash_table.h"
+#include <windows.h>
+#include <stdint.h>
+
+// Runs merged into one once this many have been written
+#define SPILL_MAX_RUNS 8
+
+// Records between fences: a lookup reads one such stretch of a run
+#define SPILL_FENCE_RECORDS 64
+
+// Log-linear latency buckets: four per power of two nanoseconds, up to ~4 s
+#define LATENCY_BUCKETS 128
+
+// One spilled file.  A record of an index's run is only as good as the
+// file behind it: a lookup that reaches it checks size and mtime first.
+typedef struct SpillEntry {
+    uint64_t key;                // Digest hash: runs are sorted on it
+    uint8_t digest[INDEX_DIGEST_BYTES];
+    uint32_t dir;                // Path tree node of the spilling index
+    uint64_t filesize;
+    uint64_t mtime;
+    uint64_t file_index;
+    const char *name;            // Owned by whoever produced the entry
+    uint32_t name_len;
+    uint32_t run;                // Where it was read from (lookups, merges)
+    uint64_t ordinal;
+} SpillEntry;
+
+typedef struct SpillFence {
+    uint64_t key;
+    uint64_t offset;
+} SpillFence;
+
+// An immutable file of records sorted by key.  Only the fences and the
+// filter stay in memory; the file is deleted when its handle closes.
+typedef struct SpillRun {
+    HANDLE file;
+    uint32_t id;
+    uint64_t records;
+    uint64_t bytes;              // End of the last record
+    SpillFence *fences;          // First record of every SPILL_FENCE_RECORDS
+    size_t fence_count;
+    ContentFilter filter;        // Keys in the file
+} SpillRun;
+
+typedef struct LatencyHistogram {
+    volatile LONGLONG buckets[LATENCY_BUCKETS];
+    volatile LONGLONG count;
+} LatencyHistogram;
+
+// A record a lookup found stale (file gone or changed), left for the
+// next merge
+typedef struct SpillDead {
+    uint32_t run;
+    uint64_t ordinal;
+} SpillDead;
+
+// A directory dropped from the index: records below it in runs older than
+// before_run are gone too
+typedef struct SpillDrop {
+    uint32_t dir;
+    uint32_t before_run;
+} SpillDrop;
+
+// The part of an index that did not fit its memory budget.  Lookups and
+// adds hold lock shared for as long as a spill must not slip between
+// their lookup and their insert; writing or merging runs holds it
+// exclusively.
+typedef struct SpillStore {
+    SRWLOCK lock;
+    SpillRun *runs[SPILL_MAX_RUNS];
+    int run_count;
+    uint32_t next_run;
+    uint32_t tag;                // In the file names, unique in this process
+    CRITICAL_SECTION dead_lock;  // Lookups add to dead while holding lock shared
+    SpillDead *dead;
+    size_t dead_count;
+    size_t dead_capacity;
+    SpillDrop *drops;
+    size_t drop_count;
+    size_t drop_capacity;
+    volatile LONGLONG records;   // In runs, stale ones included
+    volatile LONGLONG probes;    // Lookups that read a run
+    LatencyHistogram lookups;    // Every digest lookup of the index
+    LatencyHistogram disk;       // Those that read a run
+} SpillStore;
+
+// Decide during a merge whether a record is still worth keeping
+typedef BOOL (*SpillKeep)(const SpillEntry *entry, void *ctx);
+
+typedef void (*SpillVisitor)(const SpillEntry *entry, void *ctx);
+
+SpillStore* spill_store_create(void);
+
+// Close (and so delete) every run
+void spill_store_free(SpillStore *store);
+
+// Sort entries by key and write them as a new run (lock held exclusively).
+// FALSE if the file could not be written; the entries are then not spilled.
+BOOL spill_store_write_run(SpillStore *store, SpillEntry *entries, size_t count);
+
+// Every record whose digest is digest, newest run first, written to out
+// with names in names (max entries of MAX_PATH each).  Returns the count,
+// or -1 after a read error (lock held shared).
+int spill_store_find(SpillStore *store, uint64_t key, const uint8_t *digest,
+                     SpillEntry *out, char (*names)[MAX_PATH], int max);
+
+// TRUE unless every run's filter rules key out (lock held shared)
+BOOL spill_store_may_contain(SpillStore *store, uint64_t key);
+
+// Leave a record a lookup found stale for the next merge (lock held shared)
+void spill_store_mark_dead(SpillStore *store, const SpillEntry *entry);
+
+// Forget every record below dir (lock held exclusively)
+void spill_store_drop(SpillStore *store, uint32_t dir);
+
+// Merge every run into one, keeping what keep accepts and nothing marked
+// dead (lock held exclusively).  FALSE if the merged run could not be
+// written; the old runs then stay.
+BOOL spill_store_merge(SpillStore *store, SpillKeep keep, void *ctx);
+
+// Visit every record of every run, stale ones included (lock held)
+BOOL spill_store_for_each(SpillStore *store, SpillVisitor visit, void *ctx);
+
+// Bytes the store keeps in memory (fences, filters, bookkeeping)
+size_t spill_store_memory(SpillStore *store);
+
+void latency_record(LatencyHistogram *histogram, uint64_t ns);
+
+// Record the time since start (a QueryPerformanceCounter reading)
+void latency_record_since(LatencyHistogram *histogram, LARGE_INTEGER start);
+
+// Upper bound of the bucket holding quantile q (0..1), in nanoseconds;
+// 0 when nothing was recorded
+uint64_t latency_percentile(const LatencyHistogram *histogram, double q);
+
+#endif // INDEX_SPILL_H
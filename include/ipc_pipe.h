@@ -8,7 +8,6 @@
 #define PIPE_BUFFER_SIZE 65536
 #define MAX_MESSAGE_SIZE 32768
 #define MAX_DUPLICATES 100
-#define MAX_HISTORY_ALERTS 100
 
 // Message types
 typedef enum {
@@ -93,6 +92,10 @@ BOOL send_alert_duplicate_detected(
     const char *timestamp
 );
 
+// Send duplicate-directory alert: count identical trees of files files / bytes bytes each
+BOOL send_alert_duplicate_directory(const char *const *paths, int count,
+                                    uint64_t files, uint64_t bytes, const char *timestamp);
+
 // Send scan complete alert
 BOOL send_alert_scan_complete(int total_files, int duplicate_groups, const char *timestamp);
 
@@ -106,9 +109,15 @@ BOOL send_alert_empty_file(const char *filepath, uint64_t filesize,
 // Send all stored alerts to newly connected client
 BOOL send_alert_history_to_client(void);
 
+// Send an EMPTY_FILE alert for every empty file in the live index
+void send_empty_files_to_client(void);
+
 // Remove a filepath from all duplicate groups (call when a file is renamed or deleted)
 void remove_filepath_from_ipc_groups(const char *filepath);
 
+// Move group paths below old_dir to new_dir (call when a directory is renamed)
+void rename_ipc_group_paths(const char *old_dir, const char *new_dir);
+
 // Clear all stored duplicate groups and empty-file records (call before a re-scan)
 void clear_ipc_state(void);
 
@@ -118,9 +127,18 @@ void send_raw_notification(const char *json_message);
 // Helper: Get current ISO 8601 timestamp
 void get_iso8601_timestamp(char *buffer, size_t buffer_size);
 
+// Helper: Format FILETIME ticks as ISO 8601 ("unknown" for 0)
+void format_file_time(uint64_t mtime, char *buffer, size_t buffer_size);
+
 // Helper: Get file modified time as ISO 8601
 void get_file_modified_time(const char *filepath, char *buffer, size_t buffer_size);
 
+// Helper: Combine volume serial and NTFS file index into a file index
+uint64_t make_file_index(DWORD volume_serial, DWORD index_high, DWORD index_low);
+
+// Helper: File index derived from the path, for files never opened
+uint64_t path_file_index(const char *filepath);
+
 // Helper: Generate unique file index (based on creation time and inode)
 uint64_t generate_file_index(const char *filepath);
 
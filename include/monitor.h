@@ -4,10 +4,10 @@
 
 #include <windows.h>
 
-// Monitor thread function
+// Monitor thread function (lpParam is the MonitorRoot to watch)
 DWORD WINAPI monitor_thread_func(LPVOID lpParam);
 
-// Signal monitor thread to stop immediately
+// Signal every root's monitor thread to stop immediately
 void signal_monitor_stop(void);
 
 #endif // MONITOR_H
\ No newline at end of file
@@ -0,0 +1,51 @@
+//path_arena.h
+#ifndef PATH_ARENA_H
+#define PATH_ARENA_H
+
+#include <windows.h>
+#include <stddef.h>
+
+// Bytes per arena block; longer strings get a block of their own
+#define PATH_ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct PathArenaBlock {
+    struct PathArenaBlock *next;
+    size_t size;
+    size_t used;
+    char data[];
+} PathArenaBlock;
+
+// Bump allocator for path strings.  Strings are never freed one at a
+// time: releasing one only counts its bytes as dead, and the whole arena
+// is rebuilt from the live strings once dead bytes dominate.
+typedef struct PathArena {
+    PathArenaBlock *blocks;      // Newest first; allocation happens in the head
+    size_t block_count;
+    size_t live_bytes;
+    size_t dead_bytes;
+} PathArena;
+
+void path_arena_init(PathArena *arena);
+
+// Copy path into the arena; NULL on allocation failure
+char* path_arena_store(PathArena *arena, const char *path);
+
+// Same for the first len bytes of text (stored NUL-terminated)
+char* path_arena_store_len(PathArena *arena, const char *text, size_t len);
+
+// Count a stored path as dead (its bytes stay readable until compaction)
+void path_arena_release(PathArena *arena, const char *path);
+
+// TRUE once dead bytes outweigh live ones by enough to be worth a rebuild
+BOOL path_arena_wants_compaction(const PathArena *arena);
+
+// Detach every block so live paths can be stored afresh; returns the old
+// blocks, which the caller frees once nothing can still read them
+PathArenaBlock* path_arena_detach(PathArena *arena);
+
+// Free a detached block list (O(blocks))
+void path_arena_free_blocks(PathArenaBlock *blocks);
+
+void path_arena_free(PathArena *arena);
+
+#endif // PATH_ARENA_H
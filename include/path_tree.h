@@ -0,0 +1,137 @@
+//path_tree.h
+#ifndef PATH_TREE_H
+#define PATH_TREE_H
+
+#include "flat_index.h"
+#include "path_arena.h"
+#include <windows.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define PATH_TREE_NONE FLAT_INDEX_NONE
+
+// One directory: its parent and its own name component.  "C:\a\b" is the
+// chain C: <- a <- b, so every prefix is stored once however many files
+// sit below it.
+typedef struct PathNode {
+    uint32_t parent;             // PATH_TREE_NONE for the first component
+    uint32_t name_len;
+    const char *name;            // In the tree's name arena
+    uint64_t hash;               // Of (parent, name): key in the child index
+    volatile LONG entries;       // Index entries directly in this directory
+    uint32_t children;           // Nodes whose parent this is
+    uint32_t first_child;        // Child list (PATH_TREE_NONE ends it)
+    uint32_t next_sibling;
+    uint32_t prev_sibling;
+    volatile LONGLONG dup_files; // Duplicate files anywhere below, kept by the index
+    volatile LONGLONG dup_bytes;
+    uint64_t weight[2];          // Odd multipliers from the name (see below)
+    volatile LONGLONG digest[2]; // Merkle digest of every file below; 0 when none
+    volatile LONGLONG files;     // Files anywhere below, and their bytes
+    volatile LONGLONG bytes;
+    BOOL reference;              // In a reference root (inherited from the parent)
+} PathNode;
+
+// A directory's digest is, per 64-bit lane and mod 2^64, the sum of
+// leaf(name, content) over its own files plus weight(child) * digest(child)
+// over its subdirectories.  Being linear, a file's change reaches every
+// ancestor as one add each (the term multiplied by the weights on the way
+// up), concurrent changes commute, and a renamed subtree moves by
+// subtracting its term from the old ancestors and adding it to the new.
+// Identical copies of a tree get the same digest wherever they are.
+
+// Interned directory tree shared by all index shards.  Lookups take the
+// lock shared; only a directory seen for the first time, or a rename,
+// takes it exclusively.  Node ids are never reused, so an id a caller
+// resolved earlier can go stale but never names a different directory.
+typedef struct PathTree {
+    SRWLOCK lock;
+    PathNode *nodes;
+    uint32_t count;
+    uint32_t capacity;
+    FlatIndex children;          // (parent, name) -> node
+    PathArena names;
+    uint32_t first_root;         // Child list of the nodes without a parent
+} PathTree;
+
+// Directories whose digests, file counts and byte counts all match
+typedef struct DirectoryGroup {
+    uint64_t files;              // In each copy
+    uint64_t bytes;
+    uint32_t first;              // Copies are nodes[first .. first + count)
+    uint32_t count;
+} DirectoryGroup;
+
+typedef struct DirectoryDuplicates {
+    DirectoryGroup *groups;
+    uint32_t group_count;
+    uint32_t *nodes;
+    uint32_t *covered;           // Per node: group + 1 of the innermost copy it is in, or 0
+    uint32_t node_count;         // Length of covered
+} DirectoryDuplicates;
+
+// Duplicate totals of one directory's subtree
+typedef struct PathRollup {
+    char path[MAX_PATH];
+    uint64_t duplicate_files;
+    uint64_t duplicate_bytes;
+} PathRollup;
+
+BOOL path_tree_init(PathTree *tree);
+void path_tree_free(PathTree *tree);
+
+// Node for the directory dir_path[0..len), or PATH_TREE_NONE if it was
+// never interned
+uint32_t path_tree_find(PathTree *tree, const char *dir_path, size_t len);
+
+// Same, adding any missing components (PATH_TREE_NONE only when out of memory)
+uint32_t path_tree_intern(PathTree *tree, const char *dir_path, size_t len);
+
+// Write the full path of node into buffer; returns its length, or 0 if it
+// does not fit
+size_t path_tree_format(PathTree *tree, uint32_t node, char *buffer, size_t size);
+
+// TRUE if node is ancestor or lies below it
+BOOL path_tree_is_under(PathTree *tree, uint32_t node, uint32_t ancestor);
+
+// Mark dir_path[0..len) and every directory below it as in (or no longer
+// in) a reference root; directories added below later inherit the mark.
+// FALSE when out of memory.
+BOOL path_tree_set_reference(PathTree *tree, const char *dir_path, size_t len, BOOL reference);
+
+// TRUE if node lies in a reference root
+BOOL path_tree_is_reference(PathTree *tree, uint32_t node);
+
+// Count index entries in a directory (delta +1 / -1)
+void path_tree_add_entries(PathTree *tree, uint32_t node, LONG delta);
+
+// Add to the duplicate totals of node and every directory above it
+void path_tree_add_duplicates(PathTree *tree, uint32_t node, LONG files, LONGLONG bytes);
+
+// Count a file into (sign 1) or out of (-1) the digests and totals of
+// node and every directory above it; content is the file's digest
+void path_tree_add_file(PathTree *tree, uint32_t node, const char *name,
+                        const uint8_t *content, size_t content_len, uint64_t size, LONG sign);
+
+// Group the directories of at least min_files files whose subtrees are
+// identical.  A group whose every copy sits directly in a directory that is
+// itself duplicated adds nothing and is left out.  FALSE when out of memory.
+BOOL path_tree_duplicate_directories(PathTree *tree, uint64_t min_files,
+                                     DirectoryDuplicates *dups);
+void path_tree_free_duplicates(DirectoryDuplicates *dups);
+
+// Totals of dir_path[0..len) (of every directory when len is 0) and up to
+// max of its subdirectories with the most duplicate bytes, largest first.
+// Returns the number of subdirectories written, or -1 if dir_path is unknown.
+int path_tree_rollup(PathTree *tree, const char *dir_path, size_t len,
+                     PathRollup *self, PathRollup *children, int max);
+
+// Move the directory old_path to new_path by relinking its node, so every
+// path below it changes at once.  Fails if old_path is unknown, new_path
+// already holds entries or subdirectories, or new_path lies inside old_path.
+BOOL path_tree_rename(PathTree *tree, const char *old_path, const char *new_path);
+
+// Directories interned so far
+uint32_t path_tree_count(PathTree *tree);
+
+#endif // PATH_TREE_H
@@ -0,0 +1,108 @@
+//roots.h
+#ifndef ROOTS_H
+#define ROOTS_H
+
+#include "visited_set.h"
+#include <windows.h>
+
+#define MAX_ROOTS 32
+
+struct HashTable;
+
+// One monitored directory tree.  Listed roots all feed the live index; a
+// staged root feeds the index being built for a CHANGE_DIRECTORY.
+typedef struct MonitorRoot {
+    char path[MAX_PATH];
+    struct HashTable *table;     // Index this root's threads write to
+    HANDLE monitor_thread;
+    HANDLE scan_thread;
+    HANDLE stop_event;           // Wakes this root's monitor for shutdown
+    volatile BOOL stopping;      // Set when the root is removed
+    int file_count;              // Files indexed by this root's last scan
+    HANDLE estimate_thread;      // Enumeration-only walk for the progress ETA
+    volatile BOOL estimate_cancel;
+    VisitedSet visited;          // Identities of directories this root scanned
+    volatile BOOL covered;       // Initial scan finished: every file below is indexed
+    struct HashTable *reuse_from; // Live index to copy reused subtrees from
+    char reused[MAX_ROOTS][MAX_PATH]; // Subtrees copied, not scanned
+    int reused_count;
+    BOOL reference;              // Read-only archive: matched against, never alerted on
+} MonitorRoot;
+
+typedef struct RootList {
+    MonitorRoot *roots[MAX_ROOTS];
+    int count;
+    CRITICAL_SECTION lock;
+} RootList;
+
+typedef enum {
+    ROOT_CMD_ADD = 1,
+    ROOT_CMD_REMOVE = 2,
+    ROOT_CMD_ADD_REFERENCE = 3
+} RootCommand;
+
+// Global root list
+extern RootList g_roots;
+
+// Initialize / free root list
+void init_roots(void);
+void free_roots(void);
+
+// Register a new root.  Fails if it overlaps an existing root.  A reference
+// root's files are matched against but never alerted on, and once it has
+// been scanned to the end it is loaded from the digest store instead of
+// rescanned.
+MonitorRoot* roots_add(const char *path, BOOL reference);
+
+// Start the monitor and scanner threads for a registered root
+BOOL root_start(MonitorRoot *root);
+
+// Create a root outside the list that feeds table, for an index built
+// behind the live one.  Subtrees the live roots have fully scanned that
+// overlap it (a live root inside it, or the one it lies inside) are noted
+// for its scanner to copy from the live index instead of scanning.
+MonitorRoot* roots_stage(const char *path, struct HashTable *table);
+
+// Stop a staged root that will not be adopted
+void roots_discard(MonitorRoot *root);
+
+// Put a staged root, whose index is now live, in the (empty) list
+void roots_adopt(MonitorRoot *root);
+
+// TRUE once root's scanner thread has exited
+BOOL root_scan_finished(MonitorRoot *root);
+
+// Copy the paths of the listed reference roots; returns how many
+int roots_reference_paths(char paths[][MAX_PATH]);
+
+// Stop every root's threads and drop them from the list (index untouched)
+void roots_stop_all(void);
+
+// Wake every monitor thread so it can exit
+void roots_signal_stop_all(void);
+
+// TRUE while any root's scanner thread is still running
+BOOL roots_scans_running(void);
+
+// TRUE while any root's monitor thread is still running
+BOOL roots_monitors_running(void);
+
+// Root's initial scan has indexed its whole tree
+void root_mark_covered(MonitorRoot *root);
+
+// TRUE once every listed root is covered.  Until then a file may still
+// have an unindexed copy, so alerts and query answers are marked partial.
+BOOL roots_covered(void);
+
+// Claim a directory for root's scan.  Returns FALSE if this or another
+// root already entered it (a link loop or a second path to the same data).
+BOOL roots_claim_directory(MonitorRoot *root, const DirIdentity *id);
+
+// Queue an ADD_ROOT / REMOVE_ROOT request (called from the IPC thread).
+// FALSE (logged) if MAX_PENDING_ROOT_COMMANDS are already waiting.
+BOOL roots_queue_command(RootCommand command, const char *path);
+
+// Apply queued root changes (called from the main thread)
+void roots_process_pending(void);
+
+#endif // ROOTS_H
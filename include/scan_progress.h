@@ -0,0 +1,39 @@
+//scan_progress.h
+#ifndef SCAN_PROGRESS_H
+#define SCAN_PROGRESS_H
+
+#include "roots.h"
+#include <windows.h>
+#include <stdint.h>
+
+// Emit SCAN_PROGRESS at most this often
+#ifndef SCAN_PROGRESS_INTERVAL_MS
+#define SCAN_PROGRESS_INTERVAL_MS 1000
+#endif
+
+// Counters every scanner thread feeds.  Updates are single interlocked
+// adds; all formatting happens in scan_progress_tick().
+typedef enum {
+    PROGRESS_ENUMERATED = 0,     // Files found by the walk (or replayed)
+    PROGRESS_HASHED,             // Files whose content was read and hashed
+    PROGRESS_SKIPPED,            // Files whose digest was reused or not needed
+    PROGRESS_ESTIMATED,          // Files found by the enumeration-only estimate
+    PROGRESS_STAGE_COUNT
+} ProgressStage;
+
+// Count one file of filesize bytes against a stage
+void scan_progress_add(ProgressStage stage, uint64_t filesize);
+
+// A root's scan is starting: resets counters if no other scan is running
+// and starts the root's enumeration-only estimate
+void scan_progress_begin(MonitorRoot *root);
+
+// A root's scan has ended: stops its estimate and, when it was the last
+// running scan, sends a final SCAN_PROGRESS
+void scan_progress_end(MonitorRoot *root);
+
+// Send SCAN_PROGRESS if a scan is running and the interval has elapsed
+// (called from the main thread's poll loop)
+void scan_progress_tick(void);
+
+#endif // SCAN_PROGRESS_H
@@ -3,21 +3,34 @@
 #define SCANNER_H
 
 #include "hash_table.h"
+#include "roots.h"
 #include <windows.h>
 
+// Digest store records a reference root is loaded by per lock hold
+#ifndef REFERENCE_LOAD_BATCH
+#define REFERENCE_LOAD_BATCH 4096
+#endif
+
 // Global variables for scanner
 extern volatile int g_scanning_complete;
 extern volatile int g_stop_monitoring;
-extern char g_monitor_path[MAX_PATH];
+
+// --lazy: monitors start at once and the initial scans trickle in the
+// background, so new files are indexed (and alerted) before old ones
+extern int g_lazy_index;
 
 // Pending directory change (set by command handler, consumed by main loop)
 extern volatile BOOL g_dir_change_pending;
 extern char g_pending_dir[MAX_PATH];
 
-// Recursively scan directory
-void scan_directory(const char *dir_path, HashTable *table, int *file_count);
+// Scan a root's tree, resuming from a saved checkpoint if one exists.
+// Returns FALSE if the scan was interrupted (frontier checkpointed).
+BOOL scan_directory(MonitorRoot *root, HashTable *table, int *file_count);
 
-// Scanner thread function
+// Scanner thread function (lpParam is the MonitorRoot to scan)
 DWORD WINAPI scanner_thread_func(LPVOID lpParam);
 
+// Report duplicates once every root's initial scan has finished
+void finish_initial_scan(void);
+
 #endif // SCANNER_H
\ No newline at end of file
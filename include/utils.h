@@ -3,6 +3,7 @@
 #define UTILS_H
 
 #include <windows.h>
+#include <stddef.h>
 
 // MinGW compatibility
 #ifndef _MSC_VER
@@ -21,4 +22,8 @@ void init_utils(void);
 // Cleanup utils
 void cleanup_utils(void);
 
+// Build the path of a persistent state file (digest store, checkpoints)
+// next to the engine executable
+void get_state_file_path(const char *filename, char *buffer, size_t buffer_size);
+
 #endif // UTILS_H
\ No newline at end of file
@@ -0,0 +1,52 @@
+//visited_set.h
+#ifndef VISITED_SET_H
+#define VISITED_SET_H
+
+#include <windows.h>
+#include <stdint.h>
+
+// Whether to descend into symbolic links, junctions and mount points
+typedef enum {
+    REPARSE_FOLLOW = 0,          // Follow, but never enter the same directory twice
+    REPARSE_SKIP = 1             // Do not descend into them at all
+} ReparsePolicy;
+
+// Volume serial + file index: the same for every path reaching a directory
+typedef struct DirIdentity {
+    uint64_t file_index;
+    DWORD volume_serial;
+} DirIdentity;
+
+// Open-addressed set of directory identities
+typedef struct VisitedSet {
+    DirIdentity *slots;
+    size_t capacity;
+    size_t count;
+    CRITICAL_SECTION lock;
+} VisitedSet;
+
+// Reparse policy for scans (set from --reparse in main)
+extern ReparsePolicy g_reparse_policy;
+
+// Read the identity and last-write time of a directory, following links
+// Returns: 0 on success, -1 on error
+int get_directory_identity(const char *dir_path, DirIdentity *id, uint64_t *mtime);
+
+// TRUE if the entry is a directory symlink, junction or mount point
+BOOL is_link_entry(const WIN32_FIND_DATA *find_data);
+
+// Same check for a path (one FindFirstFile on the path itself)
+BOOL is_link_path(const char *path);
+
+// TRUE if a scan should enter this directory entry under g_reparse_policy
+BOOL should_descend(const WIN32_FIND_DATA *find_data);
+
+void visited_init(VisitedSet *set);
+void visited_free(VisitedSet *set);
+
+// Add an identity.  Returns FALSE if it was already present.
+BOOL visited_insert(VisitedSet *set, const DirIdentity *id);
+
+BOOL visited_contains(VisitedSet *set, const DirIdentity *id);
+
+#endif // VISITED_SET_H
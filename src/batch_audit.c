@@ -0,0 +1,752 @@
+//batch_audit.c
+#include "batch_audit.h"
+#include "checkpoint.h"
+#include "file_ops.h"
+#include "scanner.h"
+#include "visited_set.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#define RECORD_HEADER_BYTES sizeof(AuditRecord)
+
+// Room for the largest record a run can hold
+#define RECORD_MAX_BYTES (RECORD_HEADER_BYTES + MAX_PATH)
+
+// Per-file stdio buffers while merging, whatever the budget
+#define MERGE_BUFFER_MIN (64 * 1024)
+#define MERGE_BUFFER_MAX (4 * 1024 * 1024)
+
+#define PROGRESS_INTERVAL_MS 10000
+
+typedef int (*RecordCompare)(const AuditRecord *a, const AuditRecord *b);
+
+// Visit records in merged order; FALSE stops the merge (write error)
+typedef BOOL (*RecordVisitor)(const AuditRecord *record, void *ctx);
+
+static int compare_size(const AuditRecord *a, const AuditRecord *b) {
+    if (a->filesize != b->filesize) return a->filesize < b->filesize ? -1 : 1;
+    return strcmp(a->path, b->path);
+}
+
+static int compare_hash(const AuditRecord *a, const AuditRecord *b) {
+    int order = memcmp(a->hash, b->hash, sizeof(a->hash));
+    return order ? order : strcmp(a->path, b->path);
+}
+
+static BOOL audit_stopped(void) {
+    return g_stop_monitoring != 0;
+}
+
+// ── Run files ───────────────────────────────────────────────────────────
+
+typedef struct RunList {
+    char (*paths)[MAX_PATH];
+    int count;
+    int capacity;
+    unsigned next;               // In the file names
+} RunList;
+
+typedef struct RunWriter {
+    FILE *file;
+    char *buffer;
+    uint64_t records;
+} RunWriter;
+
+typedef struct RunReader {
+    FILE *file;
+    char *buffer;
+    AuditRecord *record;         // Last record read, path NUL-terminated
+} RunReader;
+
+// Name a new run file and add it to runs.  Returns its path, or NULL.
+static const char* run_list_add(RunList *runs) {
+    if (runs->count >= runs->capacity) {
+        int capacity = runs->capacity ? runs->capacity * 2 : 64;
+        char (*paths)[MAX_PATH] = realloc(runs->paths, capacity * sizeof(*paths));
+        if (!paths) return NULL;
+        runs->paths = paths;
+        runs->capacity = capacity;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "ddas_audit_%lu_%u.run",
+             (unsigned long)GetCurrentProcessId(), runs->next++);
+    get_state_file_path(name, runs->paths[runs->count], MAX_PATH);
+    return runs->paths[runs->count++];
+}
+
+// Delete the first count runs and forget them
+static void run_list_drop(RunList *runs, int count) {
+    for (int i = 0; i < count; i++) {
+        DeleteFile(runs->paths[i]);
+    }
+    memmove(runs->paths, runs->paths + count, (runs->count - count) * sizeof(*runs->paths));
+    runs->count -= count;
+}
+
+static void run_list_free(RunList *runs) {
+    run_list_drop(runs, runs->count);
+    free(runs->paths);
+    runs->paths = NULL;
+    runs->capacity = 0;
+}
+
+static BOOL writer_open(RunWriter *writer, const char *path, size_t buffer_size) {
+    writer->records = 0;
+    writer->buffer = NULL;
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        safe_printf("[AUDIT] Cannot create %s\n", path);
+        return FALSE;
+    }
+    writer->buffer = malloc(buffer_size);
+    if (writer->buffer) setvbuf(writer->file, writer->buffer, _IOFBF, buffer_size);
+    return TRUE;
+}
+
+static BOOL writer_put(RunWriter *writer, const AuditRecord *record) {
+    writer->records++;
+    return fwrite(record, RECORD_HEADER_BYTES, 1, writer->file) == 1 &&
+           fwrite(record->path, 1, record->path_len, writer->file) == record->path_len;
+}
+
+// Flush and close; FALSE if anything written was lost
+static BOOL writer_close(RunWriter *writer) {
+    BOOL ok = fflush(writer->file) == 0 && !ferror(writer->file);
+    ok = (fclose(writer->file) == 0) && ok;
+    free(writer->buffer);
+    writer->file = NULL;
+    writer->buffer = NULL;
+    return ok;
+}
+
+static BOOL reader_open(RunReader *reader, const char *path, size_t buffer_size) {
+    reader->buffer = NULL;
+    reader->record = malloc(RECORD_MAX_BYTES);
+    reader->file = reader->record ? fopen(path, "rb") : NULL;
+    if (!reader->file) {
+        free(reader->record);
+        reader->record = NULL;
+        return FALSE;
+    }
+    reader->buffer = malloc(buffer_size);
+    if (reader->buffer) setvbuf(reader->file, reader->buffer, _IOFBF, buffer_size);
+    return TRUE;
+}
+
+// Next record into reader->record.  FALSE at the end or on a damaged
+// record (*failed set).
+static BOOL reader_next(RunReader *reader, BOOL *failed) {
+    AuditRecord *record = reader->record;
+    if (fread(record, RECORD_HEADER_BYTES, 1, reader->file) != 1) {
+        if (ferror(reader->file)) *failed = TRUE;
+        return FALSE;
+    }
+    if (record->path_len >= MAX_PATH ||
+        fread(record->path, 1, record->path_len, reader->file) != record->path_len) {
+        *failed = TRUE;
+        return FALSE;
+    }
+    record->path[record->path_len] = '\0';
+    return TRUE;
+}
+
+static void reader_close(RunReader *reader) {
+    if (reader->file) fclose(reader->file);
+    free(reader->buffer);
+    free(reader->record);
+    reader->file = NULL;
+    reader->buffer = NULL;
+    reader->record = NULL;
+}
+
+// ── Record buffer ───────────────────────────────────────────────────────
+
+// One block of the budget: records packed from the front, pointers to
+// them from the back; full when the two meet
+typedef struct RecordBuffer {
+    char *block;
+    size_t size;
+    size_t used;                 // Record bytes at the front
+    size_t count;                // Pointers at the back
+    size_t held;                 // Budget held elsewhere, taken off the block's size
+} RecordBuffer;
+
+static BOOL buffer_init(RecordBuffer *buffer, size_t size) {
+    size &= ~(size_t)7;          // Keeps the pointers at the back aligned
+    buffer->block = malloc(size);
+    buffer->size = size;
+    buffer->used = 0;
+    buffer->count = 0;
+    buffer->held = 0;
+    return buffer->block != NULL;
+}
+
+static AuditRecord** buffer_slots(RecordBuffer *buffer) {
+    return (AuditRecord**)(buffer->block + buffer->size) - buffer->count;
+}
+
+// FALSE when the buffer is full
+static BOOL buffer_add(RecordBuffer *buffer, uint64_t filesize, const char *hash,
+                       const char *path) {
+    size_t path_len = strlen(path);
+    size_t bytes = (RECORD_HEADER_BYTES + path_len + 1 + 7) & ~(size_t)7;
+    size_t slots = (buffer->count + 1) * sizeof(AuditRecord*);
+    if (buffer->used + bytes + slots + buffer->held > buffer->size) return FALSE;
+
+    AuditRecord *record = (AuditRecord*)(buffer->block + buffer->used);
+    record->filesize = filesize;
+    record->path_len = (uint32_t)path_len;
+    record->reserved = 0;
+    if (hash) {
+        memcpy(record->hash, hash, sizeof(record->hash));
+    } else {
+        memset(record->hash, 0, sizeof(record->hash));
+    }
+    memcpy(record->path, path, path_len + 1);
+    buffer->used += bytes;
+    buffer->count++;
+    buffer_slots(buffer)[0] = record;
+    return TRUE;
+}
+
+static RecordCompare g_sort_compare;
+
+static int compare_slots(const void *a, const void *b) {
+    return g_sort_compare(*(AuditRecord* const*)a, *(AuditRecord* const*)b);
+}
+
+// Sort the buffered records and write them as a new run, then empty the
+// buffer.  Only one thread sorts at a time (callers hold their lock).
+static BOOL buffer_flush(RecordBuffer *buffer, RunList *runs, RecordCompare compare) {
+    if (buffer->count == 0) return TRUE;
+
+    AuditRecord **slots = buffer_slots(buffer);
+    g_sort_compare = compare;
+    qsort(slots, buffer->count, sizeof(*slots), compare_slots);
+
+    const char *path = run_list_add(runs);
+    RunWriter writer;
+    if (!path || !writer_open(&writer, path, MERGE_BUFFER_MAX)) return FALSE;
+    BOOL ok = TRUE;
+    for (size_t i = 0; i < buffer->count && ok; i++) {
+        ok = writer_put(&writer, slots[i]);
+    }
+    ok = writer_close(&writer) && ok;
+    if (!ok) safe_printf("[AUDIT] Cannot write run %s (disk full?)\n", path);
+
+    buffer->used = 0;
+    buffer->count = 0;
+    return ok;
+}
+
+static void buffer_free(RecordBuffer *buffer) {
+    free(buffer->block);
+    buffer->block = NULL;
+}
+
+// ── Merging ─────────────────────────────────────────────────────────────
+
+// Min-heap of readers on their current record
+typedef struct MergeHeap {
+    RunReader *readers;
+    int *order;
+    int count;
+    RecordCompare compare;
+} MergeHeap;
+
+static BOOL heap_less(const MergeHeap *heap, int a, int b) {
+    return heap->compare(heap->readers[heap->order[a]].record,
+                         heap->readers[heap->order[b]].record) < 0;
+}
+
+static void heap_sift_down(MergeHeap *heap, int i) {
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < heap->count && heap_less(heap, left, smallest)) smallest = left;
+        if (right < heap->count && heap_less(heap, right, smallest)) smallest = right;
+        if (smallest == i) return;
+        int swap = heap->order[i];
+        heap->order[i] = heap->order[smallest];
+        heap->order[smallest] = swap;
+        i = smallest;
+    }
+}
+
+// Stdio buffer per run so a merge of AUDIT_MERGE_WAYS runs plus its
+// output stays within budget
+static size_t merge_buffer_size(size_t budget) {
+    size_t size = budget / (AUDIT_MERGE_WAYS + 1);
+    if (size < MERGE_BUFFER_MIN) size = MERGE_BUFFER_MIN;
+    if (size > MERGE_BUFFER_MAX) size = MERGE_BUFFER_MAX;
+    return size;
+}
+
+// Feed the first count runs to visit in compare order
+static BOOL merge_some(RunList *runs, int count, RecordCompare compare,
+                       RecordVisitor visit, void *ctx, size_t budget) {
+    if (count == 0) return TRUE;
+
+    MergeHeap heap;
+    heap.readers = calloc(count, sizeof(RunReader));
+    heap.order = malloc(count * sizeof(int));
+    heap.count = 0;
+    heap.compare = compare;
+    if (!heap.readers || !heap.order) {
+        free(heap.readers);
+        free(heap.order);
+        return FALSE;
+    }
+
+    BOOL failed = FALSE;
+    size_t buffer_size = merge_buffer_size(budget);
+    for (int i = 0; i < count && !failed; i++) {
+        if (!reader_open(&heap.readers[i], runs->paths[i], buffer_size)) {
+            safe_printf("[AUDIT] Cannot open run %s\n", runs->paths[i]);
+            failed = TRUE;
+        } else if (reader_next(&heap.readers[i], &failed)) {
+            heap.order[heap.count++] = i;
+        }
+    }
+    for (int i = heap.count / 2 - 1; i >= 0; i--) {
+        heap_sift_down(&heap, i);
+    }
+
+    while (heap.count > 0 && !failed) {
+        if (audit_stopped()) {
+            failed = TRUE;
+            break;
+        }
+        RunReader *top = &heap.readers[heap.order[0]];
+        if (!visit(top->record, ctx)) {
+            failed = TRUE;
+            break;
+        }
+        if (!reader_next(top, &failed)) {
+            heap.order[0] = heap.order[--heap.count];
+        }
+        heap_sift_down(&heap, 0);
+    }
+
+    for (int i = 0; i < count; i++) {
+        reader_close(&heap.readers[i]);
+    }
+    free(heap.readers);
+    free(heap.order);
+    return !failed;
+}
+
+static BOOL visit_write(const AuditRecord *record, void *ctx) {
+    return writer_put((RunWriter*)ctx, record);
+}
+
+// Merge every run into visit, through intermediate runs while there are
+// more than AUDIT_MERGE_WAYS.  The runs are deleted either way.
+static BOOL merge_runs(RunList *runs, RecordCompare compare,
+                       RecordVisitor visit, void *ctx, size_t budget) {
+    BOOL ok = TRUE;
+    while (ok && runs->count > AUDIT_MERGE_WAYS) {
+        const char *path = run_list_add(runs);
+        RunWriter writer;
+        if (!path || !writer_open(&writer, path, merge_buffer_size(budget))) {
+            ok = FALSE;
+            break;
+        }
+        ok = merge_some(runs, AUDIT_MERGE_WAYS, compare, visit_write, &writer, budget);
+        ok = writer_close(&writer) && ok;
+        run_list_drop(runs, AUDIT_MERGE_WAYS);
+    }
+    if (ok) ok = merge_some(runs, runs->count, compare, visit, ctx, budget);
+    run_list_drop(runs, runs->count);
+    return ok;
+}
+
+// ── Phase 1: (size, path) runs ──────────────────────────────────────────
+
+typedef struct EnumerateState {
+    RecordBuffer buffer;
+    RunList *runs;
+    VisitedSet visited;
+    size_t frontier_bytes;       // Path bytes of the directories still queued
+    uint64_t files;
+    uint64_t bytes;
+    BOOL failed;
+} EnumerateState;
+
+// Memory the walk holds for directories: the visited set and the queue.
+// It is counted against the record buffer, so a tree of many directories
+// flushes runs sooner instead of going over the budget.
+static size_t directory_bytes(const EnumerateState *state, const ScanFrontier *frontier) {
+    return state->visited.capacity * sizeof(DirIdentity) +
+           (size_t)frontier->capacity * sizeof(char*) + state->frontier_bytes;
+}
+
+static void enumerate_directory(EnumerateState *state, const char *dir_path,
+                                ScanFrontier *frontier) {
+    // A link loop or a second path to a directory would list its files twice
+    DirIdentity identity;
+    uint64_t mtime;
+    if (get_directory_identity(dir_path, &identity, &mtime) == 0 &&
+        !visited_insert(&state->visited, &identity)) {
+        return;
+    }
+
+    char search_path[MAX_PATH];
+    snprintf(search_path, MAX_PATH, "%s\\*", dir_path);
+
+    WIN32_FIND_DATA find_data;
+    HANDLE hFind = FindFirstFile(search_path, &find_data);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+
+    do {
+        if (strcmp(find_data.cFileName, ".") == 0 ||
+            strcmp(find_data.cFileName, "..") == 0) {
+            continue;
+        }
+
+        char full_path[MAX_PATH];
+        snprintf(full_path, MAX_PATH, "%s\\%s", dir_path, find_data.cFileName);
+
+        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            // A directory left out would make the report silently incomplete
+            if (!should_descend(&find_data)) continue;
+            if (!frontier_push(frontier, full_path)) {
+                state->failed = TRUE;
+                break;
+            }
+            state->frontier_bytes += strlen(full_path) + 1;
+            continue;
+        }
+        if (should_ignore_file(find_data.cFileName)) continue;
+
+        // Empty files all match each other and are never reported
+        uint64_t filesize = ((uint64_t)find_data.nFileSizeHigh << 32) |
+                            find_data.nFileSizeLow;
+        if (filesize == 0) continue;
+
+        state->buffer.held = directory_bytes(state, frontier);
+        if (!buffer_add(&state->buffer, filesize, NULL, full_path)) {
+            if (!buffer_flush(&state->buffer, state->runs, compare_size)) {
+                state->failed = TRUE;
+                break;
+            }
+            if (!buffer_add(&state->buffer, filesize, NULL, full_path)) {
+                safe_printf("[AUDIT] --memory-budget is too small for the directories "
+                            "below %s\n", dir_path);
+                state->failed = TRUE;
+                break;
+            }
+        }
+        state->files++;
+        state->bytes += filesize;
+    } while (FindNextFile(hFind, &find_data) && !audit_stopped());
+
+    FindClose(hFind);
+}
+
+static BOOL enumerate_roots(char directories[][MAX_PATH], int count, RunList *runs,
+                            size_t budget, uint64_t *files) {
+    EnumerateState state;
+    memset(&state, 0, sizeof(state));
+    state.runs = runs;
+
+    // A flush's run writer comes on top of the records
+    size_t records = budget > MERGE_BUFFER_MAX * 2 ? budget - MERGE_BUFFER_MAX : budget / 2;
+    if (!buffer_init(&state.buffer, records)) return FALSE;
+    visited_init(&state.visited);
+
+    for (int i = 0; i < count && !state.failed && !audit_stopped(); i++) {
+        safe_printf("[AUDIT] Enumerating %s\n", directories[i]);
+        ScanFrontier frontier;
+        frontier_init(&frontier);
+        if (!frontier_push(&frontier, directories[i])) state.failed = TRUE;
+        state.frontier_bytes = strlen(directories[i]) + 1;
+        while (frontier.count > 0 && !state.failed && !audit_stopped()) {
+            char *dir_path = frontier_pop(&frontier);
+            state.frontier_bytes -= strlen(dir_path) + 1;
+            enumerate_directory(&state, dir_path, &frontier);
+            free(dir_path);
+        }
+        frontier_free(&frontier);
+    }
+
+    if (!state.failed && !buffer_flush(&state.buffer, runs, compare_size)) {
+        state.failed = TRUE;
+    }
+    safe_printf("[AUDIT] %llu files (%.1f MB) in %d sorted runs\n",
+                (unsigned long long)state.files, state.bytes / (1024.0 * 1024.0),
+                runs->count);
+
+    *files = state.files;
+    buffer_free(&state.buffer);
+    visited_free(&state.visited);
+    return !state.failed && !audit_stopped();
+}
+
+// ── Phase 2: hash the size collisions ───────────────────────────────────
+
+// Write every record whose size another record shares: the first of a
+// size waits in pending until a second shows up
+typedef struct CandidateState {
+    RunWriter writer;
+    AuditRecord *pending;
+    BOOL have_pending;
+    BOOL pending_written;
+    uint64_t files;
+    uint64_t bytes;
+} CandidateState;
+
+static BOOL visit_candidate(const AuditRecord *record, void *ctx) {
+    CandidateState *state = (CandidateState*)ctx;
+    if (state->have_pending && state->pending->filesize == record->filesize) {
+        if (!state->pending_written) {
+            if (!writer_put(&state->writer, state->pending)) return FALSE;
+            state->pending_written = TRUE;
+            state->files++;
+            state->bytes += record->filesize;
+        }
+        state->files++;
+        state->bytes += record->filesize;
+        return writer_put(&state->writer, record);
+    }
+
+    memcpy(state->pending, record, RECORD_HEADER_BYTES + record->path_len + 1);
+    state->have_pending = TRUE;
+    state->pending_written = FALSE;
+    return TRUE;
+}
+
+typedef struct HashState {
+    CRITICAL_SECTION read_lock;
+    RunReader candidates;
+    BOOL read_failed;
+    CRITICAL_SECTION buffer_lock;
+    RecordBuffer buffer;
+    RunList *runs;
+    volatile LONGLONG hashed;
+    volatile LONGLONG unreadable;
+    uint64_t total;
+    ULONGLONG last_progress;
+    volatile BOOL failed;
+} HashState;
+
+// Next candidate into record; FALSE when there are no more
+static BOOL next_candidate(HashState *state, AuditRecord *record) {
+    BOOL more = FALSE;
+    EnterCriticalSection(&state->read_lock);
+    if (!state->failed && reader_next(&state->candidates, &state->read_failed)) {
+        AuditRecord *next = state->candidates.record;
+        memcpy(record, next, RECORD_HEADER_BYTES + next->path_len + 1);
+        more = TRUE;
+    }
+    if (state->read_failed) state->failed = TRUE;
+
+    ULONGLONG now = GetTickCount64();
+    if (now - state->last_progress >= PROGRESS_INTERVAL_MS) {
+        state->last_progress = now;
+        safe_printf("[AUDIT] Hashed %lld of %llu candidates\n",
+                    (long long)state->hashed, (unsigned long long)state->total);
+    }
+    LeaveCriticalSection(&state->read_lock);
+    return more;
+}
+
+static DWORD WINAPI hash_worker(LPVOID param) {
+    HashState *state = (HashState*)param;
+    AuditRecord *record = malloc(RECORD_MAX_BYTES);
+    if (!record) {
+        state->failed = TRUE;
+        return 1;
+    }
+
+    char hex[HASH_SIZE * 2 + 1];
+    while (!audit_stopped() && next_candidate(state, record)) {
+        if (hash_file(record->path, hex) != 0) {
+            InterlockedIncrement64(&state->unreadable);
+            safe_printf("[SKIP] %s (could not be read)\n", record->path);
+            continue;
+        }
+        InterlockedIncrement64(&state->hashed);
+
+        EnterCriticalSection(&state->buffer_lock);
+        if (!buffer_add(&state->buffer, record->filesize, hex, record->path)) {
+            if (!buffer_flush(&state->buffer, state->runs, compare_hash)) {
+                state->failed = TRUE;
+            } else {
+                buffer_add(&state->buffer, record->filesize, hex, record->path);
+            }
+        }
+        LeaveCriticalSection(&state->buffer_lock);
+    }
+
+    free(record);
+    return 0;
+}
+
+static BOOL hash_candidates(const char *candidate_path, uint64_t total, RunList *runs,
+                            size_t budget) {
+    HashState state;
+    memset(&state, 0, sizeof(state));
+    state.runs = runs;
+    state.total = total;
+    state.last_progress = GetTickCount64();
+
+    // hash_file's own read buffers come on top of the records
+    size_t reserved = (size_t)AUDIT_HASH_THREADS * BUFFER_SIZE + MERGE_BUFFER_MAX;
+    size_t records = budget > reserved * 2 ? budget - reserved : budget / 2;
+    if (!buffer_init(&state.buffer, records)) return FALSE;
+    if (!reader_open(&state.candidates, candidate_path, MERGE_BUFFER_MAX)) {
+        buffer_free(&state.buffer);
+        return FALSE;
+    }
+    InitializeCriticalSection(&state.read_lock);
+    InitializeCriticalSection(&state.buffer_lock);
+
+    HANDLE threads[AUDIT_HASH_THREADS];
+    int started = 0;
+    for (int i = 0; i < AUDIT_HASH_THREADS; i++) {
+        threads[started] = CreateThread(NULL, 0, hash_worker, &state, 0, NULL);
+        if (threads[started]) started++;
+    }
+    if (started == 0) {
+        hash_worker(&state);
+    } else {
+        WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+        for (int i = 0; i < started; i++) {
+            CloseHandle(threads[i]);
+        }
+    }
+
+    if (!state.failed && !buffer_flush(&state.buffer, runs, compare_hash)) {
+        state.failed = TRUE;
+    }
+    safe_printf("[AUDIT] Hashed %lld candidates into %d sorted runs (%lld unreadable)\n",
+                (long long)state.hashed, runs->count, (long long)state.unreadable);
+
+    DeleteCriticalSection(&state.read_lock);
+    DeleteCriticalSection(&state.buffer_lock);
+    reader_close(&state.candidates);
+    buffer_free(&state.buffer);
+    return !state.failed && !audit_stopped();
+}
+
+// ── Phase 3: groups ─────────────────────────────────────────────────────
+
+// Groups are printed as the merge reaches them; only the first file of
+// the current digest is held
+typedef struct GroupState {
+    AuditRecord *first;
+    BOOL have_first;
+    BOOL in_group;
+    int groups;
+    uint64_t files;
+    uint64_t reclaimable;
+} GroupState;
+
+static void end_group(GroupState *state) {
+    if (state->in_group) safe_printf("\n");
+    state->in_group = FALSE;
+}
+
+static BOOL visit_group(const AuditRecord *record, void *ctx) {
+    GroupState *state = (GroupState*)ctx;
+    if (state->have_first &&
+        memcmp(state->first->hash, record->hash, sizeof(record->hash)) == 0) {
+        if (!state->in_group) {
+            state->groups++;
+            state->files++;
+            state->in_group = TRUE;
+            safe_printf("Duplicate group #%d (hash: %.*s):\n", state->groups,
+                        (int)sizeof(record->hash), record->hash);
+            safe_printf(" - %s\n", state->first->path);
+        }
+        state->files++;
+        state->reclaimable += record->filesize;
+        safe_printf(" - %s\n", record->path);
+        return TRUE;
+    }
+
+    end_group(state);
+    memcpy(state->first, record, RECORD_HEADER_BYTES + record->path_len + 1);
+    state->have_first = TRUE;
+    return TRUE;
+}
+
+// ── Audit ───────────────────────────────────────────────────────────────
+
+BOOL run_batch_audit(char directories[][MAX_PATH], int count, size_t budget) {
+    RunList runs;
+    memset(&runs, 0, sizeof(runs));
+    ULONGLONG started = GetTickCount64();
+    safe_printf("[AUDIT] Batch audit of %d directories within %llu MB\n",
+                count, (unsigned long long)(budget / (1024 * 1024)));
+
+    uint64_t files = 0;
+    BOOL ok = enumerate_roots(directories, count, &runs, budget, &files);
+
+    CandidateState candidates;
+    memset(&candidates, 0, sizeof(candidates));
+    char name[64];
+    char candidate_path[MAX_PATH];
+    snprintf(name, sizeof(name), "ddas_audit_%lu_candidates.run",
+             (unsigned long)GetCurrentProcessId());
+    get_state_file_path(name, candidate_path, sizeof(candidate_path));
+    if (ok) {
+        candidates.pending = malloc(RECORD_MAX_BYTES);
+        ok = candidates.pending &&
+             writer_open(&candidates.writer, candidate_path, MERGE_BUFFER_MAX);
+        if (ok) {
+            ok = merge_runs(&runs, compare_size, visit_candidate, &candidates, budget);
+            ok = writer_close(&candidates.writer) && ok;
+        }
+        free(candidates.pending);
+        if (ok) {
+            safe_printf("[AUDIT] %llu of %llu files share their size with another "
+                        "(%.1f MB to hash)\n",
+                        (unsigned long long)candidates.files, (unsigned long long)files,
+                        candidates.bytes / (1024.0 * 1024.0));
+        }
+    }
+    run_list_drop(&runs, runs.count);
+
+    if (ok && candidates.files > 0) {
+        ok = hash_candidates(candidate_path, candidates.files, &runs, budget);
+    }
+    DeleteFile(candidate_path);
+
+    GroupState groups;
+    memset(&groups, 0, sizeof(groups));
+    if (ok) {
+        groups.first = malloc(RECORD_MAX_BYTES);
+        ok = groups.first != NULL;
+    }
+    if (ok) {
+        safe_printf("\n=== DUPLICATE FILES (Audit) ===\n\n");
+        ok = merge_runs(&runs, compare_hash, visit_group, &groups, budget);
+        end_group(&groups);
+    }
+    free(groups.first);
+    run_list_free(&runs);
+
+    if (!ok) {
+        safe_printf("[AUDIT] Audit %s; no report\n",
+                    audit_stopped() ? "stopped" : "failed");
+        return FALSE;
+    }
+
+    if (groups.groups > 0) {
+        safe_printf("Found %d duplicate groups (%llu total duplicate files).\n",
+                    groups.groups, (unsigned long long)groups.files);
+        safe_printf("[AUDIT] %.1f MB reclaimable by keeping one file per group\n",
+                    groups.reclaimable / (1024.0 * 1024.0));
+    } else {
+        safe_printf("No duplicates found.\n");
+    }
+    safe_printf("[AUDIT] Finished in %.1f s\n", (GetTickCount64() - started) / 1000.0);
+    return TRUE;
+}
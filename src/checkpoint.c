@@ -0,0 +1,150 @@
+//checkpoint.c
+#include "checkpoint.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECKPOINT_MAGIC "DDASCKPT 1"
+
+void frontier_init(ScanFrontier *frontier) {
+    frontier->count = 0;
+    frontier->dirs = malloc(sizeof(char*) * 64);
+    frontier->capacity = frontier->dirs ? 64 : 0;
+    frontier->dirs_completed = 0;
+    frontier->files_processed = 0;
+}
+
+BOOL frontier_push(ScanFrontier *frontier, const char *dir_path) {
+    if (frontier->count >= frontier->capacity) {
+        int capacity = frontier->capacity ? frontier->capacity * 2 : 64;
+        char **dirs = realloc(frontier->dirs, sizeof(char*) * capacity);
+        if (!dirs) {
+            safe_printf("[ERROR] Out of memory queueing directory: %s\n", dir_path);
+            return FALSE;
+        }
+        frontier->dirs = dirs;
+        frontier->capacity = capacity;
+    }
+    char *copy = _strdup(dir_path);
+    if (!copy) {
+        safe_printf("[ERROR] Out of memory queueing directory: %s\n", dir_path);
+        return FALSE;
+    }
+    frontier->dirs[frontier->count++] = copy;
+    return TRUE;
+}
+
+char* frontier_pop(ScanFrontier *frontier) {
+    if (frontier->count == 0) return NULL;
+    return frontier->dirs[--frontier->count];
+}
+
+void frontier_free(ScanFrontier *frontier) {
+    for (int i = 0; i < frontier->count; i++) {
+        free(frontier->dirs[i]);
+    }
+    free(frontier->dirs);
+    frontier->dirs = NULL;
+    frontier->count = 0;
+    frontier->capacity = 0;
+}
+
+// One checkpoint file per root: ddas_scan_<fnv1a(root)>.ckpt
+static void checkpoint_path_for(const char *root_path, char *buffer, size_t buffer_size) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const char *p = root_path; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 1099511628211ULL;
+    }
+    char filename[64];
+    snprintf(filename, sizeof(filename), "ddas_scan_%016llx.ckpt",
+             (unsigned long long)h);
+    get_state_file_path(filename, buffer, buffer_size);
+}
+
+BOOL checkpoint_load(const char *root_path, ScanFrontier *frontier) {
+    char path[MAX_PATH];
+    checkpoint_path_for(root_path, path, sizeof(path));
+
+    FILE *in = fopen(path, "r");
+    if (!in) return FALSE;
+
+    char line[MAX_PATH + 64];
+    BOOL valid = FALSE;
+
+    if (fgets(line, sizeof(line), in) &&
+        strncmp(line, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC)) == 0 &&
+        fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        // Guard against a hash collision between two roots
+        valid = strncmp(line, "root\t", 5) == 0 && strcmp(line + 5, root_path) == 0;
+    }
+
+    while (valid && fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "completed\t", 10) == 0) {
+            unsigned long long dirs = 0, files = 0;
+            sscanf(line + 10, "%llu\t%llu", &dirs, &files);
+            frontier->dirs_completed = dirs;
+            frontier->files_processed = files;
+        } else if (strncmp(line, "pending\t", 8) == 0 && line[8] != '\0') {
+            // A partial frontier would lose directories: scan from the top
+            valid = frontier_push(frontier, line + 8);
+        }
+    }
+    fclose(in);
+
+    // A checkpoint with nothing pending is as good as no checkpoint
+    if (!valid || frontier->count == 0) {
+        for (int i = 0; i < frontier->count; i++) free(frontier->dirs[i]);
+        frontier->count = 0;
+        frontier->dirs_completed = 0;
+        frontier->files_processed = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL checkpoint_save(const char *root_path, const ScanFrontier *frontier,
+                     const ScanFrontier *deferred_links, const char *in_progress_dir) {
+    char path[MAX_PATH];
+    char tmp_path[MAX_PATH + 8];
+    checkpoint_path_for(root_path, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) return FALSE;
+
+    fprintf(out, "%s\n", CHECKPOINT_MAGIC);
+    fprintf(out, "root\t%s\n", root_path);
+    fprintf(out, "completed\t%llu\t%llu\n",
+            (unsigned long long)frontier->dirs_completed,
+            (unsigned long long)frontier->files_processed);
+    // Stack order is preserved so a resumed scan pops in the same order
+    for (int i = 0; deferred_links && i < deferred_links->count; i++) {
+        fprintf(out, "pending\t%s\n", deferred_links->dirs[i]);
+    }
+    for (int i = 0; i < frontier->count; i++) {
+        fprintf(out, "pending\t%s\n", frontier->dirs[i]);
+    }
+    if (in_progress_dir) {
+        fprintf(out, "pending\t%s\n", in_progress_dir);
+    }
+
+    BOOL ok = (fflush(out) == 0);
+    fclose(out);
+
+    if (!ok || !MoveFileEx(tmp_path, path,
+                           MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DeleteFile(tmp_path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void checkpoint_delete(const char *root_path) {
+    char path[MAX_PATH];
+    checkpoint_path_for(root_path, path, sizeof(path));
+    DeleteFile(path);
+}
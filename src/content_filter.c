@@ -0,0 +1,125 @@
+//content_filter.c
+#include "content_filter.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNTER_MAX 15
+
+// Where key's counters are: a block from the high bits, then four 7-bit
+// positions inside it from a remix (a position may repeat; adds and
+// removes repeat it alike)
+static const uint64_t* key_block(const FilterTable *table, uint64_t key) {
+    size_t block = (size_t)(key >> 32) & (table->block_count - 1);
+    return table->words + block * FILTER_BLOCK_WORDS;
+}
+
+static void key_positions(uint64_t key, uint32_t positions[FILTER_HASHES]) {
+    uint64_t bits = key * 0x9E3779B97F4A7C15ull;
+    for (int i = 0; i < FILTER_HASHES; i++) {
+        positions[i] = (uint32_t)(bits >> (64 - 7 * (i + 1))) & (FILTER_BLOCK_COUNTERS - 1);
+    }
+}
+
+static uint32_t counter_get(const uint64_t *block, uint32_t pos) {
+    return (uint32_t)(block[pos >> 4] >> ((pos & 15) * 4)) & 0xF;
+}
+
+static void counter_step(uint64_t *block, uint32_t pos, int delta) {
+    uint32_t value = counter_get(block, pos);
+    // Saturated counters no longer know their count: leave them be
+    if (value == COUNTER_MAX) return;
+    if (delta < 0 && value == 0) return;
+    uint64_t shift = (pos & 15) * 4;
+    block[pos >> 4] += delta > 0 ? (1ull << shift) : (uint64_t)0 - (1ull << shift);
+}
+
+static size_t blocks_for(size_t expected) {
+    size_t blocks = 1;
+    while (blocks * FILTER_KEYS_PER_BLOCK < expected) blocks *= 2;
+    return blocks;
+}
+
+// Zeroed table of the given size, counters aligned to a cache line
+static FilterTable* table_alloc(size_t block_count) {
+    size_t bytes = sizeof(FilterTable) + FILTER_BLOCK_BYTES + block_count * FILTER_BLOCK_BYTES;
+    FilterTable *table = calloc(1, bytes);
+    if (!table) return NULL;
+    uintptr_t words = (uintptr_t)(table + 1);
+    words = (words + FILTER_BLOCK_BYTES - 1) & ~(uintptr_t)(FILTER_BLOCK_BYTES - 1);
+    table->block_count = block_count;
+    table->words = (uint64_t*)words;
+    return table;
+}
+
+static void table_step(FilterTable *table, uint64_t key, int delta) {
+    uint64_t *block = (uint64_t*)key_block(table, key);
+    uint32_t positions[FILTER_HASHES];
+    key_positions(key, positions);
+    for (int i = 0; i < FILTER_HASHES; i++) {
+        counter_step(block, positions[i], delta);
+    }
+}
+
+BOOL content_filter_init(ContentFilter *filter, size_t expected) {
+    filter->keys = 0;
+    filter->table = table_alloc(blocks_for(expected));
+    return filter->table != NULL;
+}
+
+void content_filter_free(ContentFilter *filter) {
+    free(filter->table);
+    filter->table = NULL;
+    filter->keys = 0;
+}
+
+BOOL content_filter_may_contain(const ContentFilter *filter, uint64_t key) {
+    const FilterTable *table = filter->table;
+    if (!table) return TRUE;
+
+    const uint64_t *block = key_block(table, key);
+    uint32_t positions[FILTER_HASHES];
+    key_positions(key, positions);
+    for (int i = 0; i < FILTER_HASHES; i++) {
+        if (counter_get(block, positions[i]) == 0) return FALSE;
+    }
+    return TRUE;
+}
+
+void content_filter_add(ContentFilter *filter, uint64_t key) {
+    filter->keys++;
+    if (filter->table) table_step(filter->table, key, 1);
+}
+
+void content_filter_remove(ContentFilter *filter, uint64_t key) {
+    if (filter->keys > 0) filter->keys--;
+    if (filter->table) table_step(filter->table, key, -1);
+}
+
+size_t content_filter_capacity(const ContentFilter *filter) {
+    const FilterTable *table = filter->table;
+    return table ? table->block_count * FILTER_KEYS_PER_BLOCK : 0;
+}
+
+BOOL content_filter_wants_growth(const ContentFilter *filter) {
+    return filter->keys > content_filter_capacity(filter);
+}
+
+FilterTable* content_filter_table_alloc(size_t expected) {
+    return table_alloc(blocks_for(expected));
+}
+
+void content_filter_table_add(FilterTable *table, uint64_t key) {
+    table_step(table, key, 1);
+}
+
+void content_filter_table_remove(FilterTable *table, uint64_t key) {
+    table_step(table, key, -1);
+}
+
+FilterTable* content_filter_swap(ContentFilter *filter, FilterTable *table) {
+    // Counters first, then the pointer: a reader never sees a half-filled table
+    FilterTable *old = filter->table;
+    MemoryBarrier();
+    filter->table = table;
+    return old;
+}
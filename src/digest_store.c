@@ -0,0 +1,425 @@
+//digest_store.c
+#include "digest_store.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIGEST_STORE_INITIAL_BUCKETS 16384
+#define DIGEST_JOURNAL_BUFFER (256 * 1024)
+
+DigestStore *g_digest_store = NULL;
+
+static size_t hash_path(const char *path, size_t table_size) {
+    unsigned int hash = 5381;
+    int c;
+    while ((c = (unsigned char)*path++))
+        hash = ((hash << 5) + hash) + c;
+    return hash % table_size;
+}
+
+static DigestRecord* find_record(DigestStore *store, const char *filepath,
+                                 DigestRecord ***link_out) {
+    DigestRecord **link = &store->buckets[hash_path(filepath, store->size)];
+    while (*link) {
+        if (strcmp((*link)->filepath, filepath) == 0) {
+            if (link_out) *link_out = link;
+            return *link;
+        }
+        link = &(*link)->next;
+    }
+    if (link_out) *link_out = link;
+    return NULL;
+}
+
+static void grow_buckets(DigestStore *store) {
+    size_t new_size = store->size * 2;
+    DigestRecord **new_buckets = calloc(new_size, sizeof(DigestRecord*));
+    if (!new_buckets) return;
+
+    for (size_t i = 0; i < store->size; i++) {
+        DigestRecord *current = store->buckets[i];
+        while (current) {
+            DigestRecord *next = current->next;
+            size_t index = hash_path(current->filepath, new_size);
+            current->next = new_buckets[index];
+            new_buckets[index] = current;
+            current = next;
+        }
+    }
+    free(store->buckets);
+    store->buckets = new_buckets;
+    store->size = new_size;
+}
+
+// Insert or overwrite a record in memory only
+static DigestRecord* set_record(DigestStore *store, const char *filepath,
+                                uint64_t filesize, uint64_t mtime,
+                                const char *hash) {
+    DigestRecord **link;
+    DigestRecord *record = find_record(store, filepath, &link);
+
+    if (!record) {
+        if (store->count >= store->size * 2) {
+            grow_buckets(store);
+            find_record(store, filepath, &link);
+        }
+        record = malloc(sizeof(DigestRecord));
+        if (!record) return NULL;
+        record->filepath = _strdup(filepath);
+        if (!record->filepath) {
+            free(record);
+            return NULL;
+        }
+        record->next = NULL;
+        *link = record;
+        store->count++;
+    }
+
+    record->filesize = filesize;
+    record->mtime = mtime;
+    strncpy(record->hash, hash, HASH_SIZE * 2);
+    record->hash[HASH_SIZE * 2] = '\0';
+    return record;
+}
+
+static void delete_record(DigestStore *store, const char *filepath) {
+    DigestRecord **link;
+    DigestRecord *record = find_record(store, filepath, &link);
+    if (!record) return;
+
+    *link = record->next;
+    free(record->filepath);
+    free(record);
+    store->count--;
+}
+
+static void write_record(FILE *out, const DigestRecord *record) {
+    fprintf(out, "F\t%llu\t%llu\t%s\t%s\n",
+            (unsigned long long)record->filesize,
+            (unsigned long long)record->mtime,
+            record->hash[0] ? record->hash : "-",
+            record->filepath);
+}
+
+// Journal lines:  F <size> <mtime> <hash|-> <path>   or   D <path>
+static void load_journal(DigestStore *store) {
+    FILE *in = fopen(store->journal_path, "r");
+    if (!in) return;
+
+    char line[MAX_PATH + 160];
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        store->journal_lines++;
+
+        if (line[0] == 'D' && line[1] == '\t') {
+            delete_record(store, line + 2);
+            continue;
+        }
+        if (line[0] != 'F' || line[1] != '\t') continue;
+
+        char *fields[4];
+        char *cursor = line + 2;
+        int n = 0;
+        while (n < 4) {
+            fields[n++] = cursor;
+            char *tab = strchr(cursor, '\t');
+            if (!tab) break;
+            *tab = '\0';
+            cursor = tab + 1;
+        }
+        if (n < 4 || fields[3][0] == '\0') continue;   // Truncated tail write
+
+        const char *hash = strcmp(fields[2], "-") == 0 ? "" : fields[2];
+        if (hash[0] && strlen(hash) != HASH_SIZE * 2) continue;
+
+        set_record(store, fields[3],
+                   strtoull(fields[0], NULL, 10),
+                   strtoull(fields[1], NULL, 10), hash);
+    }
+    fclose(in);
+}
+
+static FILE* open_journal(DigestStore *store) {
+    FILE *journal = fopen(store->journal_path, "a");
+    if (journal) {
+        setvbuf(journal, NULL, _IOFBF, DIGEST_JOURNAL_BUFFER);
+    }
+    return journal;
+}
+
+BOOL digest_store_open(const char *store_path) {
+    if (g_digest_store) return TRUE;
+
+    DigestStore *store = calloc(1, sizeof(DigestStore));
+    if (!store) return FALSE;
+
+    store->size = DIGEST_STORE_INITIAL_BUCKETS;
+    store->buckets = calloc(store->size, sizeof(DigestRecord*));
+    if (!store->buckets) {
+        free(store);
+        return FALSE;
+    }
+    strncpy(store->journal_path, store_path, MAX_PATH - 1);
+    store->journal_path[MAX_PATH - 1] = '\0';
+    InitializeCriticalSection(&store->lock);
+
+    load_journal(store);
+    g_digest_store = store;
+
+    // Drop superseded records left by earlier runs before appending
+    if (store->journal_lines > store->count * 2 + 1024) {
+        digest_store_compact();
+    }
+
+    if (!store->journal) {
+        store->journal = open_journal(store);
+    }
+    if (!store->journal) {
+        safe_printf("[STORE] Cannot open digest journal: %s\n", store_path);
+    }
+
+    safe_printf("[STORE] Loaded %llu cached digests from %s\n",
+                (unsigned long long)store->count, store_path);
+    return TRUE;
+}
+
+void digest_store_close(void) {
+    DigestStore *store = g_digest_store;
+    if (!store) return;
+    g_digest_store = NULL;
+
+    if (store->journal) {
+        fclose(store->journal);
+    }
+    for (size_t i = 0; i < store->size; i++) {
+        DigestRecord *current = store->buckets[i];
+        while (current) {
+            DigestRecord *next = current->next;
+            free(current->filepath);
+            free(current);
+            current = next;
+        }
+    }
+    DeleteCriticalSection(&store->lock);
+    free(store->buckets);
+    free(store);
+}
+
+BOOL digest_store_lookup(const char *filepath, uint64_t filesize,
+                         uint64_t mtime, char *hash_out) {
+    DigestStore *store = g_digest_store;
+    if (!store) return FALSE;
+
+    EnterCriticalSection(&store->lock);
+    DigestRecord *record = find_record(store, filepath, NULL);
+    BOOL hit = record && record->filesize == filesize &&
+               record->mtime == mtime && record->hash[0] != '\0';
+    if (hit) {
+        strcpy(hash_out, record->hash);
+    }
+    LeaveCriticalSection(&store->lock);
+    return hit;
+}
+
+void digest_store_put(const char *filepath, uint64_t filesize,
+                      uint64_t mtime, const char *hash) {
+    DigestStore *store = g_digest_store;
+    if (!store) return;
+
+    EnterCriticalSection(&store->lock);
+    DigestRecord *record = set_record(store, filepath, filesize, mtime, hash);
+    if (record && store->journal) {
+        write_record(store->journal, record);
+        store->journal_lines++;
+    }
+    LeaveCriticalSection(&store->lock);
+}
+
+void digest_store_remove(const char *filepath) {
+    DigestStore *store = g_digest_store;
+    if (!store) return;
+
+    EnterCriticalSection(&store->lock);
+    if (find_record(store, filepath, NULL)) {
+        delete_record(store, filepath);
+        if (store->journal) {
+            fprintf(store->journal, "D\t%s\n", filepath);
+            store->journal_lines++;
+        }
+    }
+    LeaveCriticalSection(&store->lock);
+}
+
+void digest_store_flush(void) {
+    DigestStore *store = g_digest_store;
+    if (!store) return;
+
+    EnterCriticalSection(&store->lock);
+    if (store->journal) {
+        fflush(store->journal);
+    }
+    LeaveCriticalSection(&store->lock);
+}
+
+void digest_store_compact(void) {
+    DigestStore *store = g_digest_store;
+    if (!store) return;
+
+    char tmp_path[MAX_PATH + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", store->journal_path);
+
+    EnterCriticalSection(&store->lock);
+
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        LeaveCriticalSection(&store->lock);
+        return;
+    }
+    setvbuf(out, NULL, _IOFBF, DIGEST_JOURNAL_BUFFER);
+    for (size_t i = 0; i < store->size; i++) {
+        for (DigestRecord *r = store->buckets[i]; r; r = r->next) {
+            write_record(out, r);
+        }
+    }
+    BOOL ok = (fflush(out) == 0);
+    fclose(out);
+
+    if (store->journal) {
+        fclose(store->journal);
+        store->journal = NULL;
+    }
+    if (ok && MoveFileEx(tmp_path, store->journal_path,
+                         MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        store->journal_lines = store->count;
+    } else {
+        DeleteFile(tmp_path);
+    }
+    store->journal = open_journal(store);
+
+    LeaveCriticalSection(&store->lock);
+}
+
+static BOOL record_under(const DigestRecord *r, const char *dir_path,
+                         size_t prefix_len, BOOL has_separator) {
+    return strncmp(r->filepath, dir_path, prefix_len) == 0 &&
+           (has_separator || r->filepath[prefix_len] == '\\');
+}
+
+void digest_store_for_each_under(const char *dir_path,
+                                 DigestStoreVisitor visit, void *ctx) {
+    DigestStore *store = g_digest_store;
+    if (!store) return;
+
+    size_t prefix_len = strlen(dir_path);
+    BOOL has_separator = prefix_len > 0 && dir_path[prefix_len - 1] == '\\';
+
+    EnterCriticalSection(&store->lock);
+    for (size_t i = 0; i < store->size; i++) {
+        for (DigestRecord *r = store->buckets[i]; r; r = r->next) {
+            if (record_under(r, dir_path, prefix_len, has_separator)) {
+                visit(r, ctx);
+            }
+        }
+    }
+    LeaveCriticalSection(&store->lock);
+}
+
+size_t digest_store_copy_under(const char *dir_path, DigestStoreCursor *cursor,
+                               DigestCopy **batch, size_t *capacity, BOOL *failed) {
+    *failed = FALSE;
+    DigestStore *store = g_digest_store;
+    if (!store) return 0;
+
+    size_t prefix_len = strlen(dir_path);
+    BOOL has_separator = prefix_len > 0 && dir_path[prefix_len - 1] == '\\';
+    size_t count = 0;
+
+    EnterCriticalSection(&store->lock);
+    if (cursor->base_size == 0) cursor->base_size = store->size;
+
+    // The store only ever doubles, so a record that hashed to bucket b of
+    // base_size is always in a bucket congruent to b: walking those groups
+    // in order misses and repeats nothing, however much the store grows
+    // between calls.  A group is copied whole or left for the next call;
+    // one larger than the whole batch (the store grew far past base_size)
+    // grows the batch instead.
+    for (; cursor->next < cursor->base_size; cursor->next++) {
+        size_t matches = 0;
+        for (size_t i = cursor->next; i < store->size; i += cursor->base_size) {
+            for (DigestRecord *r = store->buckets[i]; r; r = r->next) {
+                if (record_under(r, dir_path, prefix_len, has_separator)) matches++;
+            }
+        }
+        if (count + matches > *capacity) {
+            if (count > 0) break;
+            DigestCopy *grown = realloc(*batch, sizeof(DigestCopy) * matches);
+            if (!grown) {
+                *failed = TRUE;
+                break;
+            }
+            *batch = grown;
+            *capacity = matches;
+        }
+
+        for (size_t i = cursor->next; i < store->size; i += cursor->base_size) {
+            for (DigestRecord *r = store->buckets[i]; r; r = r->next) {
+                if (!record_under(r, dir_path, prefix_len, has_separator) ||
+                    strlen(r->filepath) >= MAX_PATH) continue;
+                DigestCopy *copy = &(*batch)[count++];
+                strcpy(copy->filepath, r->filepath);
+                copy->filesize = r->filesize;
+                copy->mtime = r->mtime;
+                strcpy(copy->hash, r->hash);
+            }
+        }
+    }
+    LeaveCriticalSection(&store->lock);
+    return count;
+}
+
+void digest_store_rename_under(const char *old_dir, const char *new_dir) {
+    DigestStore *store = g_digest_store;
+    if (!store) return;
+
+    size_t old_len = strlen(old_dir);
+    DigestRecord **moved = NULL;
+    size_t count = 0, capacity = 0;
+
+    EnterCriticalSection(&store->lock);
+
+    // Collect first: re-keying relinks records between buckets
+    for (size_t i = 0; i < store->size; i++) {
+        for (DigestRecord *r = store->buckets[i]; r; r = r->next) {
+            if (strncmp(r->filepath, old_dir, old_len) != 0 ||
+                r->filepath[old_len] != '\\') continue;
+            if (count == capacity) {
+                size_t new_capacity = capacity ? capacity * 2 : 256;
+                DigestRecord **grown = realloc(moved, sizeof(DigestRecord*) * new_capacity);
+                if (!grown) break;
+                moved = grown;
+                capacity = new_capacity;
+            }
+            moved[count++] = r;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        DigestRecord *r = moved[i];
+        char new_path[MAX_PATH];
+        if (snprintf(new_path, MAX_PATH, "%s%s", new_dir, r->filepath + old_len) >= MAX_PATH) {
+            continue;
+        }
+        DigestRecord *fresh = set_record(store, new_path, r->filesize, r->mtime, r->hash);
+        if (!fresh) continue;
+        if (store->journal) {
+            write_record(store->journal, fresh);
+            fprintf(store->journal, "D\t%s\n", r->filepath);
+            store->journal_lines += 2;
+        }
+        delete_record(store, r->filepath);
+    }
+
+    LeaveCriticalSection(&store->lock);
+    free(moved);
+}
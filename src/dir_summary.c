@@ -0,0 +1,453 @@
+//dir_summary.c
+#include "dir_summary.h"
+#include "digest_store.h"
+#include "visited_set.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIR_SUMMARY_INITIAL_BUCKETS 4096
+#define DIR_SUMMARY_BUFFER (256 * 1024)
+
+DirSummaryTable *g_dir_summaries = NULL;
+
+static size_t hash_path(const char *path, size_t table_size) {
+    unsigned int hash = 5381;
+    int c;
+    while ((c = (unsigned char)*path++))
+        hash = ((hash << 5) + hash) + c;
+    return hash % table_size;
+}
+
+// TRUE if path equals dir or lies below it
+static BOOL path_is_within(const char *path, const char *dir, size_t dir_len) {
+    return strncmp(path, dir, dir_len) == 0 &&
+           (path[dir_len] == '\0' || path[dir_len] == '\\');
+}
+
+static DirSummary* find_summary(DirSummaryTable *table, const char *dirpath,
+                                DirSummary ***link_out) {
+    DirSummary **link = &table->buckets[hash_path(dirpath, table->size)];
+    while (*link) {
+        if (strcmp((*link)->dirpath, dirpath) == 0) {
+            if (link_out) *link_out = link;
+            return *link;
+        }
+        link = &(*link)->next;
+    }
+    if (link_out) *link_out = link;
+    return NULL;
+}
+
+static void grow_buckets(DirSummaryTable *table) {
+    size_t new_size = table->size * 2;
+    DirSummary **new_buckets = calloc(new_size, sizeof(DirSummary*));
+    if (!new_buckets) return;
+
+    for (size_t i = 0; i < table->size; i++) {
+        DirSummary *current = table->buckets[i];
+        while (current) {
+            DirSummary *next = current->next;
+            size_t index = hash_path(current->dirpath, new_size);
+            current->next = new_buckets[index];
+            new_buckets[index] = current;
+            current = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = new_buckets;
+    table->size = new_size;
+}
+
+static DirSummary* set_summary(DirSummaryTable *table, const char *dirpath,
+                               uint64_t mtime, uint32_t entry_count,
+                               uint64_t child_hash) {
+    DirSummary **link;
+    DirSummary *summary = find_summary(table, dirpath, &link);
+
+    if (!summary) {
+        if (table->count >= table->size * 2) {
+            grow_buckets(table);
+            find_summary(table, dirpath, &link);
+        }
+        summary = calloc(1, sizeof(DirSummary));
+        if (!summary) return NULL;
+        summary->dirpath = _strdup(dirpath);
+        if (!summary->dirpath) {
+            free(summary);
+            return NULL;
+        }
+        *link = summary;
+        table->count++;
+    }
+
+    summary->mtime = mtime;
+    summary->entry_count = entry_count;
+    summary->child_hash = child_hash;
+    return summary;
+}
+
+static void free_file_list(SummaryFile *file) {
+    while (file) {
+        SummaryFile *next = file->next;
+        free(file->filepath);
+        free(file);
+        file = next;
+    }
+}
+
+static void free_summary_files(DirSummary *summary) {
+    free_file_list(summary->files);
+    summary->files = NULL;
+}
+
+// File lines:  <mtime> <entry count> <child hash> <path>
+static void load_summaries(DirSummaryTable *table) {
+    FILE *in = fopen(table->store_path, "r");
+    if (!in) return;
+
+    // Summaries taken under another reparse policy list a different set of
+    // subdirectories, so they are discarded rather than replayed
+    char line[MAX_PATH + 96];
+    char header[32];
+    snprintf(header, sizeof(header), "DDASDIRS 1 %d", (int)g_reparse_policy);
+    if (!fgets(line, sizeof(line), in) ||
+        strncmp(line, header, strlen(header)) != 0) {
+        fclose(in);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *fields[4];
+        char *cursor = line;
+        int n = 0;
+        while (n < 4) {
+            fields[n++] = cursor;
+            char *tab = strchr(cursor, '\t');
+            if (!tab) break;
+            *tab = '\0';
+            cursor = tab + 1;
+        }
+        if (n < 4 || fields[3][0] == '\0') continue;
+
+        set_summary(table, fields[3],
+                    strtoull(fields[0], NULL, 10),
+                    (uint32_t)strtoul(fields[1], NULL, 10),
+                    strtoull(fields[2], NULL, 16));
+    }
+    fclose(in);
+}
+
+BOOL dir_summary_open(const char *store_path) {
+    if (g_dir_summaries) return TRUE;
+
+    DirSummaryTable *table = calloc(1, sizeof(DirSummaryTable));
+    if (!table) return FALSE;
+
+    table->size = DIR_SUMMARY_INITIAL_BUCKETS;
+    table->buckets = calloc(table->size, sizeof(DirSummary*));
+    if (!table->buckets) {
+        free(table);
+        return FALSE;
+    }
+    strncpy(table->store_path, store_path, MAX_PATH - 1);
+    table->store_path[MAX_PATH - 1] = '\0';
+    InitializeCriticalSection(&table->lock);
+
+    load_summaries(table);
+    g_dir_summaries = table;
+
+    safe_printf("[RECONCILE] Loaded %llu directory summaries from %s\n",
+                (unsigned long long)table->count, store_path);
+    return TRUE;
+}
+
+void dir_summary_close(void) {
+    DirSummaryTable *table = g_dir_summaries;
+    if (!table) return;
+    g_dir_summaries = NULL;
+
+    for (size_t i = 0; i < table->size; i++) {
+        DirSummary *current = table->buckets[i];
+        while (current) {
+            DirSummary *next = current->next;
+            free_summary_files(current);
+            free(current->dirpath);
+            free(current);
+            current = next;
+        }
+    }
+    DeleteCriticalSection(&table->lock);
+    free(table->buckets);
+    free(table);
+}
+
+uint64_t dir_summary_child_hash(const char *name, BOOL is_dir) {
+    // FNV-1a, then a finalizer so that summing contributions stays well mixed
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 0x100000001b3ULL;
+    }
+    h ^= is_dir ? 0x9e3779b97f4a7c15ULL : 0;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static const char* leaf_name(const char *path) {
+    const char *sep = strrchr(path, '\\');
+    return sep ? sep + 1 : path;
+}
+
+typedef struct PrepareContext {
+    DirSummaryTable *table;
+} PrepareContext;
+
+static void attach_store_record(const DigestRecord *record, void *ctx) {
+    PrepareContext *prep = (PrepareContext*)ctx;
+    const char *sep = strrchr(record->filepath, '\\');
+    if (!sep) return;
+
+    char parent[MAX_PATH];
+    size_t len = (size_t)(sep - record->filepath);
+    if (len >= MAX_PATH) return;
+    memcpy(parent, record->filepath, len);
+    parent[len] = '\0';
+
+    DirSummary *summary = find_summary(prep->table, parent, NULL);
+    if (!summary) return;
+
+    SummaryFile *file = malloc(sizeof(SummaryFile));
+    if (!file) return;
+    file->filepath = _strdup(record->filepath);
+    if (!file->filepath) {
+        free(file);
+        return;
+    }
+    file->filesize = record->filesize;
+    file->mtime = record->mtime;
+    strcpy(file->hash, record->hash);
+    file->next = summary->files;
+    summary->files = file;
+}
+
+void dir_summary_prepare(const char *root_path) {
+    DirSummaryTable *table = g_dir_summaries;
+    if (!table) return;
+
+    size_t root_len = strlen(root_path);
+
+    EnterCriticalSection(&table->lock);
+
+    for (size_t i = 0; i < table->size; i++) {
+        for (DirSummary *s = table->buckets[i]; s; s = s->next) {
+            if (!path_is_within(s->dirpath, root_path, root_len)) continue;
+            free_summary_files(s);
+            s->first_child = NULL;
+            s->next_sibling = NULL;
+            s->seen = FALSE;
+        }
+    }
+
+    // Link every directory to its parent's summary
+    for (size_t i = 0; i < table->size; i++) {
+        for (DirSummary *s = table->buckets[i]; s; s = s->next) {
+            if (strlen(s->dirpath) <= root_len ||
+                !path_is_within(s->dirpath, root_path, root_len)) continue;
+
+            char parent[MAX_PATH];
+            const char *sep = strrchr(s->dirpath, '\\');
+            size_t len = (size_t)(sep - s->dirpath);
+            memcpy(parent, s->dirpath, len);
+            parent[len] = '\0';
+
+            DirSummary *p = find_summary(table, parent, NULL);
+            if (p) {
+                s->next_sibling = p->first_child;
+                p->first_child = s;
+            }
+        }
+    }
+
+    PrepareContext prep = { table };
+    digest_store_for_each_under(root_path, attach_store_record, &prep);
+
+    LeaveCriticalSection(&table->lock);
+}
+
+void dir_summary_release(const char *root_path) {
+    DirSummaryTable *table = g_dir_summaries;
+    if (!table) return;
+
+    size_t root_len = strlen(root_path);
+
+    EnterCriticalSection(&table->lock);
+    for (size_t i = 0; i < table->size; i++) {
+        for (DirSummary *s = table->buckets[i]; s; s = s->next) {
+            if (!path_is_within(s->dirpath, root_path, root_len)) continue;
+            free_summary_files(s);
+            s->first_child = NULL;
+            s->next_sibling = NULL;
+        }
+    }
+    LeaveCriticalSection(&table->lock);
+}
+
+BOOL dir_summary_replay(const char *dir_path, uint64_t mtime,
+                        DirReplayVisitor on_file, DirReplayVisitor on_subdir,
+                        void *ctx) {
+    DirSummaryTable *table = g_dir_summaries;
+    if (!table) return FALSE;
+
+    EnterCriticalSection(&table->lock);
+
+    DirSummary *summary = find_summary(table, dir_path, NULL);
+    if (!summary || summary->mtime != mtime) {
+        LeaveCriticalSection(&table->lock);
+        return FALSE;
+    }
+
+    // The digest store and child summaries must account for exactly the
+    // entries seen at the last enumeration, otherwise something is missing
+    uint32_t count = 0;
+    uint32_t subdir_count = 0;
+    uint64_t hash = 0;
+    for (SummaryFile *f = summary->files; f; f = f->next) {
+        count++;
+        hash += dir_summary_child_hash(leaf_name(f->filepath), FALSE);
+    }
+    for (DirSummary *c = summary->first_child; c; c = c->next_sibling) {
+        subdir_count++;
+        hash += dir_summary_child_hash(leaf_name(c->dirpath), TRUE);
+    }
+    count += subdir_count;
+    if (count != summary->entry_count || hash != summary->child_hash) {
+        LeaveCriticalSection(&table->lock);
+        return FALSE;
+    }
+
+    // The visitors index files and send alerts, so they run unlocked: the
+    // files are taken off the summary (a directory is replayed once per
+    // prepare) and the subdirectory names copied
+    char **subdirs = NULL;
+    if (subdir_count > 0) {
+        subdirs = malloc(sizeof(char*) * subdir_count);
+        if (!subdirs) {
+            LeaveCriticalSection(&table->lock);
+            return FALSE;
+        }
+        uint32_t copied = 0;
+        for (DirSummary *c = summary->first_child; c; c = c->next_sibling) {
+            subdirs[copied] = _strdup(c->dirpath);
+            if (!subdirs[copied]) break;
+            copied++;
+        }
+        if (copied < subdir_count) {
+            while (copied > 0) free(subdirs[--copied]);
+            free(subdirs);
+            LeaveCriticalSection(&table->lock);
+            return FALSE;
+        }
+    }
+    SummaryFile *files = summary->files;
+    summary->files = NULL;
+    summary->seen = TRUE;
+
+    LeaveCriticalSection(&table->lock);
+
+    for (SummaryFile *f = files; f; f = f->next) {
+        on_file(f->filepath, f->filesize, f->mtime, f->hash, ctx);
+    }
+    for (uint32_t i = 0; i < subdir_count; i++) {
+        on_subdir(subdirs[i], 0, 0, NULL, ctx);
+        free(subdirs[i]);
+    }
+    free(subdirs);
+    free_file_list(files);
+    return TRUE;
+}
+
+BOOL dir_summary_known(const char *dir_path) {
+    DirSummaryTable *table = g_dir_summaries;
+    if (!table) return FALSE;
+
+    EnterCriticalSection(&table->lock);
+    BOOL known = find_summary(table, dir_path, NULL) != NULL;
+    LeaveCriticalSection(&table->lock);
+    return known;
+}
+
+void dir_summary_record(const char *dir_path, uint64_t mtime,
+                        uint32_t entry_count, uint64_t child_hash) {
+    DirSummaryTable *table = g_dir_summaries;
+    if (!table) return;
+
+    EnterCriticalSection(&table->lock);
+    DirSummary *summary = set_summary(table, dir_path, mtime, entry_count, child_hash);
+    if (summary) {
+        summary->seen = TRUE;
+    }
+    LeaveCriticalSection(&table->lock);
+}
+
+void dir_summary_save(const char *root_path) {
+    DirSummaryTable *table = g_dir_summaries;
+    if (!table) return;
+
+    char tmp_path[MAX_PATH + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", table->store_path);
+
+    EnterCriticalSection(&table->lock);
+
+    if (root_path) {
+        size_t root_len = strlen(root_path);
+        for (size_t i = 0; i < table->size; i++) {
+            DirSummary **link = &table->buckets[i];
+            while (*link) {
+                DirSummary *s = *link;
+                if (!s->seen && path_is_within(s->dirpath, root_path, root_len)) {
+                    *link = s->next;
+                    free_summary_files(s);
+                    free(s->dirpath);
+                    free(s);
+                    table->count--;
+                } else {
+                    link = &s->next;
+                }
+            }
+        }
+    }
+
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        LeaveCriticalSection(&table->lock);
+        return;
+    }
+    setvbuf(out, NULL, _IOFBF, DIR_SUMMARY_BUFFER);
+    fprintf(out, "DDASDIRS 1 %d\n", (int)g_reparse_policy);
+    for (size_t i = 0; i < table->size; i++) {
+        for (DirSummary *s = table->buckets[i]; s; s = s->next) {
+            fprintf(out, "%llu\t%lu\t%016llx\t%s\n",
+                    (unsigned long long)s->mtime,
+                    (unsigned long)s->entry_count,
+                    (unsigned long long)s->child_hash,
+                    s->dirpath);
+        }
+    }
+    BOOL ok = (fflush(out) == 0);
+    fclose(out);
+
+    if (!ok || !MoveFileEx(tmp_path, table->store_path,
+                           MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DeleteFile(tmp_path);
+    }
+
+    LeaveCriticalSection(&table->lock);
+}
@@ -1,7 +1,7 @@
 //file_ops.c
 #include "file_ops.h"
 #include "hash_table.h"
-#include "empty_files.h"
+#include "digest_store.h"
 #include "ipc_pipe.h"
 #include "utils.h"
 #include "blake3.h"
@@ -36,6 +36,48 @@ int is_file_empty(const char *filepath) {
     return (fileSize.QuadPart == 0) ? 1 : 0;
 }
 
+int get_file_stat(const char *filepath, uint64_t *filesize, uint64_t *mtime) {
+    WIN32_FILE_ATTRIBUTE_DATA file_data;
+    if (!GetFileAttributesEx(filepath, GetFileExInfoStandard, &file_data)) {
+        return -1;
+    }
+    
+    *filesize = ((uint64_t)file_data.nFileSizeHigh << 32) | file_data.nFileSizeLow;
+    *mtime = ((uint64_t)file_data.ftLastWriteTime.dwHighDateTime << 32) |
+             file_data.ftLastWriteTime.dwLowDateTime;
+    return 0;
+}
+
+int get_file_meta(const char *filepath, FileMeta *meta) {
+    HANDLE hFile = CreateFile(
+        filepath,
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+    
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(hFile, &info);
+    CloseHandle(hFile);
+    if (!ok) {
+        return -1;
+    }
+    
+    meta->filesize = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    meta->mtime = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) |
+                  info.ftLastWriteTime.dwLowDateTime;
+    meta->file_index = make_file_index(info.dwVolumeSerialNumber,
+                                       info.nFileIndexHigh, info.nFileIndexLow);
+    return 0;
+}
+
 int should_ignore_file(const char *filename) {
     char lower_name[MAX_PATH];
     strncpy(lower_name, filename, MAX_PATH);
@@ -107,33 +149,62 @@ int hash_file(const char *filepath, char *hex_output) {
     return 0;
 }
 
-void process_file(const char *full_path, const char *action) {
-    int empty_check = is_file_empty(full_path);
-    if (empty_check == 1) {
+int file_full_digest(const char *filepath, char *hex_output) {
+    uint64_t filesize, mtime;
+    if (get_file_stat(filepath, &filesize, &mtime) == 0 &&
+        digest_store_lookup(filepath, filesize, mtime, hex_output)) {
+        return 0;
+    }
+    return hash_file(filepath, hex_output);
+}
+
+int process_file(HashTable *table, const char *full_path, const char *action) {
+    // One open gives size, mtime and identity, and proves the file readable
+    FileMeta meta;
+    if (get_file_meta(full_path, &meta) != 0) {
+        safe_printf("[ERROR] Cannot access: %s\n", full_path);
+        return PROCESS_FAILED;
+    }
+    
+    if (meta.filesize == 0) {
         safe_printf("[%s] %s (0 bytes - skipped)\n", action, full_path);
-        add_empty_file(full_path);
+        digest_store_put(full_path, 0, meta.mtime, "");
+        if (!hash_table_add_empty(table, full_path, &meta) || table != g_hash_table) {
+            return PROCESS_EMPTY;   // Already alerted, or not live yet
+        }
 
         char last_mod[32]  = {0};
         char timestamp[32] = {0};
-        get_file_modified_time(full_path, last_mod, sizeof(last_mod));
+        format_file_time(meta.mtime, last_mod, sizeof(last_mod));
         get_iso8601_timestamp(timestamp, sizeof(timestamp));
         send_alert_empty_file(full_path, 0, last_mod, timestamp);
-        return;
-    } else if (empty_check == -1) {
-        safe_printf("[ERROR] Cannot access: %s\n", full_path);
-        return;
+        return PROCESS_EMPTY;
     }
     
     char hash[HASH_SIZE * 2 + 1];
-    if (hash_file(full_path, hash) == 0) {
+    int hashed = 0;
+    int result = PROCESS_HASHED;
+    
+    // Reuse the persisted digest while size and mtime are unchanged
+    if (digest_store_lookup(full_path, meta.filesize, meta.mtime, hash)) {
+        hashed = 1;
+        result = PROCESS_CACHED;
+    } else if (hash_file(full_path, hash) == 0) {
+        hashed = 1;
+        digest_store_put(full_path, meta.filesize, meta.mtime, hash);
+    }
+    
+    if (hashed) {
         safe_printf("[%s] %s\n", action, full_path);
         
-        if (check_for_duplicate(g_hash_table, hash, full_path)) {
-            print_duplicates_for_file(g_hash_table, hash, full_path);
+        if (check_for_duplicate(table, hash, full_path, &meta)) {
+            print_duplicates_for_file(table, hash, full_path);
         }
         
-        add_file_hash(g_hash_table, hash, full_path);
-    } else {
-        safe_printf("[ERROR] Failed to hash: %s\n", full_path);
+        add_file_hash(table, hash, full_path, &meta);
+        return result;
     }
+
+    safe_printf("[ERROR] Failed to hash: %s\n", full_path);
+    return PROCESS_FAILED;
 }
\ No newline at end of file
@@ -0,0 +1,322 @@
+//flat_index.c
+#include "flat_index.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FLAT_INDEX_SSE2 1
+#endif
+
+// Full slots have the high bit set.  Empty is zero so new control arrays
+// come from calloc: the OS hands out zeroed pages lazily instead of a
+// resize touching every byte up front.
+#define CTRL_EMPTY   ((uint8_t)0x00)
+#define CTRL_DELETED ((uint8_t)0x01)
+#define CTRL_FULL    ((uint8_t)0x80)
+
+// Keep at most 7/8 of the slots in use (live + tombstones)
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+static uint8_t hash_tag(uint64_t hash) {
+    return (uint8_t)(CTRL_FULL | (hash & 0x7F));
+}
+
+static size_t hash_start(uint64_t hash, size_t capacity) {
+    return (size_t)(hash >> 7) & (capacity - 1);
+}
+
+// Bit i set where group byte i equals b
+static uint32_t group_match(const uint8_t *group, uint8_t b) {
+#ifdef FLAT_INDEX_SSE2
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)b)));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < FLAT_GROUP_WIDTH; i++) {
+        if (group[i] == b) bits |= 1u << i;
+    }
+    return bits;
+#endif
+}
+
+// Bit i set where group byte i is empty or deleted (high bit clear)
+static uint32_t group_match_free(const uint8_t *group) {
+#ifdef FLAT_INDEX_SSE2
+    return ~(uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group)) & 0xFFFF;
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < FLAT_GROUP_WIDTH; i++) {
+        if (!(group[i] & CTRL_FULL)) bits |= 1u << i;
+    }
+    return bits;
+#endif
+}
+
+static int lowest_bit(uint32_t bits) {
+    return __builtin_ctz(bits);
+}
+
+static void set_ctrl(FlatTable *table, size_t slot, uint8_t value) {
+    table->ctrl[slot] = value;
+    // Groups read past the end wrap onto a mirror of the first bytes
+    if (slot < FLAT_GROUP_WIDTH) {
+        table->ctrl[table->capacity + slot] = value;
+    }
+}
+
+static FlatTable* allocate(size_t capacity) {
+    // Payloads first so they stay 4-byte aligned; calloc leaves every
+    // control byte CTRL_EMPTY
+    FlatTable *table = calloc(1, sizeof(FlatTable) + capacity * sizeof(uint32_t) +
+                                 capacity + FLAT_GROUP_WIDTH);
+    if (!table) return NULL;
+    table->capacity = capacity;
+    table->values = (uint32_t*)(table + 1);
+    table->ctrl = (uint8_t*)(table->values + capacity);
+    return table;
+}
+
+static size_t capacity_for(size_t expected) {
+    size_t capacity = FLAT_GROUP_WIDTH;
+    while (MAX_LOAD(capacity) < expected) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+BOOL flat_index_init(FlatIndex *index, size_t expected) {
+    memset(index, 0, sizeof(FlatIndex));
+    index->table = allocate(capacity_for(expected));
+    return index->table != NULL;
+}
+
+void flat_index_free(FlatIndex *index) {
+    flat_index_reclaim(index);
+    free(index->table);
+    free(index->old);
+    memset(index, 0, sizeof(FlatIndex));
+}
+
+// Probe one table for a payload whose key matches
+static uint32_t find_in(const FlatTable *table, uint64_t hash,
+                        FlatIndexMatch match, const void *key, void *ctx) {
+    size_t mask = table->capacity - 1;
+    size_t pos = hash_start(hash, table->capacity);
+    uint8_t tag = hash_tag(hash);
+
+    // Triangular probing over groups visits every group once
+    for (size_t step = FLAT_GROUP_WIDTH; ; step += FLAT_GROUP_WIDTH) {
+        const uint8_t *group = table->ctrl + pos;
+        uint32_t candidates = group_match(group, tag);
+        while (candidates) {
+            size_t slot = (pos + lowest_bit(candidates)) & mask;
+            uint32_t value = table->values[slot];
+            if (match(value, key, ctx)) {
+                return value;
+            }
+            candidates &= candidates - 1;
+        }
+        if (group_match(group, CTRL_EMPTY) || step > table->capacity) {
+            return FLAT_INDEX_NONE;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+uint32_t flat_index_find(const FlatIndex *index, uint64_t hash,
+                         FlatIndexMatch match, const void *key, void *ctx) {
+    // The current table is published after the old one, so loading it first
+    // never skips a table that is still live
+    const FlatTable *table = index->table;
+    uint32_t value = find_in(table, hash, match, key, ctx);
+    if (value == FLAT_INDEX_NONE) {
+        const FlatTable *old = index->old;
+        if (old && old != table) {
+            value = find_in(old, hash, match, key, ctx);
+        }
+    }
+    return value;
+}
+
+// Mark the slot holding value deleted; returns FALSE if it is not in this table
+static BOOL erase_in(FlatTable *table, uint64_t hash, uint32_t value) {
+    size_t mask = table->capacity - 1;
+    size_t pos = hash_start(hash, table->capacity);
+    uint8_t tag = hash_tag(hash);
+
+    for (size_t step = FLAT_GROUP_WIDTH; ; step += FLAT_GROUP_WIDTH) {
+        const uint8_t *group = table->ctrl + pos;
+        uint32_t candidates = group_match(group, tag);
+        while (candidates) {
+            size_t slot = (pos + lowest_bit(candidates)) & mask;
+            if (table->values[slot] == value) {
+                set_ctrl(table, slot, CTRL_DELETED);
+                return TRUE;
+            }
+            candidates &= candidates - 1;
+        }
+        if (group_match(group, CTRL_EMPTY) || step > table->capacity) {
+            return FALSE;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+// First empty or deleted slot on the probe sequence
+static size_t find_free_slot(const FlatTable *table, uint64_t hash) {
+    size_t mask = table->capacity - 1;
+    size_t pos = hash_start(hash, table->capacity);
+
+    for (size_t step = FLAT_GROUP_WIDTH; ; step += FLAT_GROUP_WIDTH) {
+        uint32_t free_slots = group_match_free(table->ctrl + pos);
+        if (free_slots) {
+            return (pos + lowest_bit(free_slots)) & mask;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+static void place(FlatIndex *index, uint64_t hash, uint32_t value) {
+    FlatTable *table = index->table;
+    size_t slot = find_free_slot(table, hash);
+    if (table->ctrl[slot] == CTRL_DELETED) {
+        index->tombstones--;
+    }
+    // Payload before tag: a reader that matches the tag sees this value
+    table->values[slot] = value;
+    MemoryBarrier();
+    set_ctrl(table, slot, hash_tag(hash));
+}
+
+// Move up to slots old-table slots into the current table
+static void migrate(FlatIndex *index, size_t slots, FlatIndexHash rehash, void *ctx) {
+    FlatTable *old = index->old;
+    if (!old) return;
+
+    size_t end = old->capacity;
+    if (slots < end - index->migrate_pos) end = index->migrate_pos + slots;
+
+    for (size_t slot = index->migrate_pos; slot < end; slot++) {
+        if (!(old->ctrl[slot] & CTRL_FULL)) continue;
+        uint32_t value = old->values[slot];
+        place(index, rehash(value, ctx), value);
+        // A lookup that misses the new table must not find it here too
+        set_ctrl(old, slot, CTRL_DELETED);
+        index->old_count--;
+    }
+    index->migrate_pos = end;
+
+    if (end == old->capacity) {
+        index->old = NULL;
+        old->next_retired = index->retired;
+        index->retired = old;
+        index->old_count = 0;
+        index->migrate_pos = 0;
+    }
+}
+
+// Swap in an empty table of the given capacity; the current table becomes
+// the old one and drains over the following operations
+static BOOL begin_resize(FlatIndex *index, size_t capacity, FlatIndexHash rehash, void *ctx) {
+    // Finish any earlier resize first; at FLAT_MIGRATE_SLOTS per operation
+    // that one is normally long done before the new table fills
+    migrate(index, SIZE_MAX, rehash, ctx);
+
+    FlatTable *table = allocate(capacity);
+    if (!table) {
+        return FALSE;
+    }
+
+    index->old_count = index->count;
+    index->migrate_pos = 0;
+    index->tombstones = 0;
+    index->old = index->table;
+    MemoryBarrier();
+    index->table = table;
+    return TRUE;
+}
+
+// Start a reserve that arrived while the previous resize was draining
+static void begin_reserved(FlatIndex *index, FlatIndexHash rehash, void *ctx) {
+    if (index->old || index->reserve_capacity == 0) return;
+    size_t capacity = index->reserve_capacity;
+    index->reserve_capacity = 0;
+    // On allocation failure growth is left to the inserts, as without it
+    if (capacity > index->table->capacity) {
+        begin_resize(index, capacity, rehash, ctx);
+    }
+}
+
+BOOL flat_index_insert(FlatIndex *index, uint64_t hash, uint32_t value,
+                       FlatIndexHash rehash, void *ctx) {
+    migrate(index, FLAT_MIGRATE_SLOTS, rehash, ctx);
+    begin_reserved(index, rehash, ctx);
+
+    // Slots in use in the current table, counting tombstones
+    size_t capacity = index->table->capacity;
+    size_t used = index->count - index->old_count + index->tombstones;
+    if (used + 1 > MAX_LOAD(capacity)) {
+        // Mostly tombstones: clean up at the same size, otherwise double
+        if (index->count * 2 >= MAX_LOAD(capacity)) {
+            capacity *= 2;
+        }
+        if (!begin_resize(index, capacity, rehash, ctx)) {
+            return FALSE;
+        }
+    }
+
+    place(index, hash, value);
+    index->count++;
+    return TRUE;
+}
+
+BOOL flat_index_erase(FlatIndex *index, uint64_t hash, uint32_t value,
+                      FlatIndexHash rehash, void *ctx) {
+    BOOL erased = FALSE;
+    if (erase_in(index->table, hash, value)) {
+        index->tombstones++;
+        erased = TRUE;
+    } else if (index->old && erase_in(index->old, hash, value)) {
+        index->old_count--;
+        erased = TRUE;
+    }
+    if (erased) {
+        index->count--;
+    }
+
+    migrate(index, FLAT_MIGRATE_SLOTS, rehash, ctx);
+    begin_reserved(index, rehash, ctx);
+    return erased;
+}
+
+BOOL flat_index_reserve(FlatIndex *index, size_t expected,
+                        FlatIndexHash rehash, void *ctx) {
+    size_t capacity = capacity_for(expected);
+    if (capacity <= index->table->capacity) {
+        return TRUE;
+    }
+    // Draining the current resize at once would stall the caller's writers
+    if (index->old) {
+        if (capacity > index->reserve_capacity) index->reserve_capacity = capacity;
+        return TRUE;
+    }
+    return begin_resize(index, capacity, rehash, ctx);
+}
+
+size_t flat_index_capacity(const FlatIndex *index) {
+    return index->table->capacity;
+}
+
+BOOL flat_index_has_retired(const FlatIndex *index) {
+    return index->retired != NULL;
+}
+
+void flat_index_reclaim(FlatIndex *index) {
+    while (index->retired) {
+        FlatTable *next = index->retired->next_retired;
+        free(index->retired);
+        index->retired = next;
+    }
+}
@@ -1,5 +1,6 @@
 //hash_table.c
 #include "hash_table.h"
+#include "index_spill.h"
 #include "ipc_pipe.h"
 #include "utils.h"
 #include <stdio.h>
@@ -7,354 +8,2102 @@
 #include <string.h>
 
 HashTable *g_hash_table = NULL;
+size_t g_index_memory_budget = 0;
 
-static unsigned int hash_string(const char *str, size_t table_size) {
-    unsigned int hash = 5381;
+// Shared by hash_table_acquire holders, exclusive for a swap
+static SRWLOCK g_live_lock = SRWLOCK_INIT;
+
+// 64-bit FNV-1a over the file name seeded with its directory node,
+// finalized so the low bits are well mixed
+static uint64_t hash_entry_key(uint32_t dir, const char *str) {
+    uint64_t hash = (0xcbf29ce484222325ULL ^ dir) * 0x100000001b3ULL;
     int c;
-    while ((c = *str++))
-        hash = ((hash << 5) + hash) + c;
-    return hash % table_size;
+    while ((c = (unsigned char)*str++)) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ULL;
+    hash ^= hash >> 32;
+    return hash;
 }
 
-HashTable* create_hash_table(size_t size) {
-    HashTable *table = malloc(sizeof(HashTable));
-    table->size = size;
-    table->buckets = calloc(size, sizeof(FileHash*));
-    InitializeCriticalSection(&table->lock);
-    return table;
+// Fold every digest word so keys differing only late still spread
+static uint64_t hash_digest(const uint8_t *digest) {
+    static const uint64_t multipliers[4] = {
+        1, 0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL
+    };
+    uint64_t words[INDEX_DIGEST_BYTES / 8];
+    memcpy(words, digest, sizeof(words));
+    uint64_t hash = 0;
+    for (int i = 0; i < INDEX_DIGEST_BYTES / 8; i++) {
+        hash ^= words[i] * multipliers[i];
+    }
+    hash ^= hash >> 29;
+    return hash;
 }
 
-void add_file_hash(HashTable *table, const char *hash, const char *filepath) {
-    EnterCriticalSection(&table->lock);
-    
-    unsigned int index = hash_string(hash, table->size);
-    FileHash *new_node = malloc(sizeof(FileHash));
-    strcpy(new_node->hash, hash);
-    new_node->filepath = _strdup(filepath);
-    new_node->next = table->buckets[index];
-    table->buckets[index] = new_node;
-    
-    LeaveCriticalSection(&table->lock);
+// Nibble value of each hex character, 0xFF for anything else
+static uint8_t g_hex_values[256];
+
+static void init_hex_values(void) {
+    if (g_hex_values['0'] == 0 && g_hex_values['1'] == 1) return;
+    memset(g_hex_values, 0xFF, sizeof(g_hex_values));
+    for (int i = 0; i < 10; i++) g_hex_values['0' + i] = (uint8_t)i;
+    for (int i = 0; i < 6; i++) {
+        g_hex_values['a' + i] = (uint8_t)(10 + i);
+        g_hex_values['A' + i] = (uint8_t)(10 + i);
+    }
 }
 
-void remove_file_from_table(HashTable *table, const char *filepath) {
-    EnterCriticalSection(&table->lock);
-    
-    for (size_t i = 0; i < table->size; i++) {
-        FileHash *current = table->buckets[i];
-        FileHash *prev = NULL;
-        
-        while (current) {
-            if (strcmp(current->filepath, filepath) == 0) {
-                if (prev) {
-                    prev->next = current->next;
-                } else {
-                    table->buckets[i] = current->next;
-                }
-                free(current->filepath);
-                free(current);
-                LeaveCriticalSection(&table->lock);
+// Convert a hex digest to the INDEX_DIGEST_BYTES the index keeps.  Takes
+// the full 64 characters or just the kept prefix (as format_digest writes
+// it).  Returns FALSE if malformed.
+static BOOL parse_digest(const char *hex, uint8_t *digest) {
+    const unsigned char *in = (const unsigned char*)hex;
+    for (int i = 0; i < INDEX_DIGEST_BYTES; i++) {
+        uint8_t hi = g_hex_values[in[i * 2]];
+        if (hi & 0xF0) return FALSE;
+        uint8_t lo = g_hex_values[in[i * 2 + 1]];
+        if (lo & 0xF0) return FALSE;
+        digest[i] = (uint8_t)((hi << 4) | lo);
+    }
+    size_t len = INDEX_DIGEST_BYTES * 2;
+    while (len < HASH_SIZE * 2 && !(g_hex_values[in[len]] & 0xF0)) len++;
+    return hex[len] == '\0' && (len == INDEX_DIGEST_BYTES * 2 || len == HASH_SIZE * 2);
+}
+
+static void format_digest(const uint8_t *digest, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < INDEX_DIGEST_BYTES; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0F];
+    }
+    hex[INDEX_DIGEST_BYTES * 2] = '\0';
+}
+
+
+static IndexShard* shard_for(HashTable *table, const uint8_t *digest) {
+    return &table->shards[digest[0] >> (8 - INDEX_SHARD_BITS)];
+}
+
+// Writer-side accessors (shard lock held, slot known to be allocated)
+static DigestGroup* group_at(IndexShard *shard, uint32_t slot) {
+    DigestGroup *chunk = shard->group_chunks->chunks[slot >> SLOT_CHUNK_BITS];
+    return &chunk[slot & (SLOT_CHUNK_SIZE - 1)];
+}
+
+static FileEntry* entry_at(IndexShard *shard, uint32_t slot) {
+    FileEntry *chunk = shard->entry_chunks->chunks[slot >> SLOT_CHUNK_BITS];
+    return &chunk[slot & (SLOT_CHUNK_SIZE - 1)];
+}
+
+// Column blocks; the slot's position in them is slot & (SLOT_CHUNK_SIZE - 1)
+static GroupColumns* group_columns(IndexShard *shard, uint32_t slot) {
+    return shard->group_columns->chunks[slot >> SLOT_CHUNK_BITS];
+}
+
+static EntryColumns* entry_columns(IndexShard *shard, uint32_t slot) {
+    return shard->entry_columns->chunks[slot >> SLOT_CHUNK_BITS];
+}
+
+#define COLUMN_INDEX(slot) ((slot) & (SLOT_CHUNK_SIZE - 1))
+
+static FileMeta entry_meta(IndexShard *shard, uint32_t slot) {
+    const EntryColumns *columns = entry_columns(shard, slot);
+    FileMeta meta = { columns->sizes[COLUMN_INDEX(slot)], columns->mtimes[COLUMN_INDEX(slot)],
+                      entry_at(shard, slot)->file_index };
+    return meta;
+}
+
+// Extension of a file name as an integer column key: up to its first 8
+// bytes lowercased, packed little-endian (0 if the name has none)
+static uint64_t extension_key(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name) return 0;
+    uint64_t key = 0;
+    for (int i = 0; i < 8 && dot[1 + i]; i++) {
+        uint64_t c = (unsigned char)dot[1 + i];
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        key |= c << (8 * i);
+    }
+    return key;
+}
+
+// Reader-side accessors: a lock-free reader may hold a slot number from a
+// slot that is being rewritten, so bounds-check against what it can see
+static const void* slot_peek(ChunkTable *chunks, uint32_t slot, size_t item_size) {
+    if (!chunks || (slot >> SLOT_CHUNK_BITS) >= chunks->count) return NULL;
+    const char *chunk = chunks->chunks[slot >> SLOT_CHUNK_BITS];
+    return chunk + (size_t)(slot & (SLOT_CHUNK_SIZE - 1)) * item_size;
+}
+
+static const DigestGroup* group_peek(IndexShard *shard, uint32_t slot) {
+    return slot_peek(shard->group_chunks, slot, sizeof(DigestGroup));
+}
+
+static const FileEntry* entry_peek(IndexShard *shard, uint32_t slot) {
+    return slot_peek(shard->entry_chunks, slot, sizeof(FileEntry));
+}
+
+// FlatIndex callbacks: keys live in the side arrays.  The match callbacks
+// also run under lock-free reads.
+static BOOL group_matches(uint32_t value, const void *key, void *ctx) {
+    const DigestGroup *group = group_peek((IndexShard*)ctx, value);
+    return group && memcmp(group->digest, key, INDEX_DIGEST_BYTES) == 0;
+}
+
+static uint64_t group_rehash(uint32_t value, void *ctx) {
+    return hash_digest(group_at((IndexShard*)ctx, value)->digest);
+}
+
+// A file path split into its interned directory and its name
+typedef struct PathKey {
+    uint32_t dir;                // PATH_TREE_NONE if the path has no directory part
+    const char *name;            // NULL if the directory was never indexed
+    uint64_t hash;
+} PathKey;
+
+// Split filepath and look its directory up in the path tree (adding it
+// when intern is set).  FALSE if the directory is unknown, in which case
+// no entry can match the key.
+static BOOL resolve_path(HashTable *table, const char *filepath, BOOL intern, PathKey *key) {
+    const char *sep = strrchr(filepath, '\\');
+    key->dir = PATH_TREE_NONE;
+    key->name = filepath;
+    if (sep) {
+        size_t len = (size_t)(sep - filepath);
+        key->dir = intern ? path_tree_intern(&table->tree, filepath, len)
+                          : path_tree_find(&table->tree, filepath, len);
+        key->name = sep + 1;
+        if (key->dir == PATH_TREE_NONE) {
+            key->name = NULL;
+            return FALSE;
+        }
+    }
+    key->hash = hash_entry_key(key->dir, key->name);
+    return TRUE;
+}
+
+static BOOL entry_is(const FileEntry *entry, const PathKey *key) {
+    const char *name = entry ? entry->name : NULL;
+    return name && key->name && entry->dir == key->dir && strcmp(name, key->name) == 0;
+}
+
+// Rebuild the full path of name in dir; FALSE if it does not fit in size bytes
+static BOOL format_path(HashTable *table, uint32_t dir, const char *name, char *buffer, size_t size) {
+    size_t len = 0;
+    if (dir != PATH_TREE_NONE) {
+        len = path_tree_format(&table->tree, dir, buffer, size);
+        if (len == 0 || len + 1 >= size) return FALSE;
+        buffer[len++] = '\\';
+    }
+    size_t name_len = strlen(name);
+    if (len + name_len + 1 > size) return FALSE;
+    memcpy(buffer + len, name, name_len + 1);
+    return TRUE;
+}
+
+static BOOL format_entry_path(HashTable *table, const FileEntry *entry, char *buffer, size_t size) {
+    return format_path(table, entry->dir, entry->name, buffer, size);
+}
+
+// Dropped from the index (a removed root) after it was spilled?
+static BOOL spill_dropped(HashTable *table, const SpillEntry *entry) {
+    const SpillStore *spill = table->spill;
+    for (size_t i = 0; i < spill->drop_count; i++) {
+        if (entry->run < spill->drops[i].before_run && entry->dir != PATH_TREE_NONE &&
+            path_tree_is_under(&table->tree, entry->dir, spill->drops[i].dir)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Still the file that was spilled?  Anything else (gone, changed, dropped)
+// is left for the next merge.  Fills path.
+static BOOL spill_valid(HashTable *table, const SpillEntry *entry, char *path) {
+    uint64_t size, mtime;
+    if (spill_dropped(table, entry) || !format_path(table, entry->dir, entry->name, path, MAX_PATH) ||
+        get_file_stat(path, &size, &mtime) != 0 || size != entry->filesize ||
+        (entry->mtime && mtime != entry->mtime)) {
+        spill_store_mark_dead(table->spill, entry);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static BOOL entry_matches(uint32_t value, const void *key, void *ctx) {
+    return entry_is(entry_peek((IndexShard*)ctx, value), (const PathKey*)key);
+}
+
+static uint64_t entry_rehash(uint32_t value, void *ctx) {
+    return entry_at((IndexShard*)ctx, value)->path_hash;
+}
+
+static void shard_lock(IndexShard *shard) {
+    if (!TryEnterCriticalSection(&shard->lock)) {
+        InterlockedIncrement64(&shard->lock_contended);
+        EnterCriticalSection(&shard->lock);
+    }
+    shard->lock_acquisitions++;
+}
+
+static void shard_unlock(IndexShard *shard) {
+    LeaveCriticalSection(&shard->lock);
+}
+
+// Hand a block to the shard's retire list; it is freed once no lock-free
+// reader is inside (shard lock held)
+static void retire(IndexShard *shard, void *ptr) {
+    RetiredBlock *block = malloc(sizeof(RetiredBlock));
+    if (!block) {
+        // No node to defer with: wait out the readers instead
+        while (shard->readers > 0) Sleep(0);
+        free(ptr);
+        return;
+    }
+    block->ptr = ptr;
+    block->next = shard->retired;
+    shard->retired = block;
+}
+
+static void free_retired(IndexShard *shard) {
+    while (shard->retired) {
+        RetiredBlock *next = shard->retired->next;
+        free(shard->retired->ptr);
+        free(shard->retired);
+        shard->retired = next;
+    }
+    flat_index_reclaim(&shard->digest_index);
+    flat_index_reclaim(&shard->path_index);
+}
+
+static void write_begin(IndexShard *shard) {
+    shard_lock(shard);
+    InterlockedIncrement(&shard->seq);      // Odd: readers retry
+}
+
+static void write_end(IndexShard *shard) {
+    InterlockedIncrement(&shard->seq);
+    if (shard->retired || flat_index_has_retired(&shard->digest_index) ||
+        flat_index_has_retired(&shard->path_index)) {
+        // Retired blocks were unlinked before this check, so a reader that
+        // arrives later cannot reach them
+        MemoryBarrier();
+        if (shard->readers == 0) {
+            free_retired(shard);
+        }
+    }
+    shard_unlock(shard);
+}
+
+typedef void (*ShardReader)(IndexShard *shard, void *ctx);
+
+// Run read without the shard lock, retrying while a writer is active, and
+// under the lock if it keeps racing writers
+static void shard_read(IndexShard *shard, ShardReader read, void *ctx) {
+    // The increment is a full barrier, so the reads below cannot move above it
+    InterlockedIncrement(&shard->readers);
+    for (int attempt = 0; attempt < INDEX_READ_ATTEMPTS; attempt++) {
+        LONG seq = shard->seq;
+        if (!(seq & 1)) {
+            if (attempt > 0) MemoryBarrier();
+            read(shard, ctx);
+            MemoryBarrier();
+            if (shard->seq == seq) {
+                InterlockedDecrement(&shard->readers);
                 return;
             }
-            prev = current;
-            current = current->next;
         }
+        InterlockedIncrement64(&shard->read_retries);
     }
-    
-    LeaveCriticalSection(&table->lock);
+    InterlockedDecrement(&shard->readers);
+
+    InterlockedIncrement64(&shard->read_fallbacks);
+    shard_lock(shard);
+    read(shard, ctx);
+    shard_unlock(shard);
 }
 
-// Helper function to collect all files with same hash
-static int collect_duplicates_for_hash(HashTable *table, const char *hash, 
-                                       const char *exclude_filepath, 
-                                       FileInfo *duplicates, int max_count) {
-    int count = 0;
-    
-    for (size_t i = 0; i < table->size && count < max_count; i++) {
-        FileHash *current = table->buckets[i];
-        while (current && count < max_count) {
-            if (strcmp(current->hash, hash) == 0 && 
-                strcmp(current->filepath, exclude_filepath) != 0) {
-                
-                FileInfo *dup = &duplicates[count];
-                strncpy(dup->filepath, current->filepath, MAX_PATH - 1);
-                dup->filepath[MAX_PATH - 1] = '\0';
-                
-                // Extract filename
-                const char *filename = strrchr(current->filepath, '\\');
-                filename = filename ? filename + 1 : current->filepath;
-                strncpy(dup->filename, filename, MAX_PATH - 1);
-                dup->filename[MAX_PATH - 1] = '\0';
-                
-                strncpy(dup->filehash, hash, 64);
-                dup->filehash[64] = '\0';
-                
-                // Get file size
-                WIN32_FILE_ATTRIBUTE_DATA file_data;
-                if (GetFileAttributesEx(current->filepath, GetFileExInfoStandard, &file_data)) {
-                    dup->filesize = ((uint64_t)file_data.nFileSizeHigh << 32) | file_data.nFileSizeLow;
+static DWORD WINAPI compact_thread_func(LPVOID param);
+
+HashTable* create_hash_table(size_t expected_files) {
+    HashTable *table = calloc(1, sizeof(HashTable));
+    init_hex_values();
+    // Digests are uniform, so each shard gets an equal share.  Duplicates
+    // are rare, so expect about one group per file.
+    size_t per_shard = expected_files / INDEX_SHARD_COUNT + 1;
+    for (int i = 0; i < INDEX_PATH_SHARDS; i++) {
+        IndexShard *shard = &table->shards[i];
+        size_t expected = i == EMPTY_SHARD ? 0 : per_shard;
+        InitializeCriticalSection(&shard->lock);
+        flat_index_init(&shard->digest_index, expected);
+        flat_index_init(&shard->path_index, expected);
+        if (i != EMPTY_SHARD) {
+            content_filter_init(&shard->digest_filter, expected);
+        }
+        shard->group_free = FLAT_INDEX_NONE;
+        shard->entry_free = FLAT_INDEX_NONE;
+        path_arena_init(&shard->names);
+    }
+    path_tree_init(&table->tree);
+    if (g_index_memory_budget > 0) {
+        table->memory_budget = g_index_memory_budget;
+        table->spill = spill_store_create();
+    }
+
+    table->compact_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    table->compact_thread = CreateThread(NULL, 0, compact_thread_func, table, 0, NULL);
+    if (table->compact_thread) {
+        SetThreadPriority(table->compact_thread, THREAD_PRIORITY_BELOW_NORMAL);
+    }
+    return table;
+}
+
+// Add the digest of each live group in slots [filter_built, end) to the
+// filter being built (shard lock held)
+static void build_filter_to(IndexShard *shard, uint32_t end) {
+    for (uint32_t slot = shard->filter_built; slot < end; slot++) {
+        DigestGroup *group = group_at(shard, slot);
+        if (group->count > 0) {
+            content_filter_table_add(shard->filter_build, hash_digest(group->digest));
+        }
+    }
+    shard->filter_built = end;
+}
+
+// Refill the digest filter at a size for expected groups (compaction
+// thread).  Lock-free readers keep using the old table while the new one
+// is filled, a batch of group slots per hold of the plain shard lock;
+// writers mirror their changes for the slots already walked.  Only the
+// last few slots and the swap run in a write section.  A failed
+// allocation keeps the old table.
+static void rebuild_filter(IndexShard *shard, size_t expected) {
+    FilterTable *fresh = content_filter_table_alloc(expected);
+    if (!fresh) return;
+
+    shard_lock(shard);
+    shard->filter_build = fresh;
+    shard->filter_built = 0;
+    while (shard->group_used - shard->filter_built > FILTER_REBUILD_BATCH) {
+        build_filter_to(shard, shard->filter_built + FILTER_REBUILD_BATCH);
+        shard_unlock(shard);
+        shard_lock(shard);
+    }
+    shard_unlock(shard);
+
+    write_begin(shard);
+    build_filter_to(shard, shard->group_used);
+    shard->filter_build = NULL;
+    FilterTable *old = content_filter_swap(&shard->digest_filter, fresh);
+    if (old) retire(shard, old);
+    write_end(shard);
+}
+
+// A group's digest entering (or leaving) the filter, and the one being
+// built if it has already walked past the group (shard write in progress)
+static void filter_add(IndexShard *shard, uint32_t group, uint64_t key) {
+    content_filter_add(&shard->digest_filter, key);
+    if (shard->filter_build && group < shard->filter_built) {
+        content_filter_table_add(shard->filter_build, key);
+    }
+}
+
+static void filter_remove(IndexShard *shard, uint32_t group, uint64_t key) {
+    content_filter_remove(&shard->digest_filter, key);
+    if (shard->filter_build && group < shard->filter_built) {
+        content_filter_table_remove(shard->filter_build, key);
+    }
+}
+
+void hash_table_reserve(HashTable *table, size_t expected_files) {
+    size_t per_shard = expected_files / INDEX_SHARD_COUNT + 1;
+    size_t before = 0, after = 0;
+    for (int i = 0; i < INDEX_SHARD_COUNT; i++) {
+        IndexShard *shard = &table->shards[i];
+        write_begin(shard);
+        before += flat_index_capacity(&shard->path_index);
+        flat_index_reserve(&shard->digest_index, per_shard, group_rehash, shard);
+        flat_index_reserve(&shard->path_index, per_shard, entry_rehash, shard);
+        after += flat_index_capacity(&shard->path_index);
+        write_end(shard);
+    }
+
+    // Refilling a filter walks every group of its shard: left to the
+    // compaction thread rather than done here on the caller's thread
+    if (per_shard > table->filter_reserve) {
+        table->filter_reserve = per_shard;
+        SetEvent(table->compact_event);
+    }
+
+    if (after != before) {
+        safe_printf("[INDEX] Growing index for ~%llu files (%llu -> %llu slots)\n",
+                    (unsigned long long)expected_files, (unsigned long long)before,
+                    (unsigned long long)after);
+    }
+}
+
+// Make slot used (the next high-water slot) addressable, adding a chunk
+// when it starts a new one (shard lock held)
+static BOOL reserve_slot(IndexShard *shard, ChunkTable *volatile *table_ptr,
+                         uint32_t used, size_t item_size) {
+    ChunkTable *chunks = *table_ptr;
+    uint32_t chunk = used >> SLOT_CHUNK_BITS;
+    if (chunks && chunk < chunks->count) return TRUE;
+    if (used == FLAT_INDEX_NONE) return FALSE;
+
+    if (!chunks || chunks->count == chunks->capacity) {
+        uint32_t capacity = chunks ? chunks->capacity * 2 : 16;
+        ChunkTable *grown = malloc(sizeof(ChunkTable) + sizeof(void*) * capacity);
+        if (!grown) return FALSE;
+        grown->count = chunks ? chunks->count : 0;
+        grown->capacity = capacity;
+        if (chunks) {
+            memcpy(grown->chunks, chunks->chunks, sizeof(void*) * chunks->count);
+        }
+        MemoryBarrier();
+        *table_ptr = grown;
+        if (chunks) retire(shard, chunks);
+        chunks = grown;
+    }
+
+    // Zeroed, so a reader that sees the slot early finds no path
+    void *fresh = calloc(SLOT_CHUNK_SIZE, item_size);
+    if (!fresh) return FALSE;
+    chunks->chunks[chunks->count] = fresh;
+    MemoryBarrier();
+    chunks->count++;
+    return TRUE;
+}
+
+// Column blocks are reserved like chunks of items sizeof(block) / SLOT_CHUNK_SIZE wide
+static uint32_t alloc_group(IndexShard *shard) {
+    uint32_t slot = shard->group_free;
+    if (slot != FLAT_INDEX_NONE) {
+        shard->group_free = group_at(shard, slot)->members;
+        return slot;
+    }
+    if (!reserve_slot(shard, &shard->group_chunks, shard->group_used, sizeof(DigestGroup)) ||
+        !reserve_slot(shard, &shard->group_columns, shard->group_used,
+                      sizeof(GroupColumns) / SLOT_CHUNK_SIZE)) {
+        return FLAT_INDEX_NONE;
+    }
+    return shard->group_used++;
+}
+
+// Take a memberless group out of the digest index and filter and put its
+// slot on the free list; it keeps its digest bytes until the slot is
+// reused (shard write in progress)
+static void free_group(IndexShard *shard, uint32_t slot) {
+    DigestGroup *group = group_at(shard, slot);
+    flat_index_erase(&shard->digest_index, hash_digest(group->digest), slot,
+                     group_rehash, shard);
+    filter_remove(shard, slot, hash_digest(group->digest));
+    group->members = shard->group_free;
+    shard->group_free = slot;
+}
+
+static uint32_t alloc_entry(IndexShard *shard) {
+    uint32_t slot = shard->entry_free;
+    if (slot != FLAT_INDEX_NONE) {
+        shard->entry_free = entry_at(shard, slot)->group_next;
+        return slot;
+    }
+    if (!reserve_slot(shard, &shard->entry_chunks, shard->entry_used, sizeof(FileEntry)) ||
+        !reserve_slot(shard, &shard->entry_columns, shard->entry_used,
+                      sizeof(EntryColumns) / SLOT_CHUNK_SIZE)) {
+        return FLAT_INDEX_NONE;
+    }
+    return shard->entry_used++;
+}
+
+// Bytes a group's extra copies take, from its columns
+static uint64_t group_wasted(IndexShard *shard, uint32_t group) {
+    const GroupColumns *columns = group_columns(shard, group);
+    uint32_t count = columns->counts[COLUMN_INDEX(group)];
+    return count > 1 ? (uint64_t)(count - 1) * columns->sizes[COLUMN_INDEX(group)] : 0;
+}
+
+static void heap_place(IndexShard *shard, uint32_t pos, uint32_t group) {
+    shard->dup_heap->slots[pos] = group;
+    group_at(shard, group)->heap_pos = pos;
+}
+
+// Move the group at pos up or down to where its wasted bytes belong
+static void heap_sift(IndexShard *shard, uint32_t pos) {
+    const GroupHeap *heap = shard->dup_heap;
+    uint32_t group = heap->slots[pos];
+    uint64_t wasted = group_wasted(shard, group);
+
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (group_wasted(shard, heap->slots[parent]) >= wasted) break;
+        heap_place(shard, pos, heap->slots[parent]);
+        pos = parent;
+    }
+    for (;;) {
+        uint32_t child = pos * 2 + 1;
+        if (child >= shard->dup_groups) break;
+        if (child + 1 < shard->dup_groups &&
+            group_wasted(shard, heap->slots[child + 1]) > group_wasted(shard, heap->slots[child])) {
+            child++;
+        }
+        if (group_wasted(shard, heap->slots[child]) <= wasted) break;
+        heap_place(shard, pos, heap->slots[child]);
+        pos = child;
+    }
+    heap_place(shard, pos, group);
+}
+
+// A group joins the duplicate heap when its second member arrives (its
+// count column already set) and leaves it when it drops back to one
+static void link_duplicate(IndexShard *shard, uint32_t group) {
+    GroupHeap *heap = shard->dup_heap;
+    group_at(shard, group)->heap_pos = FLAT_INDEX_NONE;
+    if (!heap || shard->dup_groups == heap->capacity) {
+        uint32_t capacity = heap ? heap->capacity * 2 : 64;
+        GroupHeap *grown = malloc(sizeof(GroupHeap) + sizeof(uint32_t) * capacity);
+        // Left out of the heap: still a group, just never ranked
+        if (!grown) return;
+        grown->capacity = capacity;
+        if (heap) {
+            memcpy(grown->slots, heap->slots, sizeof(uint32_t) * shard->dup_groups);
+        }
+        MemoryBarrier();
+        shard->dup_heap = grown;
+        if (heap) retire(shard, heap);
+    }
+    uint32_t pos = shard->dup_groups++;
+    heap_place(shard, pos, group);
+    heap_sift(shard, pos);
+}
+
+static void unlink_duplicate(IndexShard *shard, uint32_t group) {
+    DigestGroup *g = group_at(shard, group);
+    uint32_t pos = g->heap_pos;
+    if (pos == FLAT_INDEX_NONE) return;
+    g->heap_pos = FLAT_INDEX_NONE;
+
+    uint32_t last = shard->dup_heap->slots[--shard->dup_groups];
+    if (pos < shard->dup_groups) {
+        heap_place(shard, pos, last);
+        heap_sift(shard, pos);
+    }
+}
+
+// The group's count changed while it stayed a duplicate
+static void update_duplicate(IndexShard *shard, uint32_t group) {
+    uint32_t pos = group_at(shard, group)->heap_pos;
+    if (pos != FLAT_INDEX_NONE) heap_sift(shard, pos);
+}
+
+// Count an entry into (sign 1) or out of (-1) the duplicate totals of its
+// directory and every one above it
+static void tally_duplicate(HashTable *table, IndexShard *shard, uint32_t slot, LONG sign) {
+    const EntryColumns *columns = entry_columns(shard, slot);
+    uint32_t i = COLUMN_INDEX(slot);
+    path_tree_add_duplicates(&table->tree, columns->dirs[i], sign,
+                             sign * (LONGLONG)columns->sizes[i]);
+}
+
+static uint32_t find_group(IndexShard *shard, const uint8_t *digest) {
+    return flat_index_find(&shard->digest_index, hash_digest(digest),
+                           group_matches, digest, shard);
+}
+
+static uint32_t find_entry(IndexShard *shard, const PathKey *key) {
+    return flat_index_find(&shard->path_index, key->hash, entry_matches, key, shard);
+}
+
+// Index one file whose directory is already resolved (shard is the
+// digest's)
+static void insert_file(HashTable *table, IndexShard *shard, const uint8_t *digest,
+                        const PathKey *key, const FileMeta *meta) {
+    write_begin(shard);
+    BOOL grow_filter = FALSE;
+
+    // Already indexed with this content (a scan reaching a file the monitor
+    // got to first, or one copied from another index): keep the one entry.
+    // Most content is new, and the filter says so without the probe.
+    uint32_t group = FLAT_INDEX_NONE;
+    if (content_filter_may_contain(&shard->digest_filter, hash_digest(digest))) {
+        group = find_group(shard, digest);
+        if (group == FLAT_INDEX_NONE) InterlockedIncrement64(&shard->filter_false_positives);
+    } else {
+        InterlockedIncrement64(&shard->filter_rejects);
+    }
+    uint32_t existing = group != FLAT_INDEX_NONE ? find_entry(shard, key) : FLAT_INDEX_NONE;
+    if (existing != FLAT_INDEX_NONE && entry_at(shard, existing)->group == group) {
+        write_end(shard);
+        return;
+    }
+    BOOL new_group = group == FLAT_INDEX_NONE;
+    if (new_group) {
+        group = alloc_group(shard);
+        if (group == FLAT_INDEX_NONE) {
+            write_end(shard);
+            return;
+        }
+        DigestGroup *g = group_at(shard, group);
+        memcpy(g->digest, digest, INDEX_DIGEST_BYTES);
+        g->members = FLAT_INDEX_NONE;
+        g->count = 0;
+        group_columns(shard, group)->sizes[COLUMN_INDEX(group)] = meta ? meta->filesize : 0;
+        flat_index_insert(&shard->digest_index, hash_digest(digest), group,
+                          group_rehash, shard);
+        filter_add(shard, group, hash_digest(digest));
+        grow_filter = content_filter_wants_growth(&shard->digest_filter);
+    }
+
+    uint32_t slot = alloc_entry(shard);
+    char *name_copy = slot != FLAT_INDEX_NONE ? path_arena_store(&shard->names, key->name) : NULL;
+    if (!name_copy) {
+        if (slot != FLAT_INDEX_NONE) {
+            entry_columns(shard, slot)->groups[COLUMN_INDEX(slot)] = FLAT_INDEX_NONE;
+            entry_at(shard, slot)->group_next = shard->entry_free;
+            shard->entry_free = slot;
+        }
+        // A group created for this file must not be left without members
+        if (new_group) free_group(shard, group);
+        write_end(shard);
+        return;
+    }
+    DigestGroup *g = group_at(shard, group);
+    FileEntry *entry = entry_at(shard, slot);
+    entry->name = name_copy;
+    entry->dir = key->dir;
+    entry->path_hash = key->hash;
+    entry->group = group;
+    entry->file_index = meta ? meta->file_index : 0;
+    entry->group_prev = FLAT_INDEX_NONE;
+    entry->group_next = g->members;
+    if (g->members != FLAT_INDEX_NONE) {
+        entry_at(shard, g->members)->group_prev = slot;
+    }
+    g->members = slot;
+    g->count++;
+
+    EntryColumns *columns = entry_columns(shard, slot);
+    uint32_t i = COLUMN_INDEX(slot);
+    columns->sizes[i] = meta ? meta->filesize : 0;
+    columns->mtimes[i] = meta ? meta->mtime : 0;
+    columns->exts[i] = extension_key(key->name);
+    columns->groups[i] = group;
+    columns->dirs[i] = key->dir;
+    group_columns(shard, group)->counts[COLUMN_INDEX(group)] = g->count;
+    if (g->count == 2) {
+        link_duplicate(shard, group);
+    } else if (g->count > 2) {
+        update_duplicate(shard, group);
+    }
+
+    flat_index_insert(&shard->path_index, key->hash, slot, entry_rehash, shard);
+    path_tree_add_entries(&table->tree, key->dir, 1);
+    path_tree_add_file(&table->tree, key->dir, key->name, digest, INDEX_DIGEST_BYTES,
+                       columns->sizes[i], 1);
+    if (g->count == 2) {
+        // The first member only became a duplicate now
+        tally_duplicate(table, shard, entry->group_next, 1);
+    }
+    if (g->count >= 2) {
+        tally_duplicate(table, shard, slot, 1);
+    }
+
+    write_end(shard);
+    // Outgrown filters are rebuilt on the compaction thread; until then
+    // they only answer "maybe" more often
+    if (grow_filter) SetEvent(table->compact_event);
+}
+
+BOOL hash_table_add_empty(HashTable *table, const char *filepath, const FileMeta *meta) {
+    IndexShard *shard = &table->shards[EMPTY_SHARD];
+    PathKey key;
+    if (!resolve_path(table, filepath, TRUE, &key)) return FALSE;
+    // Nothing is ever matched against an empty file, so an archive's are
+    // of no use
+    if (path_tree_is_reference(&table->tree, key.dir)) return FALSE;
+
+    write_begin(shard);
+    // A set: the same path seen again (rescan, MODIFIED) is not added twice
+    if (find_entry(shard, &key) != FLAT_INDEX_NONE) {
+        write_end(shard);
+        return FALSE;
+    }
+
+    uint32_t slot = alloc_entry(shard);
+    char *name_copy = slot != FLAT_INDEX_NONE ? path_arena_store(&shard->names, key.name) : NULL;
+    if (!name_copy) {
+        if (slot != FLAT_INDEX_NONE) {
+            entry_columns(shard, slot)->groups[COLUMN_INDEX(slot)] = FLAT_INDEX_NONE;
+            entry_at(shard, slot)->group_next = shard->entry_free;
+            shard->entry_free = slot;
+        }
+        write_end(shard);
+        return FALSE;
+    }
+    FileEntry *entry = entry_at(shard, slot);
+    entry->name = name_copy;
+    entry->dir = key.dir;
+    entry->path_hash = key.hash;
+    entry->group = FLAT_INDEX_NONE;
+    entry->file_index = meta ? meta->file_index : 0;
+    entry->group_prev = FLAT_INDEX_NONE;
+    entry->group_next = FLAT_INDEX_NONE;
+
+    EntryColumns *columns = entry_columns(shard, slot);
+    uint32_t i = COLUMN_INDEX(slot);
+    columns->sizes[i] = 0;
+    columns->mtimes[i] = meta ? meta->mtime : 0;
+    columns->exts[i] = extension_key(key.name);
+    columns->groups[i] = FLAT_INDEX_NONE;
+    columns->dirs[i] = key.dir;
+
+    flat_index_insert(&shard->path_index, key.hash, slot, entry_rehash, shard);
+    path_tree_add_entries(&table->tree, key.dir, 1);
+
+    write_end(shard);
+    return TRUE;
+}
+
+// Unlink an entry from its digest group, freeing the group when it was
+// the last member (shard write in progress)
+static void leave_group(HashTable *table, IndexShard *shard, uint32_t slot) {
+    FileEntry *entry = entry_at(shard, slot);
+    DigestGroup *group = group_at(shard, entry->group);
+
+    if (entry->group_prev != FLAT_INDEX_NONE) {
+        entry_at(shard, entry->group_prev)->group_next = entry->group_next;
+    } else {
+        group->members = entry->group_next;
+    }
+    if (entry->group_next != FLAT_INDEX_NONE) {
+        entry_at(shard, entry->group_next)->group_prev = entry->group_prev;
+    }
+
+    if (group->count >= 2) {
+        tally_duplicate(table, shard, slot, -1);
+    }
+    if (group->count == 2) {
+        // The member left behind is no longer a duplicate
+        tally_duplicate(table, shard, group->members, -1);
+    }
+
+    --group->count;
+    group_columns(shard, entry->group)->counts[COLUMN_INDEX(entry->group)] = group->count;
+
+    if (group->count == 1) {
+        unlink_duplicate(shard, entry->group);
+    } else if (group->count > 1) {
+        update_duplicate(shard, entry->group);
+    } else {
+        free_group(shard, entry->group);
+    }
+
+    path_tree_add_file(&table->tree, entry->dir, entry->name, group->digest, INDEX_DIGEST_BYTES,
+                       entry_columns(shard, slot)->sizes[COLUMN_INDEX(slot)], -1);
+}
+
+// Take an entry out of both indexes and free its slot; its path bytes
+// stay in the arena until the next compaction (shard write in progress)
+static void release_entry(HashTable *table, IndexShard *shard, uint32_t slot) {
+    FileEntry *entry = entry_at(shard, slot);
+    // Zero-byte files (the empty shard) belong to no group
+    if (entry->group != FLAT_INDEX_NONE) {
+        leave_group(table, shard, slot);
+    }
+    entry_columns(shard, slot)->groups[COLUMN_INDEX(slot)] = FLAT_INDEX_NONE;
+
+    flat_index_erase(&shard->path_index, entry->path_hash, slot, entry_rehash, shard);
+
+    path_tree_add_entries(&table->tree, entry->dir, -1);
+    path_arena_release(&shard->names, entry->name);
+    entry->name = NULL;
+    entry->group_next = shard->entry_free;
+    shard->entry_free = slot;
+}
+
+typedef struct PathLookup {
+    PathKey key;
+    uint32_t slot;
+} PathLookup;
+
+static void read_path(IndexShard *shard, void *ctx) {
+    PathLookup *lookup = (PathLookup*)ctx;
+    lookup->slot = find_entry(shard, &lookup->key);
+}
+
+// Shard holding filepath, found without taking any lock (NULL if none)
+static IndexShard* find_path_shard(HashTable *table, PathLookup *lookup) {
+    InterlockedIncrement64(&table->reads);
+    for (int i = 0; i < INDEX_PATH_SHARDS; i++) {
+        shard_read(&table->shards[i], read_path, lookup);
+        if (lookup->slot != FLAT_INDEX_NONE) {
+            return &table->shards[i];
+        }
+    }
+    return NULL;
+}
+
+void remove_file_from_table(HashTable *table, const char *filepath) {
+    PathLookup lookup;
+    lookup.slot = FLAT_INDEX_NONE;
+    if (!resolve_path(table, filepath, FALSE, &lookup.key)) return;
+    IndexShard *shard = find_path_shard(table, &lookup);
+    if (!shard) return;
+
+    write_begin(shard);
+    // Look again now that no writer can move it
+    uint32_t slot = find_entry(shard, &lookup.key);
+    if (slot != FLAT_INDEX_NONE) {
+        release_entry(table, shard, slot);
+    }
+    BOOL compact = path_arena_wants_compaction(&shard->names);
+    write_end(shard);
+
+    if (compact) SetEvent(table->compact_event);
+}
+
+void remove_files_under_path(HashTable *table, const char *dir_path) {
+    char **removed = NULL;
+    int removed_count = 0;
+    int removed_capacity = 0;
+    int dropped = 0;
+    BOOL copying = TRUE;             // FALSE once a copy could not be allocated
+
+    uint32_t dir = path_tree_find(&table->tree, dir_path, strlen(dir_path));
+    // Held throughout, so nothing below dir is spilled behind the drop
+    if (table->spill) {
+        AcquireSRWLockExclusive(&table->spill->lock);
+        if (dir != PATH_TREE_NONE) spill_store_drop(table->spill, dir);
+    }
+    for (int i = 0; i < INDEX_PATH_SHARDS && dir != PATH_TREE_NONE; i++) {
+        IndexShard *shard = &table->shards[i];
+        write_begin(shard);
+
+        // Entries are dense, so a linear pass beats walking either index
+        for (uint32_t slot = 0; slot < shard->entry_used; slot++) {
+            FileEntry *entry = entry_at(shard, slot);
+            if (!entry->name || !path_tree_is_under(&table->tree, entry->dir, dir)) {
+                continue;
+            }
+
+            // Keep a copy so the IPC groups can be pruned after unlocking;
+            // out of memory, the entry is still dropped, only not pruned
+            char path[MAX_PATH];
+            if (copying && removed_count >= removed_capacity) {
+                int capacity = removed_capacity ? removed_capacity * 2 : 256;
+                char **grown = realloc(removed, sizeof(char*) * capacity);
+                if (grown) {
+                    removed = grown;
+                    removed_capacity = capacity;
                 } else {
-                    dup->filesize = 0;
+                    copying = FALSE;
                 }
-                
-                // Get modified time
-                get_file_modified_time(current->filepath, dup->last_modified, sizeof(dup->last_modified));
-                
-                // Generate file index
-                dup->file_index = generate_file_index(current->filepath);
-                
-                count++;
             }
-            current = current->next;
+            if (copying && format_entry_path(table, entry, path, sizeof(path))) {
+                char *copy = _strdup(path);
+                if (copy) {
+                    removed[removed_count++] = copy;
+                } else {
+                    copying = FALSE;
+                }
+            }
+            release_entry(table, shard, slot);
+            dropped++;
         }
+
+        write_end(shard);
     }
-    
-    return count;
+    if (table->spill) ReleaseSRWLockExclusive(&table->spill->lock);
+    SetEvent(table->compact_event);
+
+    for (int i = 0; i < removed_count; i++) {
+        remove_filepath_from_ipc_groups(removed[i]);
+        free(removed[i]);
+    }
+    free(removed);
+
+    if (!copying) {
+        safe_printf("[WARNING] Out of memory: the GUI may still list files under %s\n",
+                    dir_path);
+    }
+    safe_printf("[INDEX] Dropped %d entries under %s\n", dropped, dir_path);
+}
+
+typedef struct ResidentLookup {
+    PathKey key;
+    const uint8_t *digest;
+    BOOL found;
+} ResidentLookup;
+
+static void read_resident(IndexShard *shard, void *ctx) {
+    ResidentLookup *lookup = (ResidentLookup*)ctx;
+    const FileEntry *entry = entry_peek(shard, find_entry(shard, &lookup->key));
+    const DigestGroup *group = entry && entry_is(entry, &lookup->key) ?
+                               group_peek(shard, entry->group) : NULL;
+    lookup->found = group && memcmp(group->digest, lookup->digest, INDEX_DIGEST_BYTES) == 0;
+}
+
+// Is the spilled file back in memory with the same content?
+static BOOL spill_resident(HashTable *table, const SpillEntry *entry) {
+    ResidentLookup lookup;
+    lookup.key.dir = entry->dir;
+    lookup.key.name = entry->name;
+    lookup.key.hash = hash_entry_key(entry->dir, entry->name);
+    lookup.digest = entry->digest;
+    shard_read(shard_for(table, entry->digest), read_resident, &lookup);
+    return lookup.found;
 }
 
-int check_for_duplicate(HashTable *table, const char *hash, const char *new_filepath) {
-    EnterCriticalSection(&table->lock);
-    
-    int found = 0;
-    for (size_t i = 0; i < table->size; i++) {
-        FileHash *current = table->buckets[i];
-        while (current) {
-            if (strcmp(current->hash, hash) == 0 && 
-                strcmp(current->filepath, new_filepath) != 0) {
-                found = 1;
-                break;
+typedef struct SpillCopy {
+    HashTable *dst;
+    HashTable *src;
+    uint32_t dir;
+    size_t copied;
+} SpillCopy;
+
+static void copy_spilled(const SpillEntry *entry, void *ctx) {
+    SpillCopy *copy = (SpillCopy*)ctx;
+    char path[MAX_PATH];
+    // Files back in memory are copied from the shards
+    if (entry->dir == PATH_TREE_NONE || !path_tree_is_under(&copy->src->tree, entry->dir, copy->dir) ||
+        spill_resident(copy->src, entry) || !spill_valid(copy->src, entry, path)) {
+        return;
+    }
+    char hash[HASH_SIZE * 2 + 1];
+    FileMeta meta = { entry->filesize, entry->mtime, entry->file_index };
+    format_digest(entry->digest, hash);
+    add_file_hash(copy->dst, hash, path, &meta);
+    copy->copied++;
+}
+
+size_t hash_table_copy_under(HashTable *dst, HashTable *src, const char *dir_path) {
+    size_t copied = 0;
+    uint32_t dir = path_tree_find(&src->tree, dir_path, strlen(dir_path));
+    if (src->spill && dir != PATH_TREE_NONE) {
+        SpillCopy copy = { dst, src, dir, 0 };
+        AcquireSRWLockShared(&src->spill->lock);
+        spill_store_for_each(src->spill, copy_spilled, &copy);
+        ReleaseSRWLockShared(&src->spill->lock);
+        copied += copy.copied;
+    }
+    for (int i = 0; i < INDEX_PATH_SHARDS && dir != PATH_TREE_NONE; i++) {
+        IndexShard *shard = &src->shards[i];
+        // Nothing takes a src lock while holding one of dst's, so adding
+        // under src's lock cannot deadlock
+        shard_lock(shard);
+        for (uint32_t slot = 0; slot < shard->entry_used; slot++) {
+            const FileEntry *entry = entry_at(shard, slot);
+            char path[MAX_PATH];
+            if (!entry->name || !path_tree_is_under(&src->tree, entry->dir, dir) ||
+                !format_entry_path(src, entry, path, sizeof(path))) {
+                continue;
             }
-            current = current->next;
-        }
-        if (found) break;
-    }
-    
-    // If duplicate found, collect all duplicates and send IPC alert
-    if (found) {
-        FileInfo duplicates[100]; // Max 100 duplicates per alert
-        int duplicate_count = collect_duplicates_for_hash(table, hash, new_filepath, duplicates, 100);
-        
-        if (duplicate_count > 0) {
-            // Build FileInfo for trigger file (new file)
-            FileInfo trigger;
-            strncpy(trigger.filepath, new_filepath, MAX_PATH - 1);
-            trigger.filepath[MAX_PATH - 1] = '\0';
-            
-            const char *filename = strrchr(new_filepath, '\\');
-            filename = filename ? filename + 1 : new_filepath;
-            strncpy(trigger.filename, filename, MAX_PATH - 1);
-            trigger.filename[MAX_PATH - 1] = '\0';
-            
-            strncpy(trigger.filehash, hash, 64);
-            trigger.filehash[64] = '\0';
-            
-            // Get file size
-            WIN32_FILE_ATTRIBUTE_DATA file_data;
-            if (GetFileAttributesEx(new_filepath, GetFileExInfoStandard, &file_data)) {
-                trigger.filesize = ((uint64_t)file_data.nFileSizeHigh << 32) | file_data.nFileSizeLow;
+            FileMeta meta = entry_meta(shard, slot);
+            if (entry->group == FLAT_INDEX_NONE) {
+                hash_table_add_empty(dst, path, &meta);
             } else {
-                trigger.filesize = 0;
+                char hash[HASH_SIZE * 2 + 1];
+                format_digest(group_at(shard, entry->group)->digest, hash);
+                add_file_hash(dst, hash, path, &meta);
             }
-            
-            get_file_modified_time(new_filepath, trigger.last_modified, sizeof(trigger.last_modified));
-            trigger.file_index = generate_file_index(new_filepath);
-            
-            // Get timestamp
-            char timestamp[32];
-            get_iso8601_timestamp(timestamp, sizeof(timestamp));
-            
-            // Send alert via IPC (releases lock internally if needed)
-            LeaveCriticalSection(&table->lock);
-            send_alert_duplicate_detected(&trigger, duplicates, duplicate_count, timestamp);
-            EnterCriticalSection(&table->lock);
+            copied++;
         }
+        shard_unlock(shard);
     }
-    
-    LeaveCriticalSection(&table->lock);
-    return found;
+    return copied;
 }
 
-void print_duplicates_for_file(HashTable *table, const char *hash, 
+// Fill the alert record for one file from what the index holds
+static void fill_file_info(FileInfo *info, const char *filepath, const char *hash,
+                           const FileMeta *meta) {
+    strncpy(info->filepath, filepath, MAX_PATH - 1);
+    info->filepath[MAX_PATH - 1] = '\0';
+
+    // Extract filename
+    const char *filename = strrchr(filepath, '\\');
+    filename = filename ? filename + 1 : filepath;
+    strncpy(info->filename, filename, MAX_PATH - 1);
+    info->filename[MAX_PATH - 1] = '\0';
+
+    strncpy(info->filehash, hash, 64);
+    info->filehash[64] = '\0';
+
+    info->filesize = meta ? meta->filesize : 0;
+    format_file_time(meta ? meta->mtime : 0, info->last_modified, sizeof(info->last_modified));
+    // Files restored from the caches were never opened
+    info->file_index = meta && meta->file_index ? meta->file_index : path_file_index(filepath);
+}
+
+// Fill alert records for up to max_count members of a group, skipping the
+// file at exclude.  Memory only, so cheap enough to do under the lock.
+static int copy_group_files(HashTable *table, IndexShard *shard, uint32_t group,
+                            const PathKey *exclude, const char *hash,
+                            FileInfo *files, int max_count) {
+    int count = 0;
+    if (group == FLAT_INDEX_NONE) return 0;
+
+    for (uint32_t m = group_at(shard, group)->members;
+         m != FLAT_INDEX_NONE && count < max_count;
+         m = entry_at(shard, m)->group_next) {
+        const FileEntry *entry = entry_at(shard, m);
+        char path[MAX_PATH];
+        if ((!exclude || !entry_is(entry, exclude)) &&
+            format_entry_path(table, entry, path, sizeof(path))) {
+            FileMeta meta = entry_meta(shard, m);
+            fill_file_info(&files[count++], path, hash, &meta);
+        }
+    }
+    return count;
+}
+
+#if INDEX_DIGEST_BYTES < HASH_SIZE
+// Groups are keyed by a digest prefix, so two contents could share one.
+// Keep only the files whose full digest is hash (the digest store's, or
+// the file hashed again), so a collision never reaches the GUI as copies
+// it might delete.  Returns how many were kept.
+static int confirm_full_digest(FileInfo *files, int count, const char *hash) {
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        char full[HASH_SIZE * 2 + 1];
+        if (file_full_digest(files[i].filepath, full) == 0 && strcmp(full, hash) == 0) {
+            if (kept != i) files[kept] = files[i];
+            strcpy(files[kept++].filehash, hash);
+        } else {
+            safe_printf("[INDEX] %s shares a digest prefix with %.16s... but not the content\n",
+                        files[i].filepath, hash);
+        }
+    }
+    return kept;
+}
+#endif
+
+typedef struct GroupLookup {
+    const uint8_t *digest;
+    const PathKey *file;         // File that should not count as a duplicate
+    uint32_t count;
+    BOOL has_other;
+    BOOL filtered;               // The filter ruled the digest out
+} GroupLookup;
+
+// Group size and whether it holds a file other than file.  A group of two
+// or more always does; a group of one only if its member differs.
+static void read_group(IndexShard *shard, void *ctx) {
+    GroupLookup *lookup = (GroupLookup*)ctx;
+    lookup->count = 0;
+    lookup->has_other = FALSE;
+    lookup->filtered = !content_filter_may_contain(&shard->digest_filter,
+                                                   hash_digest(lookup->digest));
+    if (lookup->filtered) return;
+
+    const DigestGroup *group = group_peek(shard, find_group(shard, lookup->digest));
+    if (!group) return;
+    lookup->count = group->count;
+    if (lookup->count >= 2) {
+        lookup->has_other = TRUE;
+    } else if (lookup->count == 1 && lookup->file) {
+        const FileEntry *member = entry_peek(shard, group->members);
+        lookup->has_other = member && member->name && !entry_is(member, lookup->file);
+    }
+}
+
+// Lock-free group read, counting the probes the filter saved or failed to
+static void lookup_group(HashTable *table, IndexShard *shard, GroupLookup *lookup) {
+    InterlockedIncrement64(&table->reads);
+    shard_read(shard, read_group, lookup);
+    if (lookup->filtered) {
+        InterlockedIncrement64(&shard->filter_rejects);
+    } else if (lookup->count == 0) {
+        InterlockedIncrement64(&shard->filter_false_positives);
+    }
+}
+
+// What one more live entry or group costs: its slot, its share of a column
+// block and a flat index slot (value and control byte, at the 7/8 load)
+#define FLAT_SLOT_BYTES ((sizeof(uint32_t) + 1) * 8 / 7 + 1)
+#define ENTRY_BYTES (sizeof(FileEntry) + sizeof(EntryColumns) / SLOT_CHUNK_SIZE + FLAT_SLOT_BYTES)
+#define GROUP_BYTES (sizeof(DigestGroup) + sizeof(GroupColumns) / SLOT_CHUNK_SIZE + FLAT_SLOT_BYTES)
+
+// hash_table_memory without the spill store.  Unlocked, so approximate
+// while writers run.
+static size_t resident_memory(HashTable *table) {
+    size_t bytes = (size_t)table->tree.count * sizeof(PathNode);
+    for (int i = 0; i < INDEX_PATH_SHARDS; i++) {
+        IndexShard *shard = &table->shards[i];
+        bytes += shard->path_index.count * ENTRY_BYTES + shard->digest_index.count * GROUP_BYTES +
+                 shard->names.live_bytes +
+                 content_filter_capacity(&shard->digest_filter) / FILTER_KEYS_PER_BLOCK * FILTER_BLOCK_BYTES;
+    }
+    return bytes;
+}
+
+// Spilled files with one digest that a lookup brings back at most
+#define UNSPILL_MAX 16
+
+// Adds between checks of the memory budget
+#define BUDGET_CHECK_ADDS 256
+
+// Count files added (or brought back) and wake the compaction thread when
+// the index has outgrown its budget (spill lock held shared)
+static void check_budget(HashTable *table, LONG added) {
+    LONG ticks = InterlockedExchangeAdd(&table->budget_ticks, added) + added;
+    if (ticks / BUDGET_CHECK_ADDS != (ticks - added) / BUDGET_CHECK_ADDS &&
+        resident_memory(table) + spill_store_memory(table->spill) > table->memory_budget) {
+        SetEvent(table->compact_event);
+    }
+}
+
+// Put the spilled files with this digest back in memory if no file with it
+// is there (spill lock held shared).  A group in memory means they already
+// came back, so only a miss the run filters cannot rule out reads the disk.
+static void unspill(HashTable *table, IndexShard *shard, const uint8_t *digest) {
+    SpillStore *spill = table->spill;
+    uint64_t key = hash_digest(digest);
+    if (spill->run_count == 0 || !spill_store_may_contain(spill, key)) return;
+    GroupLookup lookup = { digest, NULL, 0, FALSE, FALSE };
+    shard_read(shard, read_group, &lookup);
+    if (lookup.count > 0) return;
+
+    SpillEntry found[UNSPILL_MAX];
+    char names[UNSPILL_MAX][MAX_PATH];
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    int count = spill_store_find(spill, key, digest, found, names, UNSPILL_MAX);
+    latency_record_since(&spill->disk, start);
+    InterlockedIncrement64(&spill->probes);
+
+    LONG restored = 0;
+    for (int i = 0; i < count; i++) {
+        char path[MAX_PATH];
+        PathKey file;
+        if (!spill_valid(table, &found[i], path) || !resolve_path(table, path, TRUE, &file)) {
+            continue;
+        }
+        FileMeta meta = { found[i].filesize, found[i].mtime, found[i].file_index };
+        insert_file(table, shard, found[i].digest, &file, &meta);
+        restored++;
+    }
+    if (restored > 0) check_budget(table, restored);
+}
+
+// Lock out spills until spill_lookup_end and bring back what the lookup
+// must see
+static void spill_lookup_begin(HashTable *table, IndexShard *shard, const uint8_t *digest,
+                               LARGE_INTEGER *start) {
+    if (!table->spill) return;
+    QueryPerformanceCounter(start);
+    AcquireSRWLockShared(&table->spill->lock);
+    unspill(table, shard, digest);
+}
+
+static void spill_lookup_end(HashTable *table, LARGE_INTEGER start) {
+    if (!table->spill) return;
+    ReleaseSRWLockShared(&table->spill->lock);
+    latency_record_since(&table->spill->lookups, start);
+}
+
+void add_file_hash(HashTable *table, const char *hash, const char *filepath,
+                   const FileMeta *meta) {
+    uint8_t digest[INDEX_DIGEST_BYTES];
+    if (!parse_digest(hash, digest)) return;
+
+    IndexShard *shard = shard_for(table, digest);
+    // Directory first: the path tree has its own lock, never taken inside
+    // a shard's while it can add nodes
+    PathKey key;
+    if (!resolve_path(table, filepath, TRUE, &key)) return;
+    if (!table->spill) {
+        insert_file(table, shard, digest, &key, meta);
+        return;
+    }
+
+    // The new file joins any spilled ones with its digest in memory, and
+    // no spill slips in between
+    AcquireSRWLockShared(&table->spill->lock);
+    unspill(table, shard, digest);
+    insert_file(table, shard, digest, &key, meta);
+    check_budget(table, 1);
+    ReleaseSRWLockShared(&table->spill->lock);
+}
+
+int check_for_duplicate(HashTable *table, const char *hash, const char *new_filepath,
+                        const FileMeta *new_meta) {
+    uint8_t digest[INDEX_DIGEST_BYTES];
+    if (!parse_digest(hash, digest)) return 0;
+
+    IndexShard *shard = shard_for(table, digest);
+    PathKey key;
+    // Interned, not just looked up, so a directory new to the index
+    // already carries its reference mark
+    if (resolve_path(table, new_filepath, TRUE, &key) &&
+        path_tree_is_reference(&table->tree, key.dir)) {
+        return 0;
+    }
+    GroupLookup lookup = { digest, &key, 0, FALSE, FALSE };
+    LARGE_INTEGER start;
+    spill_lookup_begin(table, shard, digest, &start);
+    lookup_group(table, shard, &lookup);
+    // An index built behind the live one stays quiet until it is swapped in
+    FileInfo *duplicates = lookup.has_other && table == g_hash_table ?
+                           malloc(sizeof(FileInfo) * MAX_DUPLICATES) : NULL;
+    int duplicate_count = 0;
+    if (duplicates) {
+        // Collected before a spill could take the group's only other file
+        shard_lock(shard);
+        duplicate_count = copy_group_files(table, shard, find_group(shard, digest),
+                                           &key, hash, duplicates, MAX_DUPLICATES);
+        shard_unlock(shard);
+    }
+    spill_lookup_end(table, start);
+    if (!lookup.has_other) return 0;
+    if (!duplicates) return 1;
+
+#if INDEX_DIGEST_BYTES < HASH_SIZE
+    duplicate_count = confirm_full_digest(duplicates, duplicate_count, hash);
+    if (duplicate_count == 0) {
+        free(duplicates);
+        return 0;
+    }
+#endif
+
+    if (duplicate_count > 0) {
+        // Build FileInfo for trigger file (new file)
+        FileInfo trigger;
+        fill_file_info(&trigger, new_filepath, hash, new_meta);
+
+        // Get timestamp
+        char timestamp[32];
+        get_iso8601_timestamp(timestamp, sizeof(timestamp));
+
+        send_alert_duplicate_detected(&trigger, duplicates, duplicate_count, timestamp);
+    }
+
+    free(duplicates);
+    return 1;
+}
+
+void print_duplicates_for_file(HashTable *table, const char *hash,
                                const char *new_filepath) {
-    EnterCriticalSection(&table->lock);
-    
+    uint8_t digest[INDEX_DIGEST_BYTES];
+    if (!parse_digest(hash, digest)) return;
+    IndexShard *shard = shard_for(table, digest);
+
+    PathKey key;
+    resolve_path(table, new_filepath, FALSE, &key);
+
+    shard_lock(shard);
+
     safe_printf("\n[DUPLICATE DETECTED]\n");
     safe_printf("New file: %s\n", new_filepath);
     safe_printf("Matches existing files:\n");
-    
-    for (size_t i = 0; i < table->size; i++) {
-        FileHash *current = table->buckets[i];
-        while (current) {
-            if (strcmp(current->hash, hash) == 0 && 
-                strcmp(current->filepath, new_filepath) != 0) {
-                safe_printf(" - %s\n", current->filepath);
-            }
-            current = current->next;
+
+    uint32_t group = find_group(shard, digest);
+    for (uint32_t m = group != FLAT_INDEX_NONE ? group_at(shard, group)->members : FLAT_INDEX_NONE;
+         m != FLAT_INDEX_NONE; m = entry_at(shard, m)->group_next) {
+        const FileEntry *entry = entry_at(shard, m);
+        char path[MAX_PATH];
+        if (!entry_is(entry, &key) && format_entry_path(table, entry, path, sizeof(path))) {
+            safe_printf(" - %s\n", path);
         }
     }
     safe_printf("\n");
-    
-    LeaveCriticalSection(&table->lock);
+
+    shard_unlock(shard);
+}
+
+// One shard's duplicate groups, copied under its lock so they can be
+// printed and sent (a pipe write may block) after unlocking
+typedef struct DuplicateBatch {
+    char *paths;                 // NUL-separated member paths, group by group
+    size_t paths_used;
+    size_t paths_capacity;
+    FileMeta *metas;             // One per path, in the same order
+    uint32_t meta_count;
+    uint32_t meta_capacity;
+    DigestGroup *groups;         // digest and count of each group
+    uint32_t group_count;
+} DuplicateBatch;
+
+static BOOL batch_add_file(DuplicateBatch *batch, const char *path, const FileMeta *meta) {
+    if (batch->meta_count == batch->meta_capacity) {
+        uint32_t capacity = batch->meta_capacity ? batch->meta_capacity * 2 : 1024;
+        FileMeta *grown = realloc(batch->metas, sizeof(FileMeta) * capacity);
+        if (!grown) return FALSE;
+        batch->metas = grown;
+        batch->meta_capacity = capacity;
+    }
+    batch->metas[batch->meta_count++] = *meta;
+
+    size_t len = strlen(path) + 1;
+    if (batch->paths_used + len > batch->paths_capacity) {
+        size_t capacity = batch->paths_capacity ? batch->paths_capacity * 2 : 65536;
+        while (capacity < batch->paths_used + len) capacity *= 2;
+        char *grown = realloc(batch->paths, capacity);
+        if (!grown) return FALSE;
+        batch->paths = grown;
+        batch->paths_capacity = capacity;
+    }
+    memcpy(batch->paths + batch->paths_used, path, len);
+    batch->paths_used += len;
+    return TRUE;
+}
+
+// Whether every member of a group lies inside copies of the same duplicate
+// directory, which was reported instead (shard lock held)
+static BOOL group_in_directories(IndexShard *shard, const DigestGroup *group,
+                                 const DirectoryDuplicates *dirs) {
+    uint32_t covering = 0;
+    for (uint32_t m = group->members; m != FLAT_INDEX_NONE; m = entry_at(shard, m)->group_next) {
+        uint32_t dir = entry_at(shard, m)->dir;
+        // Directories added since the snapshot are in none of its groups
+        uint32_t by = dir < dirs->node_count ? dirs->covered[dir] : 0;
+        if (by == 0 || (covering && by != covering)) return FALSE;
+        covering = by;
+    }
+    return TRUE;
+}
+
+// First member outside the reference roots, or FLAT_INDEX_NONE if the
+// group lies wholly inside them (shard lock held)
+static uint32_t group_lead(HashTable *table, IndexShard *shard, const DigestGroup *group) {
+    for (uint32_t m = group->members; m != FLAT_INDEX_NONE; m = entry_at(shard, m)->group_next) {
+        if (!path_tree_is_reference(&table->tree, entry_at(shard, m)->dir)) return m;
+    }
+    return FLAT_INDEX_NONE;
+}
+
+static BOOL batch_add_entry(HashTable *table, IndexShard *shard, DuplicateBatch *batch,
+                            uint32_t slot) {
+    const FileEntry *entry = entry_at(shard, slot);
+    char path[MAX_PATH];
+    FileMeta meta = entry_meta(shard, slot);
+    // A path too long to rebuild is listed by its name alone
+    return batch_add_file(batch, format_entry_path(table, entry, path, sizeof(path))
+                                 ? path : entry->name, &meta);
+}
+
+// Copy every group in the shard's duplicate heap, leaving out groups the
+// duplicate directories already account for and groups found only in
+// reference roots.  The first member copied is never a reference file, as
+// it becomes the alert's trigger.  (Shard lock held.)
+static BOOL collect_duplicates(HashTable *table, IndexShard *shard, DuplicateBatch *batch,
+                               const DirectoryDuplicates *dirs, int *folded) {
+    batch->paths_used = 0;
+    batch->meta_count = 0;
+    batch->group_count = 0;
+    if (shard->dup_groups == 0) return TRUE;
+
+    DigestGroup *groups = realloc(batch->groups, sizeof(DigestGroup) * shard->dup_groups);
+    if (!groups) return FALSE;
+    batch->groups = groups;
+
+    for (uint32_t i = 0; i < shard->dup_groups; i++) {
+        DigestGroup *group = group_at(shard, shard->dup_heap->slots[i]);
+        uint32_t lead = group_lead(table, shard, group);
+        if (lead == FLAT_INDEX_NONE) continue;
+        if (dirs && group_in_directories(shard, group, dirs)) {
+            (*folded)++;
+            continue;
+        }
+        if (!batch_add_entry(table, shard, batch, lead)) return FALSE;
+        for (uint32_t m = group->members; m != FLAT_INDEX_NONE; m = entry_at(shard, m)->group_next) {
+            if (m != lead && !batch_add_entry(table, shard, batch, m)) return FALSE;
+        }
+        batch->groups[batch->group_count++] = *group;
+    }
+    return TRUE;
+}
+
+// TRUE if every copy in a directory group lies in a reference root
+static BOOL directories_all_reference(HashTable *table, const DirectoryDuplicates *dirs,
+                                      const DirectoryGroup *group) {
+    for (uint32_t i = 0; i < group->count; i++) {
+        if (!path_tree_is_reference(&table->tree, dirs->nodes[group->first + i])) return FALSE;
+    }
+    return TRUE;
+}
+
+// Report each set of identical directory trees as one alert, outermost
+// copies only, skipping sets found only in reference roots.  Returns FALSE
+// (and reports nothing) when out of memory.
+static BOOL report_duplicate_directories(HashTable *table, DirectoryDuplicates *dirs,
+                                         const char *timestamp, uint32_t *reported) {
+    *reported = 0;
+    if (!path_tree_duplicate_directories(&table->tree, DIRECTORY_MIN_FILES, dirs)) {
+        safe_printf("[INDEX] Out of memory comparing directory digests\n");
+        return FALSE;
+    }
+    if (dirs->group_count == 0) return TRUE;
+
+    char (*paths)[MAX_PATH] = malloc(sizeof(*paths) * MAX_DUPLICATES);
+    const char **list = malloc(sizeof(char*) * MAX_DUPLICATES);
+    if (!paths || !list) {
+        free(paths);
+        free(list);
+        return TRUE;
+    }
+
+    for (uint32_t g = 0; g < dirs->group_count; g++) {
+        const DirectoryGroup *group = &dirs->groups[g];
+        if (directories_all_reference(table, dirs, group)) continue;
+        if (++*reported == 1) safe_printf("\n=== DUPLICATE DIRECTORIES ===\n\n");
+        safe_printf("Duplicate directory #%u (%llu files, %.1f MB each):\n", *reported,
+                    (unsigned long long)group->files, group->bytes / (1024.0 * 1024.0));
+        int count = 0;
+        for (uint32_t i = 0; i < group->count && count < MAX_DUPLICATES; i++) {
+            if (!path_tree_format(&table->tree, dirs->nodes[group->first + i],
+                                  paths[count], MAX_PATH)) {
+                continue;
+            }
+            safe_printf(" - %s\n", paths[count]);
+            list[count] = paths[count];
+            count++;
+        }
+        safe_printf("\n");
+        if (count >= 2) {
+            send_alert_duplicate_directory(list, count, group->files, group->bytes, timestamp);
+        }
+    }
+    free(paths);
+    free(list);
+    return TRUE;
 }
 
 void find_duplicates(HashTable *table) {
-    EnterCriticalSection(&table->lock);
-    
     int duplicate_groups = 0;
+    int folded_groups = 0;
     int total_duplicate_files = 0;
-    char **processed_hashes = malloc(sizeof(char*) * 1000);
-    int processed_count = 0;
-    
+    DuplicateBatch batch = { 0 };
+    FileInfo *files = NULL;
+    uint32_t files_capacity = 0;
+
+    char timestamp[32];
+    get_iso8601_timestamp(timestamp, sizeof(timestamp));
+
+    // Whole copied trees first; their files are not listed one group at a time
+    DirectoryDuplicates dirs;
+    uint32_t directory_groups = 0;
+    BOOL have_dirs = report_duplicate_directories(table, &dirs, timestamp, &directory_groups);
+
     safe_printf("\n=== DUPLICATE FILES (Initial Scan) ===\n\n");
-    
-    for (size_t i = 0; i < table->size; i++) {
-        FileHash *current = table->buckets[i];
-        
-        while (current) {
-            int already_processed = 0;
-            for (int j = 0; j < processed_count; j++) {
-                if (strcmp(processed_hashes[j], current->hash) == 0) {
-                    already_processed = 1;
-                    break;
-                }
-            }
-            
-            if (already_processed) {
-                current = current->next;
-                continue;
+
+    for (int s = 0; s < INDEX_SHARD_COUNT; s++) {
+        IndexShard *shard = &table->shards[s];
+        shard_lock(shard);
+        BOOL collected = collect_duplicates(table, shard, &batch,
+                                            have_dirs ? &dirs : NULL, &folded_groups);
+        shard_unlock(shard);
+        if (!collected) {
+            safe_printf("[INDEX] Out of memory collecting duplicates of shard %d\n", s);
+            continue;
+        }
+
+        const char *path = batch.paths;
+        const FileMeta *meta = batch.metas;
+        for (uint32_t g = 0; g < batch.group_count; g++) {
+            uint32_t count = batch.groups[g].count;
+            char hash[HASH_SIZE * 2 + 1];
+            format_digest(batch.groups[g].digest, hash);
+
+            if (count > files_capacity) {
+                FileInfo *grown = realloc(files, sizeof(FileInfo) * count);
+                if (!grown) break;
+                files = grown;
+                files_capacity = count;
             }
-            
-            // Count files with this hash
-            int count = 0;
-            FileHash *counter = current;
-            for (size_t k = i; k < table->size; k++) {
-                FileHash *temp = (k == i) ? counter : table->buckets[k];
-                while (temp) {
-                    if (strcmp(temp->hash, current->hash) == 0) {
-                        count++;
-                    }
-                    temp = temp->next;
-                }
+
+            for (uint32_t i = 0; i < count; i++) {
+                fill_file_info(&files[i], path, hash, meta++);
+                path += strlen(path) + 1;
             }
-            
-            if (count > 1) {
-                duplicate_groups++;
-                total_duplicate_files += count;
-                safe_printf("Duplicate group #%d (hash: %s):\n", 
-                       duplicate_groups, current->hash);
-                
-                // Collect all files with this hash for IPC alert
-                FileInfo *all_files = malloc(sizeof(FileInfo) * count);
-                int file_index = 0;
-                
-                for (size_t k = i; k < table->size && file_index < count; k++) {
-                    FileHash *temp = (k == i) ? current : table->buckets[k];
-                    while (temp && file_index < count) {
-                        if (strcmp(temp->hash, current->hash) == 0) {
-                            safe_printf(" - %s\n", temp->filepath);
-                            
-                            // Populate FileInfo
-                            FileInfo *info = &all_files[file_index];
-                            strncpy(info->filepath, temp->filepath, MAX_PATH - 1);
-                            info->filepath[MAX_PATH - 1] = '\0';
-                            
-                            const char *filename = strrchr(temp->filepath, '\\');
-                            filename = filename ? filename + 1 : temp->filepath;
-                            strncpy(info->filename, filename, MAX_PATH - 1);
-                            info->filename[MAX_PATH - 1] = '\0';
-                            
-                            strncpy(info->filehash, current->hash, 64);
-                            info->filehash[64] = '\0';
-                            
-                            // Get file size
-                            WIN32_FILE_ATTRIBUTE_DATA file_data;
-                            if (GetFileAttributesEx(temp->filepath, GetFileExInfoStandard, &file_data)) {
-                                info->filesize = ((uint64_t)file_data.nFileSizeHigh << 32) | file_data.nFileSizeLow;
-                            } else {
-                                info->filesize = 0;
-                            }
-                            
-                            get_file_modified_time(temp->filepath, info->last_modified, sizeof(info->last_modified));
-                            info->file_index = generate_file_index(temp->filepath);
-                            
-                            file_index++;
-                        }
-                        temp = temp->next;
-                    }
-                }
-                
-                safe_printf("\n");
-                
-                // Send IPC alert: use first file as trigger, rest as duplicates
-                if (file_index > 1) {
-                    char timestamp[32];
-                    get_iso8601_timestamp(timestamp, sizeof(timestamp));
-                    
-                    // Release lock before sending
-                    LeaveCriticalSection(&table->lock);
-                    send_alert_duplicate_detected(&all_files[0], &all_files[1], file_index - 1, timestamp);
-                    Sleep(100); // Small delay between alerts so GUI can process them
-                    EnterCriticalSection(&table->lock);
-                }
-                
-                free(all_files);
-                
-                processed_hashes[processed_count] = _strdup(current->hash);
-                processed_count++;
+
+#if INDEX_DIGEST_BYTES < HASH_SIZE
+            // The first file's full digest stands for the group; a member
+            // that only shares the prefix is dropped
+            if (file_full_digest(files[0].filepath, hash) != 0) continue;
+            count = (uint32_t)confirm_full_digest(files, (int)count, hash);
+            if (count < 2) continue;
+#endif
+
+            duplicate_groups++;
+            total_duplicate_files += count;
+            safe_printf("Duplicate group #%d (hash: %s):\n", duplicate_groups, hash);
+            for (uint32_t i = 0; i < count; i++) {
+                safe_printf(" - %s\n", files[i].filepath);
             }
-            
-            current = current->next;
+            safe_printf("\n");
+
+            // First file as trigger, the rest as duplicates.  Each alert is
+            // one pipe message and the write blocks while the GUI catches up.
+            send_alert_duplicate_detected(&files[0], &files[1], count - 1, timestamp);
         }
     }
-    
-    for (int i = 0; i < processed_count; i++) {
-        free(processed_hashes[i]);
+
+    free(batch.paths);
+    free(batch.metas);
+    free(batch.groups);
+    free(files);
+    if (have_dirs) path_tree_free_duplicates(&dirs);
+
+    if (directory_groups > 0) {
+        safe_printf("Found %u duplicate directories (%d file groups inside them not listed).\n",
+                    directory_groups, folded_groups);
     }
-    free(processed_hashes);
-    
-    if (duplicate_groups == 0) {
+    if (duplicate_groups == 0 && directory_groups == 0) {
         safe_printf("No duplicates found.\n");
     } else {
-        safe_printf("Found %d duplicate groups (%d total duplicate files).\n", 
+        safe_printf("Found %d duplicate groups (%d total duplicate files).\n",
                    duplicate_groups, total_duplicate_files);
     }
-    
-    LeaveCriticalSection(&table->lock);
-    
+
     // Send scan complete alert via IPC
-    char timestamp[32];
     get_iso8601_timestamp(timestamp, sizeof(timestamp));
     send_alert_scan_complete(total_duplicate_files, duplicate_groups, timestamp);
 }
 
+int hash_table_visit_empty(HashTable *table, EmptyFileVisitor visit, void *ctx) {
+    IndexShard *shard = &table->shards[EMPTY_SHARD];
+    DuplicateBatch batch = { 0 };
+
+    // Copy out first: the visitor may block on the pipe
+    shard_lock(shard);
+    BOOL copied = TRUE;
+    for (uint32_t slot = 0; slot < shard->entry_used && copied; slot++) {
+        const FileEntry *entry = entry_at(shard, slot);
+        if (!entry->name) continue;
+        char path[MAX_PATH];
+        FileMeta meta = entry_meta(shard, slot);
+        copied = batch_add_file(&batch, format_entry_path(table, entry, path, sizeof(path))
+                                        ? path : entry->name, &meta);
+    }
+    shard_unlock(shard);
+    if (!copied) {
+        safe_printf("[INDEX] Out of memory listing empty files\n");
+    }
+
+    const char *path = batch.paths;
+    for (uint32_t i = 0; i < batch.meta_count; i++) {
+        visit(path, &batch.metas[i], ctx);
+        path += strlen(path) + 1;
+    }
+
+    free(batch.paths);
+    free(batch.metas);
+    return (int)batch.meta_count;
+}
+
+static void print_empty_file(const char *filepath, const FileMeta *meta, void *ctx) {
+    (void)meta;
+    if (*(int*)ctx == 0) {
+        safe_printf("\n=== EMPTY FILES (0 bytes) ===\n\n");
+    }
+    (*(int*)ctx)++;
+    safe_printf(" - %s\n", filepath);
+}
+
+void print_empty_files(HashTable *table) {
+    int printed = 0;
+    hash_table_visit_empty(table, print_empty_file, &printed);
+    if (printed > 0) {
+        safe_printf("\nTotal empty files: %d\n", printed);
+    }
+}
+
+int hash_table_group_size(HashTable *table, const char *hash) {
+    uint8_t digest[INDEX_DIGEST_BYTES];
+    if (!parse_digest(hash, digest)) return 0;
+
+    IndexShard *shard = shard_for(table, digest);
+    GroupLookup lookup = { digest, NULL, 0, FALSE, FALSE };
+    LARGE_INTEGER start;
+    spill_lookup_begin(table, shard, digest, &start);
+    lookup_group(table, shard, &lookup);
+    spill_lookup_end(table, start);
+    return (int)lookup.count;
+}
+
+// Heap position on the best-first frontier, with the wasted bytes it was
+// pushed with
+typedef struct HeapCursor {
+    uint32_t pos;
+    uint64_t wasted;
+} HeapCursor;
+
+typedef struct TopRead {
+    int k;
+    WastedGroup *groups;         // Up to k, largest first
+    int count;
+    HeapCursor *frontier;        // k + 1 cursors
+} TopRead;
+
+static const GroupColumns* group_columns_peek(IndexShard *shard, uint32_t slot) {
+    ChunkTable *chunks = shard->group_columns;
+    if (!chunks || (slot >> SLOT_CHUNK_BITS) >= chunks->count) return NULL;
+    return chunks->chunks[slot >> SLOT_CHUNK_BITS];
+}
+
+// Wasted bytes of the group at heap position pos (0 if a racing writer
+// left it unreadable; the seq check discards that run)
+static uint64_t peek_wasted(IndexShard *shard, const GroupHeap *heap, uint32_t pos) {
+    const GroupColumns *columns = group_columns_peek(shard, heap->slots[pos]);
+    if (!columns) return 0;
+    uint32_t count = columns->counts[COLUMN_INDEX(heap->slots[pos])];
+    return count > 1 ? (uint64_t)(count - 1) * columns->sizes[COLUMN_INDEX(heap->slots[pos])] : 0;
+}
+
+static void frontier_push(HeapCursor *frontier, int *size, uint32_t pos, uint64_t wasted) {
+    int i = (*size)++;
+    while (i > 0 && frontier[(i - 1) / 2].wasted < wasted) {
+        frontier[i] = frontier[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    frontier[i].pos = pos;
+    frontier[i].wasted = wasted;
+}
+
+static HeapCursor frontier_pop(HeapCursor *frontier, int *size) {
+    HeapCursor top = frontier[0];
+    HeapCursor last = frontier[--(*size)];
+    int i = 0;
+    for (;;) {
+        int child = i * 2 + 1;
+        if (child >= *size) break;
+        if (child + 1 < *size && frontier[child + 1].wasted > frontier[child].wasted) child++;
+        if (frontier[child].wasted <= last.wasted) break;
+        frontier[i] = frontier[child];
+        i = child;
+    }
+    frontier[i] = last;
+    return top;
+}
+
+// Best-first walk of the shard's duplicate heap: a position's children
+// can only come next once it has been taken, so the frontier never holds
+// more than k + 1 positions
+static void read_top_groups(IndexShard *shard, void *ctx) {
+    TopRead *read = (TopRead*)ctx;
+    read->count = 0;
+    const GroupHeap *heap = shard->dup_heap;
+    if (!heap) return;
+    uint32_t size = shard->dup_groups;
+    if (size > heap->capacity) size = heap->capacity;
+    if (size == 0) return;
+
+    int frontier_size = 0;
+    frontier_push(read->frontier, &frontier_size, 0, peek_wasted(shard, heap, 0));
+    while (frontier_size > 0 && read->count < read->k) {
+        HeapCursor cursor = frontier_pop(read->frontier, &frontier_size);
+        uint32_t slot = heap->slots[cursor.pos];
+        const DigestGroup *group = group_peek(shard, slot);
+        const GroupColumns *columns = group_columns_peek(shard, slot);
+        if (!group || !columns) continue;
+
+        WastedGroup *out = &read->groups[read->count++];
+        format_digest(group->digest, out->hash);
+        out->filesize = columns->sizes[COLUMN_INDEX(slot)];
+        out->count = columns->counts[COLUMN_INDEX(slot)];
+        out->wasted_bytes = cursor.wasted;
+
+        for (uint32_t child = cursor.pos * 2 + 1; child <= cursor.pos * 2 + 2 && child < size; child++) {
+            frontier_push(read->frontier, &frontier_size, child, peek_wasted(shard, heap, child));
+        }
+    }
+}
+
+static int compare_wasted(const void *a, const void *b) {
+    uint64_t wa = ((const WastedGroup*)a)->wasted_bytes;
+    uint64_t wb = ((const WastedGroup*)b)->wasted_bytes;
+    return wa < wb ? 1 : wa > wb ? -1 : 0;
+}
+
+int hash_table_top_groups(HashTable *table, WastedGroup *groups, int k) {
+    if (k <= 0) return 0;
+    WastedGroup *found = malloc(sizeof(WastedGroup) * (size_t)k * INDEX_SHARD_COUNT);
+    HeapCursor *frontier = malloc(sizeof(HeapCursor) * ((size_t)k + 1));
+    if (!found || !frontier) {
+        free(found);
+        free(frontier);
+        return 0;
+    }
+
+    InterlockedIncrement64(&table->reads);
+    int total = 0;
+    for (int i = 0; i < INDEX_SHARD_COUNT; i++) {
+        TopRead read = { k, found + total, 0, frontier };
+        shard_read(&table->shards[i], read_top_groups, &read);
+        total += read.count;
+    }
+
+    // Each shard run is sorted; at most 16 * k rows, so a plain sort merges them
+    qsort(found, total, sizeof(WastedGroup), compare_wasted);
+    if (total > k) total = k;
+    memcpy(groups, found, sizeof(WastedGroup) * total);
+    free(found);
+    free(frontier);
+    return total;
+}
+
+typedef struct ColumnRead {
+    int shard;
+    ColumnScan scan;
+    void *ctx;
+} ColumnRead;
+
+static void read_columns(IndexShard *shard, void *ctx) {
+    ColumnRead *read = (ColumnRead*)ctx;
+    ChunkTable *entries = shard->entry_columns;
+    ChunkTable *groups = shard->group_columns;
+    ChunkTable *digests = shard->group_chunks;
+
+    // A racing writer may have bumped a used mark past the blocks this run
+    // sees; the seq check discards the run, but it must not read past them
+    ShardColumns columns = { read->shard, NULL, 0, NULL, NULL, 0 };
+    if (entries) {
+        uint32_t visible = entries->count * SLOT_CHUNK_SIZE;
+        columns.entries = (EntryColumns *const *)entries->chunks;
+        columns.entry_used = shard->entry_used < visible ? shard->entry_used : visible;
+    }
+    if (groups && digests) {
+        uint32_t blocks = groups->count < digests->count ? groups->count : digests->count;
+        uint32_t visible = blocks * SLOT_CHUNK_SIZE;
+        columns.groups = (GroupColumns *const *)groups->chunks;
+        columns.digests = (DigestGroup *const *)digests->chunks;
+        columns.group_used = shard->group_used < visible ? shard->group_used : visible;
+    }
+    read->scan(&columns, read->ctx);
+}
+
+void hash_table_scan_columns(HashTable *table, ColumnScan scan, void *ctx) {
+    InterlockedIncrement64(&table->reads);
+    for (int i = 0; i < INDEX_SHARD_COUNT; i++) {
+        ColumnRead read = { i, scan, ctx };
+        shard_read(&table->shards[i], read_columns, &read);
+    }
+}
+
+size_t hash_table_count(HashTable *table) {
+    // Unlocked sum; exact only when no writer is running
+    size_t count = 0;
+    for (int i = 0; i < INDEX_SHARD_COUNT; i++) {
+        count += table->shards[i].path_index.count;
+    }
+    return count;
+}
+
 BOOL filepath_in_hash_table(HashTable *table, const char *filepath) {
-    EnterCriticalSection(&table->lock);
-    BOOL found = FALSE;
-    for (size_t i = 0; i < table->size && !found; i++) {
-        FileHash *current = table->buckets[i];
-        while (current) {
-            if (strcmp(current->filepath, filepath) == 0) {
-                found = TRUE;
-                break;
+    PathLookup lookup;
+    lookup.slot = FLAT_INDEX_NONE;
+    if (!resolve_path(table, filepath, FALSE, &lookup.key)) return FALSE;
+    return find_path_shard(table, &lookup) != NULL;
+}
+
+BOOL hash_table_rename_directory(HashTable *table, const char *old_path, const char *new_path) {
+    // Entries are keyed by (directory node, name), so relinking the one
+    // node moves every file below it without touching the shards
+    return path_tree_rename(&table->tree, old_path, new_path);
+}
+
+BOOL hash_table_set_reference(HashTable *table, const char *dir_path, BOOL reference) {
+    return path_tree_set_reference(&table->tree, dir_path, strlen(dir_path), reference);
+}
+
+void hash_table_get_stats(HashTable *table, IndexStats *stats) {
+    memset(stats, 0, sizeof(IndexStats));
+    stats->reads = table->reads;
+    stats->name_compactions = table->name_compactions;
+    for (int i = 0; i < INDEX_PATH_SHARDS; i++) {
+        IndexShard *shard = &table->shards[i];
+        stats->lock_acquisitions += shard->lock_acquisitions;
+        stats->lock_contended += shard->lock_contended;
+        stats->read_retries += shard->read_retries;
+        stats->read_fallbacks += shard->read_fallbacks;
+        stats->filter_rejects += shard->filter_rejects;
+        stats->filter_false_positives += shard->filter_false_positives;
+    }
+    stats->memory_bytes = hash_table_memory(table);
+
+    SpillStore *spill = table->spill;
+    if (spill) {
+        stats->spilled_files = spill->records;
+        stats->spill_runs = spill->run_count;
+        stats->spill_probes = spill->probes;
+        stats->lookup_p50_ns = latency_percentile(&spill->lookups, 0.50);
+        stats->lookup_p99_ns = latency_percentile(&spill->lookups, 0.99);
+        stats->lookup_p999_ns = latency_percentile(&spill->lookups, 0.999);
+        stats->disk_p99_ns = latency_percentile(&spill->disk, 0.99);
+    }
+}
+
+size_t hash_table_memory(HashTable *table) {
+    size_t bytes = resident_memory(table);
+    if (table->spill) {
+        AcquireSRWLockShared(&table->spill->lock);
+        bytes += spill_store_memory(table->spill);
+        ReleaseSRWLockShared(&table->spill->lock);
+    }
+    return bytes;
+}
+
+// Copy every live file name into fresh arena blocks and retire the old ones
+// (shard write in progress).  O(live bytes of the shard), so it runs on
+// the compaction thread rather than in the delete that tipped it over.
+static void compact_names(IndexShard *shard) {
+    PathArena before = shard->names;
+    PathArenaBlock *old = path_arena_detach(&shard->names);
+
+    for (uint32_t slot = 0; slot < shard->entry_used; slot++) {
+        FileEntry *entry = entry_at(shard, slot);
+        if (!entry->name) continue;
+        char *copy = path_arena_store(&shard->names, entry->name);
+        if (!copy) {
+            // Out of memory part way: keep the old blocks behind the new
+            // ones and count the copies made so far as dead
+            PathArenaBlock **tail = &shard->names.blocks;
+            while (*tail) tail = &(*tail)->next;
+            *tail = old;
+            shard->names.block_count += before.block_count;
+            shard->names.dead_bytes = before.dead_bytes + shard->names.live_bytes;
+            shard->names.live_bytes = before.live_bytes;
+            return;
+        }
+        entry->name = copy;
+    }
+
+    // Readers may still be comparing against the old bytes
+    while (old) {
+        PathArenaBlock *next = old->next;
+        retire(shard, old);
+        old = next;
+    }
+}
+
+// Files spilled per run at most
+#define SPILL_BATCH 32768
+
+// A file picked to spill, to be released once its run is on disk if it is
+// still the same entry
+typedef struct SpillVictim {
+    IndexShard *shard;
+    uint32_t slot;
+    uint32_t group;
+    uint64_t path_hash;
+} SpillVictim;
+
+typedef struct SpillBatch {
+    SpillEntry *entries;
+    SpillVictim *victims;        // Same files; entries get sorted by the run
+    size_t count;
+    PathArena names;             // Copies of the spilled names
+} SpillBatch;
+
+// Pick up to quota files of one shard whose digest nothing else shares,
+// sweeping the group slots like a clock from where the last pass stopped
+static void pick_victims(HashTable *table, IndexShard *shard, SpillBatch *batch, size_t quota) {
+    shard_lock(shard);
+    uint32_t used = shard->group_used;
+    for (uint32_t seen = 0; seen < used && quota > 0 && batch->count < SPILL_BATCH; seen++) {
+        uint32_t slot = shard->spill_cursor < used ? shard->spill_cursor : 0;
+        shard->spill_cursor = slot + 1;
+        const DigestGroup *group = group_at(shard, slot);
+        if (group->count != 1) continue;
+        const FileEntry *entry = entry_at(shard, group->members);
+        const char *name = path_arena_store(&batch->names, entry->name);
+        if (!name) break;
+
+        SpillEntry *out = &batch->entries[batch->count];
+        FileMeta meta = entry_meta(shard, group->members);
+        memset(out, 0, sizeof(SpillEntry));
+        out->key = hash_digest(group->digest);
+        memcpy(out->digest, group->digest, INDEX_DIGEST_BYTES);
+        out->dir = entry->dir;
+        out->filesize = meta.filesize;
+        out->mtime = meta.mtime;
+        out->file_index = meta.file_index;
+        out->name = name;
+        out->name_len = (uint32_t)strlen(name);
+
+        SpillVictim *victim = &batch->victims[batch->count++];
+        victim->shard = shard;
+        victim->slot = group->members;
+        victim->group = slot;
+        victim->path_hash = entry->path_hash;
+        quota--;
+    }
+    shard_unlock(shard);
+}
+
+// Take the spilled files out of memory (spill lock held exclusively).  A
+// remove may have got to one first; its record is then just stale.
+static void release_victims(HashTable *table, SpillBatch *batch) {
+    size_t i = 0;
+    while (i < batch->count) {
+        IndexShard *shard = batch->victims[i].shard;
+        write_begin(shard);
+        for (; i < batch->count && batch->victims[i].shard == shard; i++) {
+            const SpillVictim *victim = &batch->victims[i];
+            const FileEntry *entry = entry_at(shard, victim->slot);
+            if (entry->name && entry->group == victim->group &&
+                entry->path_hash == victim->path_hash &&
+                group_at(shard, victim->group)->count == 1) {
+                release_entry(table, shard, victim->slot);
             }
-            current = current->next;
         }
+        write_end(shard);
     }
-    LeaveCriticalSection(&table->lock);
-    return found;
 }
 
-void free_hash_table(HashTable *table) {
-    for (size_t i = 0; i < table->size; i++) {
-        FileHash *current = table->buckets[i];
-        while (current) {
-            FileHash *next = current->next;
-            free(current->filepath);
-            free(current);
-            current = next;
+// Merge filter: a record outlives neither a dropped root nor its return
+// to memory
+static BOOL keep_spilled(const SpillEntry *entry, void *ctx) {
+    HashTable *table = (HashTable*)ctx;
+    return !spill_dropped(table, entry) && !spill_resident(table, entry);
+}
+
+// Spill until the index is back under nine tenths of its budget, a run at
+// a time (compaction thread).  Adds and lookups wait while a run is
+// written, not while files are picked.
+static void enforce_budget(HashTable *table) {
+    SpillStore *spill = table->spill;
+    if (!spill || hash_table_memory(table) <= table->memory_budget) return;
+
+    SpillBatch batch;
+    batch.entries = malloc(sizeof(SpillEntry) * SPILL_BATCH);
+    batch.victims = malloc(sizeof(SpillVictim) * SPILL_BATCH);
+    path_arena_init(&batch.names);
+    size_t target = table->memory_budget / 10 * 9;
+    uint64_t spilled = 0;
+
+    while (batch.entries && batch.victims && !table->stopping) {
+        size_t memory = hash_table_memory(table);
+        if (memory <= target) break;
+        // Names come on top, so this picks a little less than needed
+        size_t want = (memory - target) / (ENTRY_BYTES + GROUP_BYTES) + 1;
+        size_t quota = want / INDEX_SHARD_COUNT + 1;
+        if (quota > SPILL_BATCH / INDEX_SHARD_COUNT) quota = SPILL_BATCH / INDEX_SHARD_COUNT;
+
+        AcquireSRWLockExclusive(&spill->lock);
+        batch.count = 0;
+        for (int i = 0; i < INDEX_SHARD_COUNT; i++) {
+            pick_victims(table, &table->shards[i], &batch, quota);
         }
+        BOOL written = batch.count > 0 &&
+                       (spill->run_count < SPILL_MAX_RUNS || spill_store_merge(spill, keep_spilled, table)) &&
+                       spill_store_write_run(spill, batch.entries, batch.count);
+        if (written) release_victims(table, &batch);
+        ReleaseSRWLockExclusive(&spill->lock);
+
+        path_arena_free(&batch.names);
+        path_arena_init(&batch.names);
+        if (!written) break;
+        spilled += batch.count;
+    }
+
+    free(batch.entries);
+    free(batch.victims);
+    path_arena_free(&batch.names);
+    if (spilled > 0) {
+        safe_printf("[INDEX] Spilled %llu files to disk under the %.1f MB budget (%d runs)\n",
+                    (unsigned long long)spilled, table->memory_budget / (1024.0 * 1024.0),
+                    spill->run_count);
+    }
+}
+
+static DWORD WINAPI compact_thread_func(LPVOID param) {
+    HashTable *table = (HashTable*)param;
+
+    while (WaitForSingleObject(table->compact_event, INFINITE) == WAIT_OBJECT_0 &&
+           !table->stopping) {
+        // First, so the names of spilled files are compacted below
+        enforce_budget(table);
+        for (int i = 0; i < INDEX_PATH_SHARDS && !table->stopping; i++) {
+            IndexShard *shard = &table->shards[i];
+            size_t reserved = i == EMPTY_SHARD ? 0 : table->filter_reserve;
+            if (content_filter_wants_growth(&shard->digest_filter) ||
+                reserved > content_filter_capacity(&shard->digest_filter)) {
+                shard_lock(shard);
+                size_t expected = content_filter_wants_growth(&shard->digest_filter)
+                                      ? shard->digest_filter.keys * 2 : 0;
+                if (reserved > content_filter_capacity(&shard->digest_filter) &&
+                    reserved > expected) {
+                    expected = reserved;
+                }
+                shard_unlock(shard);
+                if (expected > 0) rebuild_filter(shard, expected);
+            }
+            if (!path_arena_wants_compaction(&shard->names)) continue;
+
+            write_begin(shard);
+            PathArena before = shard->names;
+            BOOL compacted = path_arena_wants_compaction(&shard->names);
+            if (compacted) {
+                compact_names(shard);
+            }
+            size_t after = shard->names.block_count;
+            write_end(shard);
+
+            if (compacted) {
+                InterlockedIncrement64(&table->name_compactions);
+                safe_printf("[INDEX] Compacted names of shard %d: %llu dead bytes, %llu -> %llu blocks\n",
+                            i, (unsigned long long)before.dead_bytes,
+                            (unsigned long long)before.block_count, (unsigned long long)after);
+            }
+        }
+    }
+    return 0;
+}
+
+static void free_chunks(ChunkTable *chunks) {
+    if (!chunks) return;
+    for (uint32_t c = 0; c < chunks->count; c++) {
+        free(chunks->chunks[c]);
     }
-    DeleteCriticalSection(&table->lock);
-    free(table->buckets);
+    free(chunks);
+}
+
+HashTable* hash_table_acquire(void) {
+    AcquireSRWLockShared(&g_live_lock);
+    return g_hash_table;
+}
+
+void hash_table_release(void) {
+    ReleaseSRWLockShared(&g_live_lock);
+}
+
+HashTable* hash_table_swap(HashTable *next) {
+    AcquireSRWLockExclusive(&g_live_lock);
+    HashTable *old = g_hash_table;
+    g_hash_table = next;
+    ReleaseSRWLockExclusive(&g_live_lock);
+    return old;
+}
+
+void free_hash_table(HashTable *table) {
+    if (!table) return;
+    if (table->compact_thread) {
+        table->stopping = TRUE;
+        SetEvent(table->compact_event);
+        WaitForSingleObject(table->compact_thread, INFINITE);
+        CloseHandle(table->compact_thread);
+    }
+    if (table->compact_event) CloseHandle(table->compact_event);
+
+    // Whole blocks and chunks only: O(slabs), not O(entries)
+    for (int i = 0; i < INDEX_PATH_SHARDS; i++) {
+        IndexShard *shard = &table->shards[i];
+        path_arena_free(&shard->names);
+        free_retired(shard);
+        flat_index_free(&shard->digest_index);
+        flat_index_free(&shard->path_index);
+        content_filter_free(&shard->digest_filter);
+        free_chunks(shard->entry_chunks);
+        free_chunks(shard->entry_columns);
+        free_chunks(shard->group_chunks);
+        free_chunks(shard->group_columns);
+        free(shard->dup_heap);
+        DeleteCriticalSection(&shard->lock);
+    }
+    path_tree_free(&table->tree);
+    spill_store_free(table->spill);
     free(table);
-}
\ No newline at end of file
+}
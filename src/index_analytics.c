@@ -0,0 +1,251 @@
+//index_analytics.c
+#include "index_analytics.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPORT_ROWS 5
+
+// Slots of the column block starting at base that lie below used
+static uint32_t block_length(uint32_t used, uint32_t base) {
+    return used - base < SLOT_CHUNK_SIZE ? used - base : SLOT_CHUNK_SIZE;
+}
+
+// Members of group slot g, or 0 if the scan cannot see that slot
+static uint32_t group_count(const ShardColumns *columns, uint32_t g) {
+    if (g >= columns->group_used) return 0;
+    return columns->groups[g >> SLOT_CHUNK_BITS]->counts[g & (SLOT_CHUNK_SIZE - 1)];
+}
+
+// ── Totals ──────────────────────────────────────────────────────────────
+
+static void scan_totals(const ShardColumns *columns, void *ctx) {
+    uint64_t files = 0, bytes = 0;
+    uint64_t dup_groups = 0, dup_files = 0, reclaimable = 0;
+
+    // Group columns alone cover every file: a group of n members stands for
+    // n files of its size.  Masks instead of ifs, so the loop vectorizes.
+    for (uint32_t base = 0; base < columns->group_used; base += SLOT_CHUNK_SIZE) {
+        const GroupColumns *block = columns->groups[base >> SLOT_CHUNK_BITS];
+        uint32_t n = block_length(columns->group_used, base);
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t count = block->counts[i];
+            uint64_t size = block->sizes[i];
+            uint64_t mask = 0 - (uint64_t)(count > 1);
+            files += count;
+            bytes += count * size;
+            dup_groups += mask & 1;
+            dup_files += count & mask;
+            reclaimable += ((count - 1) * size) & mask;
+        }
+    }
+
+    // A rerun replaces the shard's figures
+    IndexTotals *totals = &((IndexTotals*)ctx)[columns->shard];
+    totals->files = files;
+    totals->bytes = bytes;
+    totals->duplicate_groups = dup_groups;
+    totals->duplicate_files = dup_files;
+    totals->reclaimable_bytes = reclaimable;
+}
+
+void index_totals(HashTable *table, IndexTotals *totals) {
+    IndexTotals shards[INDEX_SHARD_COUNT];
+    memset(shards, 0, sizeof(shards));
+    hash_table_scan_columns(table, scan_totals, shards);
+
+    memset(totals, 0, sizeof(IndexTotals));
+    for (int i = 0; i < INDEX_SHARD_COUNT; i++) {
+        totals->files += shards[i].files;
+        totals->bytes += shards[i].bytes;
+        totals->duplicate_groups += shards[i].duplicate_groups;
+        totals->duplicate_files += shards[i].duplicate_files;
+        totals->reclaimable_bytes += shards[i].reclaimable_bytes;
+    }
+}
+
+// ── Rollups by directory / extension ───────────────────────────────────
+
+typedef struct RollupRow {
+    uint64_t key;                // Directory node or extension key
+    uint64_t size;
+} RollupRow;
+
+typedef struct RollupScan {
+    BOOL by_extension;
+    RollupRow *rows[INDEX_SHARD_COUNT];
+    uint32_t counts[INDEX_SHARD_COUNT];
+    uint32_t capacities[INDEX_SHARD_COUNT];
+    BOOL failed;
+} RollupScan;
+
+static void scan_rollup(const ShardColumns *columns, void *ctx) {
+    RollupScan *scan = (RollupScan*)ctx;
+    int s = columns->shard;
+    scan->counts[s] = 0;
+
+    for (uint32_t base = 0; base < columns->entry_used; base += SLOT_CHUNK_SIZE) {
+        const EntryColumns *block = columns->entries[base >> SLOT_CHUNK_BITS];
+        uint32_t n = block_length(columns->entry_used, base);
+        for (uint32_t i = 0; i < n; i++) {
+            // Free slots hold FLAT_INDEX_NONE, which group_count rejects
+            if (group_count(columns, block->groups[i]) < 2) continue;
+
+            if (scan->counts[s] == scan->capacities[s]) {
+                uint32_t capacity = scan->capacities[s] ? scan->capacities[s] * 2 : 1024;
+                RollupRow *grown = realloc(scan->rows[s], sizeof(RollupRow) * capacity);
+                if (!grown) {
+                    scan->failed = TRUE;
+                    return;
+                }
+                scan->rows[s] = grown;
+                scan->capacities[s] = capacity;
+            }
+            RollupRow *row = &scan->rows[s][scan->counts[s]++];
+            row->key = scan->by_extension ? block->exts[i] : block->dirs[i];
+            row->size = block->sizes[i];
+        }
+    }
+}
+
+static int compare_row_keys(const void *a, const void *b) {
+    uint64_t ka = ((const RollupRow*)a)->key;
+    uint64_t kb = ((const RollupRow*)b)->key;
+    return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+static int compare_rollup_bytes(const void *a, const void *b) {
+    uint64_t ba = ((const DuplicateRollup*)a)->bytes;
+    uint64_t bb = ((const DuplicateRollup*)b)->bytes;
+    return ba < bb ? 1 : ba > bb ? -1 : 0;
+}
+
+static void label_extension(uint64_t key, char *label) {
+    if (key == 0) {
+        strcpy(label, "(none)");
+        return;
+    }
+    int len = 0;
+    label[len++] = '.';
+    for (int i = 0; i < 8 && (key >> (8 * i)) & 0xFF; i++) {
+        label[len++] = (char)((key >> (8 * i)) & 0xFF);
+    }
+    label[len] = '\0';
+}
+
+static int rollup(HashTable *table, BOOL by_extension, DuplicateRollup **rollups) {
+    RollupScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.by_extension = by_extension;
+    *rollups = NULL;
+
+    hash_table_scan_columns(table, scan_rollup, &scan);
+
+    size_t total = 0;
+    for (int s = 0; s < INDEX_SHARD_COUNT; s++) total += scan.counts[s];
+    RollupRow *rows = scan.failed ? NULL : malloc(sizeof(RollupRow) * (total ? total : 1));
+    int result = -1;
+
+    if (rows) {
+        size_t used = 0;
+        for (int s = 0; s < INDEX_SHARD_COUNT; s++) {
+            if (scan.counts[s] == 0) continue;
+            memcpy(rows + used, scan.rows[s], sizeof(RollupRow) * scan.counts[s]);
+            used += scan.counts[s];
+        }
+        qsort(rows, total, sizeof(RollupRow), compare_row_keys);
+
+        size_t distinct = 0;
+        for (size_t i = 0; i < total; i++) {
+            if (i == 0 || rows[i].key != rows[i - 1].key) distinct++;
+        }
+        *rollups = calloc(distinct ? distinct : 1, sizeof(DuplicateRollup));
+    }
+
+    if (*rollups) {
+        int count = -1;
+        for (size_t i = 0; i < total; i++) {
+            if (i == 0 || rows[i].key != rows[i - 1].key) {
+                DuplicateRollup *r = &(*rollups)[++count];
+                if (by_extension) {
+                    label_extension(rows[i].key, r->label);
+                } else if (rows[i].key == PATH_TREE_NONE ||
+                           !path_tree_format(&table->tree, (uint32_t)rows[i].key,
+                                             r->label, sizeof(r->label))) {
+                    strcpy(r->label, "(no directory)");
+                }
+            }
+            (*rollups)[count].files++;
+            (*rollups)[count].bytes += rows[i].size;
+        }
+        result = count + 1;
+        qsort(*rollups, result, sizeof(DuplicateRollup), compare_rollup_bytes);
+    }
+
+    free(rows);
+    for (int s = 0; s < INDEX_SHARD_COUNT; s++) free(scan.rows[s]);
+    return result;
+}
+
+int index_duplicates_by_directory(HashTable *table, DuplicateRollup **rollups) {
+    return rollup(table, FALSE, rollups);
+}
+
+int index_duplicates_by_extension(HashTable *table, DuplicateRollup **rollups) {
+    return rollup(table, TRUE, rollups);
+}
+
+// ── Console report ──────────────────────────────────────────────────────
+
+static double elapsed_ms(LARGE_INTEGER start) {
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (double)(now.QuadPart - start.QuadPart) * 1000.0 / (double)freq.QuadPart;
+}
+
+static void print_rollup(const char *title, DuplicateRollup *rows, int count) {
+    if (count <= 0) return;
+    safe_printf("%s:\n", title);
+    for (int i = 0; i < count && i < REPORT_ROWS; i++) {
+        safe_printf(" - %s: %llu files, %.1f MB\n", rows[i].label,
+                    (unsigned long long)rows[i].files, rows[i].bytes / (1024.0 * 1024.0));
+    }
+}
+
+void print_index_analytics(HashTable *table) {
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+
+    IndexTotals totals;
+    index_totals(table, &totals);
+    if (totals.duplicate_groups == 0) return;
+
+    WastedGroup top[REPORT_ROWS];
+    int top_count = hash_table_top_groups(table, top, REPORT_ROWS);
+    DuplicateRollup *by_dir = NULL, *by_ext = NULL;
+    int dir_count = index_duplicates_by_directory(table, &by_dir);
+    int ext_count = index_duplicates_by_extension(table, &by_ext);
+    double ms = elapsed_ms(start);
+
+    safe_printf("\n=== SPACE REPORT ===\n\n");
+    safe_printf("Indexed %llu files, %.1f MB; %.1f MB reclaimable in %llu groups\n",
+                (unsigned long long)totals.files, totals.bytes / (1024.0 * 1024.0),
+                totals.reclaimable_bytes / (1024.0 * 1024.0),
+                (unsigned long long)totals.duplicate_groups);
+    if (top_count > 0) {
+        safe_printf("Largest groups:\n");
+        for (int i = 0; i < top_count; i++) {
+            safe_printf(" - %.16s... %u x %llu bytes (%.1f MB wasted)\n", top[i].hash,
+                        top[i].count, (unsigned long long)top[i].filesize,
+                        top[i].wasted_bytes / (1024.0 * 1024.0));
+        }
+    }
+    print_rollup("Duplicates by directory", by_dir, dir_count);
+    print_rollup("Duplicates by extension", by_ext, ext_count);
+    safe_printf("(queried in %.1f ms)\n", ms);
+
+    free(by_dir);
+    free(by_ext);
+}
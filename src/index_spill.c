@@ -0,0 +1,516 @@
+//index_spill.c
+#include "index_spill.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPILL_WRITE_BUFFER (256 * 1024)
+#define SPILL_READ_BUFFER (256 * 1024)
+
+// A record as stored: this header, then name_len name bytes
+typedef struct DiskRecord {
+    uint64_t key;
+    uint64_t filesize;
+    uint64_t mtime;
+    uint64_t file_index;
+    uint32_t dir;
+    uint32_t name_len;
+    uint8_t digest[INDEX_DIGEST_BYTES];
+} DiskRecord;
+
+static volatile LONG g_store_tags = 0;
+
+// ── Latency histogram ───────────────────────────────────────────────────
+
+static int latency_bucket(uint64_t ns) {
+    if (ns < 4) return (int)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int bucket = msb * 4 + (int)((ns >> (msb - 2)) & 3) - 4;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+static uint64_t bucket_upper(int bucket) {
+    if (bucket < 4) return (uint64_t)bucket;
+    int msb = (bucket + 4) / 4;
+    uint64_t lower = (uint64_t)(4 + (bucket + 4) % 4) << (msb - 2);
+    return lower + ((uint64_t)1 << (msb - 2)) - 1;
+}
+
+void latency_record(LatencyHistogram *histogram, uint64_t ns) {
+    InterlockedIncrement64(&histogram->buckets[latency_bucket(ns)]);
+    InterlockedIncrement64(&histogram->count);
+}
+
+void latency_record_since(LatencyHistogram *histogram, LARGE_INTEGER start) {
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    uint64_t ticks = (uint64_t)(now.QuadPart - start.QuadPart);
+    latency_record(histogram, (uint64_t)((double)ticks * 1e9 / (double)freq.QuadPart));
+}
+
+uint64_t latency_percentile(const LatencyHistogram *histogram, double q) {
+    LONGLONG total = histogram->count;
+    if (total <= 0) return 0;
+    LONGLONG target = (LONGLONG)(q * (double)total + 0.999999);
+    if (target < 1) target = 1;
+    LONGLONG seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= target) return bucket_upper(i);
+    }
+    return bucket_upper(LATENCY_BUCKETS - 1);
+}
+
+// ── Runs ────────────────────────────────────────────────────────────────
+
+static BOOL read_at(HANDLE file, uint64_t offset, void *buffer, DWORD len) {
+    OVERLAPPED at;
+    memset(&at, 0, sizeof(at));
+    at.Offset = (DWORD)offset;
+    at.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD got = 0;
+    return ReadFile(file, buffer, len, &got, &at) && got == len;
+}
+
+static void run_close(SpillRun *run) {
+    if (!run) return;
+    // FILE_FLAG_DELETE_ON_CLOSE: the file goes with the handle
+    if (run->file != INVALID_HANDLE_VALUE) CloseHandle(run->file);
+    free(run->fences);
+    content_filter_free(&run->filter);
+    free(run);
+}
+
+typedef struct RunWriter {
+    SpillRun *run;
+    char *buffer;
+    size_t used;
+    size_t fence_capacity;
+    BOOL failed;
+} RunWriter;
+
+// Empty run file for about expected records.  It lives next to the digest
+// store and is never reopened, so a crash leaves nothing behind.
+static BOOL writer_begin(SpillStore *store, RunWriter *writer, size_t expected) {
+    memset(writer, 0, sizeof(RunWriter));
+    SpillRun *run = calloc(1, sizeof(SpillRun));
+    writer->buffer = malloc(SPILL_WRITE_BUFFER);
+    if (!run || !writer->buffer || !content_filter_init(&run->filter, expected)) {
+        free(run);
+        free(writer->buffer);
+        return FALSE;
+    }
+    run->id = store->next_run++;
+
+    char name[64];
+    char path[MAX_PATH];
+    snprintf(name, sizeof(name), "ddas_spill_%lu_%u_%u.tmp",
+             (unsigned long)GetCurrentProcessId(), store->tag, run->id);
+    get_state_file_path(name, path, sizeof(path));
+    run->file = CreateFile(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (run->file == INVALID_HANDLE_VALUE) {
+        run_close(run);
+        free(writer->buffer);
+        return FALSE;
+    }
+    writer->run = run;
+    return TRUE;
+}
+
+static void writer_flush(RunWriter *writer) {
+    if (writer->used == 0 || writer->failed) return;
+    DWORD written = 0;
+    if (!WriteFile(writer->run->file, writer->buffer, (DWORD)writer->used, &written, NULL) ||
+        written != writer->used) {
+        writer->failed = TRUE;
+    }
+    writer->used = 0;
+}
+
+// Entries must come in key order
+static void writer_add(RunWriter *writer, const SpillEntry *entry) {
+    SpillRun *run = writer->run;
+    size_t len = sizeof(DiskRecord) + entry->name_len;
+    if (writer->used + len > SPILL_WRITE_BUFFER) writer_flush(writer);
+    if (writer->failed) return;
+
+    if (run->records % SPILL_FENCE_RECORDS == 0) {
+        if (run->fence_count == writer->fence_capacity) {
+            size_t capacity = writer->fence_capacity ? writer->fence_capacity * 2 : 64;
+            SpillFence *grown = realloc(run->fences, sizeof(SpillFence) * capacity);
+            if (!grown) {
+                writer->failed = TRUE;
+                return;
+            }
+            run->fences = grown;
+            writer->fence_capacity = capacity;
+        }
+        run->fences[run->fence_count].key = entry->key;
+        run->fences[run->fence_count].offset = run->bytes;
+        run->fence_count++;
+    }
+
+    DiskRecord record;
+    memset(&record, 0, sizeof(record));
+    record.key = entry->key;
+    record.filesize = entry->filesize;
+    record.mtime = entry->mtime;
+    record.file_index = entry->file_index;
+    record.dir = entry->dir;
+    record.name_len = entry->name_len;
+    memcpy(record.digest, entry->digest, INDEX_DIGEST_BYTES);
+    memcpy(writer->buffer + writer->used, &record, sizeof(record));
+    memcpy(writer->buffer + writer->used + sizeof(record), entry->name, entry->name_len);
+    writer->used += len;
+
+    content_filter_add(&run->filter, entry->key);
+    run->records++;
+    run->bytes += len;
+}
+
+// The finished run, or NULL (and the file deleted) if any write failed
+static SpillRun* writer_finish(RunWriter *writer) {
+    writer_flush(writer);
+    free(writer->buffer);
+    if (writer->failed) {
+        run_close(writer->run);
+        return NULL;
+    }
+    return writer->run;
+}
+
+// Sequential reader over one run (merges and full visits)
+typedef struct RunCursor {
+    SpillRun *run;
+    char *buffer;
+    size_t len;
+    size_t pos;
+    uint64_t offset;             // File offset just past the buffered bytes
+    uint64_t ordinal;            // Of the next record
+    SpillEntry entry;
+    char name[MAX_PATH];
+    BOOL failed;
+} RunCursor;
+
+static BOOL cursor_open(RunCursor *cursor, SpillRun *run) {
+    memset(cursor, 0, sizeof(RunCursor));
+    cursor->run = run;
+    cursor->buffer = malloc(SPILL_READ_BUFFER);
+    return cursor->buffer != NULL;
+}
+
+static void cursor_close(RunCursor *cursor) {
+    free(cursor->buffer);
+    cursor->buffer = NULL;
+}
+
+// Parse one record from buffer[0..len); returns its length, or 0 when the
+// bytes hold no complete record
+static size_t parse_record(const char *buffer, size_t len, SpillEntry *entry, char *name) {
+    DiskRecord record;
+    if (len < sizeof(record)) return 0;
+    memcpy(&record, buffer, sizeof(record));
+    if (record.name_len >= MAX_PATH || len < sizeof(record) + record.name_len) return 0;
+
+    entry->key = record.key;
+    memcpy(entry->digest, record.digest, INDEX_DIGEST_BYTES);
+    entry->dir = record.dir;
+    entry->filesize = record.filesize;
+    entry->mtime = record.mtime;
+    entry->file_index = record.file_index;
+    entry->name_len = record.name_len;
+    memcpy(name, buffer + sizeof(record), record.name_len);
+    name[record.name_len] = '\0';
+    entry->name = name;
+    return sizeof(record) + record.name_len;
+}
+
+// Advance to the next record; FALSE at the end (or after a read error)
+static BOOL cursor_next(RunCursor *cursor) {
+    if (cursor->ordinal >= cursor->run->records) return FALSE;
+    size_t used = parse_record(cursor->buffer + cursor->pos, cursor->len - cursor->pos,
+                               &cursor->entry, cursor->name);
+    if (used == 0) {
+        // Keep the partial record and read on behind it
+        size_t left = cursor->len - cursor->pos;
+        memmove(cursor->buffer, cursor->buffer + cursor->pos, left);
+        uint64_t remaining = cursor->run->bytes - cursor->offset;
+        size_t want = SPILL_READ_BUFFER - left;
+        if (want > remaining) want = (size_t)remaining;
+        if (want == 0 || !read_at(cursor->run->file, cursor->offset,
+                                  cursor->buffer + left, (DWORD)want)) {
+            cursor->failed = TRUE;
+            return FALSE;
+        }
+        cursor->offset += want;
+        cursor->len = left + want;
+        cursor->pos = 0;
+        used = parse_record(cursor->buffer, cursor->len, &cursor->entry, cursor->name);
+        if (used == 0) {
+            cursor->failed = TRUE;
+            return FALSE;
+        }
+    }
+    cursor->pos += used;
+    cursor->entry.run = cursor->run->id;
+    cursor->entry.ordinal = cursor->ordinal++;
+    return TRUE;
+}
+
+// ── Store ───────────────────────────────────────────────────────────────
+
+SpillStore* spill_store_create(void) {
+    SpillStore *store = calloc(1, sizeof(SpillStore));
+    if (!store) return NULL;
+    InitializeSRWLock(&store->lock);
+    InitializeCriticalSection(&store->dead_lock);
+    store->tag = (uint32_t)InterlockedIncrement(&g_store_tags);
+    return store;
+}
+
+void spill_store_free(SpillStore *store) {
+    if (!store) return;
+    for (int i = 0; i < store->run_count; i++) run_close(store->runs[i]);
+    DeleteCriticalSection(&store->dead_lock);
+    free(store->dead);
+    free(store->drops);
+    free(store);
+}
+
+static int compare_entry_keys(const void *a, const void *b) {
+    uint64_t ka = ((const SpillEntry*)a)->key;
+    uint64_t kb = ((const SpillEntry*)b)->key;
+    return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+BOOL spill_store_write_run(SpillStore *store, SpillEntry *entries, size_t count) {
+    if (count == 0) return TRUE;
+    if (store->run_count == SPILL_MAX_RUNS) return FALSE;
+    qsort(entries, count, sizeof(SpillEntry), compare_entry_keys);
+
+    RunWriter writer;
+    if (!writer_begin(store, &writer, count)) return FALSE;
+    for (size_t i = 0; i < count; i++) writer_add(&writer, &entries[i]);
+    SpillRun *run = writer_finish(&writer);
+    if (!run) return FALSE;
+
+    store->runs[store->run_count++] = run;
+    InterlockedExchangeAdd64(&store->records, (LONGLONG)count);
+    return TRUE;
+}
+
+BOOL spill_store_may_contain(SpillStore *store, uint64_t key) {
+    for (int i = 0; i < store->run_count; i++) {
+        if (content_filter_may_contain(&store->runs[i]->filter, key)) return TRUE;
+    }
+    return FALSE;
+}
+
+// Records of run with this key: the stretch from the last fence below key
+// to the first fence above it
+static int find_in_run(SpillRun *run, uint64_t key, const uint8_t *digest,
+                       SpillEntry *out, char (*names)[MAX_PATH], int max) {
+    if (run->fence_count == 0 || !content_filter_may_contain(&run->filter, key)) return 0;
+
+    size_t lo = 0, hi = run->fence_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (run->fences[mid].key < key) lo = mid + 1; else hi = mid;
+    }
+    size_t first = lo > 0 ? lo - 1 : 0;
+    size_t end = lo;
+    while (end < run->fence_count && run->fences[end].key <= key) end++;
+
+    uint64_t start = run->fences[first].offset;
+    uint64_t stop = end < run->fence_count ? run->fences[end].offset : run->bytes;
+    size_t len = (size_t)(stop - start);
+    char *buffer = malloc(len ? len : 1);
+    if (!buffer || !read_at(run->file, start, buffer, (DWORD)len)) {
+        free(buffer);
+        return -1;
+    }
+
+    int found = 0;
+    size_t pos = 0;
+    uint64_t ordinal = (uint64_t)first * SPILL_FENCE_RECORDS;
+    SpillEntry entry;
+    char name[MAX_PATH];
+    while (pos < len && found < max) {
+        size_t used = parse_record(buffer + pos, len - pos, &entry, name);
+        if (used == 0) break;
+        pos += used;
+        if (entry.key > key) break;
+        if (entry.key == key && memcmp(entry.digest, digest, INDEX_DIGEST_BYTES) == 0) {
+            entry.run = run->id;
+            entry.ordinal = ordinal;
+            memcpy(names[found], name, entry.name_len + 1);
+            out[found] = entry;
+            out[found].name = names[found];
+            found++;
+        }
+        ordinal++;
+    }
+    free(buffer);
+    return found;
+}
+
+int spill_store_find(SpillStore *store, uint64_t key, const uint8_t *digest,
+                     SpillEntry *out, char (*names)[MAX_PATH], int max) {
+    int found = 0;
+    for (int i = store->run_count - 1; i >= 0 && found < max; i--) {
+        int n = find_in_run(store->runs[i], key, digest, out + found, names + found, max - found);
+        if (n < 0) return -1;
+        found += n;
+    }
+    return found;
+}
+
+void spill_store_mark_dead(SpillStore *store, const SpillEntry *entry) {
+    EnterCriticalSection(&store->dead_lock);
+    if (store->dead_count == store->dead_capacity) {
+        size_t capacity = store->dead_capacity ? store->dead_capacity * 2 : 256;
+        SpillDead *grown = realloc(store->dead, sizeof(SpillDead) * capacity);
+        if (!grown) {
+            // Only costs a wasted lookup later: the record stays stale
+            LeaveCriticalSection(&store->dead_lock);
+            return;
+        }
+        store->dead = grown;
+        store->dead_capacity = capacity;
+    }
+    store->dead[store->dead_count].run = entry->run;
+    store->dead[store->dead_count].ordinal = entry->ordinal;
+    store->dead_count++;
+    LeaveCriticalSection(&store->dead_lock);
+}
+
+void spill_store_drop(SpillStore *store, uint32_t dir) {
+    if (store->run_count == 0) return;
+    if (store->drop_count == store->drop_capacity) {
+        size_t capacity = store->drop_capacity ? store->drop_capacity * 2 : 16;
+        SpillDrop *grown = realloc(store->drops, sizeof(SpillDrop) * capacity);
+        if (!grown) return;
+        store->drops = grown;
+        store->drop_capacity = capacity;
+    }
+    store->drops[store->drop_count].dir = dir;
+    store->drops[store->drop_count].before_run = store->next_run;
+    store->drop_count++;
+}
+
+static int compare_dead(const void *a, const void *b) {
+    const SpillDead *da = (const SpillDead*)a, *db = (const SpillDead*)b;
+    if (da->run != db->run) return da->run < db->run ? -1 : 1;
+    return da->ordinal < db->ordinal ? -1 : da->ordinal > db->ordinal ? 1 : 0;
+}
+
+static BOOL is_dead(SpillStore *store, const SpillEntry *entry) {
+    SpillDead probe = { entry->run, entry->ordinal };
+    return store->dead_count &&
+           bsearch(&probe, store->dead, store->dead_count, sizeof(SpillDead), compare_dead);
+}
+
+// Same file as the last record written for this key?
+static BOOL same_file(const SpillEntry *a, const SpillEntry *b) {
+    return a->key == b->key && a->dir == b->dir && a->name_len == b->name_len &&
+           memcmp(a->name, b->name, a->name_len) == 0 &&
+           memcmp(a->digest, b->digest, INDEX_DIGEST_BYTES) == 0;
+}
+
+BOOL spill_store_merge(SpillStore *store, SpillKeep keep, void *ctx) {
+    if (store->run_count == 0) return TRUE;
+    if (store->dead_count > 0) qsort(store->dead, store->dead_count, sizeof(SpillDead), compare_dead);
+
+    RunCursor cursors[SPILL_MAX_RUNS];
+    BOOL live[SPILL_MAX_RUNS];
+    int opened = 0;
+    uint64_t total = 0;
+    BOOL ok = TRUE;
+    for (int i = 0; i < store->run_count; i++) {
+        if (!cursor_open(&cursors[i], store->runs[i])) {
+            ok = FALSE;
+            break;
+        }
+        opened++;
+        live[i] = cursor_next(&cursors[i]);
+        total += store->runs[i]->records;
+    }
+
+    RunWriter writer;
+    if (!ok || !writer_begin(store, &writer, (size_t)total)) {
+        for (int i = 0; i < opened; i++) cursor_close(&cursors[i]);
+        return FALSE;
+    }
+
+    // k-way merge on key; on ties the newest run goes first, so an older
+    // record of the same file is the one dropped
+    SpillEntry last;
+    char last_name[MAX_PATH];
+    BOOL have_last = FALSE;
+    for (;;) {
+        int pick = -1;
+        for (int i = opened - 1; i >= 0; i--) {
+            if (live[i] && (pick < 0 || cursors[i].entry.key < cursors[pick].entry.key)) pick = i;
+        }
+        if (pick < 0) break;
+
+        const SpillEntry *entry = &cursors[pick].entry;
+        if (!is_dead(store, entry) && !(have_last && same_file(&last, entry)) &&
+            keep(entry, ctx)) {
+            writer_add(&writer, entry);
+            last = *entry;
+            memcpy(last_name, entry->name, entry->name_len + 1);
+            last.name = last_name;
+            have_last = TRUE;
+        }
+        live[pick] = cursor_next(&cursors[pick]);
+    }
+
+    for (int i = 0; i < opened; i++) {
+        if (cursors[i].failed) writer.failed = TRUE;
+        cursor_close(&cursors[i]);
+    }
+    SpillRun *merged = writer_finish(&writer);
+    if (!merged) return FALSE;
+
+    for (int i = 0; i < store->run_count; i++) run_close(store->runs[i]);
+    store->run_count = 0;
+    store->records = (LONGLONG)merged->records;
+    if (merged->records > 0) {
+        store->runs[store->run_count++] = merged;
+    } else {
+        run_close(merged);
+    }
+    // Applied: nothing left refers to the old runs
+    store->dead_count = 0;
+    store->drop_count = 0;
+    return TRUE;
+}
+
+BOOL spill_store_for_each(SpillStore *store, SpillVisitor visit, void *ctx) {
+    BOOL ok = TRUE;
+    for (int i = 0; i < store->run_count && ok; i++) {
+        RunCursor cursor;
+        if (!cursor_open(&cursor, store->runs[i])) return FALSE;
+        // Dead records are not told apart here (the list is only sorted
+        // for merges); a visitor checks the file anyway
+        while (cursor_next(&cursor)) visit(&cursor.entry, ctx);
+        ok = !cursor.failed;
+        cursor_close(&cursor);
+    }
+    return ok;
+}
+
+size_t spill_store_memory(SpillStore *store) {
+    size_t bytes = sizeof(SpillStore) + store->dead_capacity * sizeof(SpillDead) +
+                   store->drop_capacity * sizeof(SpillDrop);
+    for (int i = 0; i < store->run_count; i++) {
+        const SpillRun *run = store->runs[i];
+        bytes += sizeof(SpillRun) + run->fence_count * sizeof(SpillFence) +
+                 content_filter_capacity(&run->filter) / FILTER_KEYS_PER_BLOCK * FILTER_BLOCK_BYTES;
+    }
+    return bytes;
+}
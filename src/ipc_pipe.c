@@ -1,45 +1,44 @@
 #include "ipc_pipe.h"
+#include "flat_index.h"
+#include "hash_table.h"
 #include "scanner.h"
+#include "roots.h"
 #include "utils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 PipeServer *g_pipe_server = NULL;
 
-// Duplicate group storage (indexed by hash)
+// Duplicate group storage (indexed by hash).  Groups are allocated one at
+// a time and never move; g_group_index maps a hash to its position.
 typedef struct {
     char filehash[65];
-    FileInfo files[MAX_DUPLICATES + 1];  // All files with this hash
+    FileInfo *files;      // All files with this hash (up to MAX_DUPLICATES + 1)
     int file_count;
+    int file_capacity;
     char last_updated[32];
     BOOL sent_to_client;  // Track if this group has been sent
 } DuplicateGroup;
 
-static DuplicateGroup g_duplicate_groups[MAX_HISTORY_ALERTS];
+static DuplicateGroup **g_duplicate_groups = NULL;
 static int g_group_count = 0;
+static int g_group_capacity = 0;
+static FlatIndex g_group_index;
 static CRITICAL_SECTION g_groups_lock;
 static BOOL g_groups_initialized = FALSE;
 
-// Empty-file tracking for IPC resend on reconnect
-typedef struct {
-    char filepath[MAX_PATH];
-    uint64_t filesize;
-    char last_modified[32];
-    char timestamp[32];
-} EmptyFileRecord;
-
-#define MAX_EMPTY_FILE_RECORDS 1000
-static EmptyFileRecord g_empty_records[MAX_EMPTY_FILE_RECORDS];
-static int g_empty_record_count = 0;
-
 // Forward declarations
 static DWORD WINAPI pipe_server_thread(LPVOID param);
 static BOOL send_message(const char *json_message);
 static void handle_client_commands(HANDLE pipe);
+static DuplicateGroup* find_group(const char *filehash);
 static DuplicateGroup* find_or_create_group(const char *filehash);
-static BOOL send_duplicate_group(DuplicateGroup *group);
+static BOOL format_duplicate_group(const DuplicateGroup *group, char *message);
 static void handle_change_directory_command(const char *json);
+static const char* handle_root_command(const char *json);
+static BOOL handle_query_command(const char *json, char *response, size_t size);
 
 // Get current timestamp in ISO 8601 format
 void get_iso8601_timestamp(char *buffer, size_t buffer_size) {
@@ -50,20 +49,48 @@ void get_iso8601_timestamp(char *buffer, size_t buffer_size) {
              st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
 }
 
+// Format FILETIME ticks as ISO 8601 ("unknown" for 0)
+void format_file_time(uint64_t mtime, char *buffer, size_t buffer_size) {
+    FILETIME ft;
+    SYSTEMTIME st;
+    ft.dwLowDateTime = (DWORD)mtime;
+    ft.dwHighDateTime = (DWORD)(mtime >> 32);
+    if (mtime && FileTimeToSystemTime(&ft, &st)) {
+        snprintf(buffer, buffer_size, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                 st.wYear, st.wMonth, st.wDay,
+                 st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+    } else {
+        snprintf(buffer, buffer_size, "unknown");
+    }
+}
+
 // Get file modified time as ISO 8601
 void get_file_modified_time(const char *filepath, char *buffer, size_t buffer_size) {
     WIN32_FILE_ATTRIBUTE_DATA file_info;
     if (GetFileAttributesEx(filepath, GetFileExInfoStandard, &file_info)) {
-        SYSTEMTIME st;
-        FileTimeToSystemTime(&file_info.ftLastWriteTime, &st);
-        snprintf(buffer, buffer_size, "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
-                 st.wYear, st.wMonth, st.wDay,
-                 st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+        format_file_time(((uint64_t)file_info.ftLastWriteTime.dwHighDateTime << 32) |
+                         file_info.ftLastWriteTime.dwLowDateTime, buffer, buffer_size);
     } else {
         strcpy(buffer, "unknown");
     }
 }
 
+// File index from the volume serial and NTFS file index
+uint64_t make_file_index(DWORD volume_serial, DWORD index_high, DWORD index_low) {
+    return ((uint64_t)volume_serial << 32) |
+           ((uint64_t)index_high << 16) |
+           index_low;
+}
+
+// Stand-in file index for a file that could not be opened
+uint64_t path_file_index(const char *filepath) {
+    uint64_t index = 0;
+    for (const char *p = filepath; *p; p++) {
+        index = index * 31 + *p;
+    }
+    return index;
+}
+
 // Generate unique file index
 uint64_t generate_file_index(const char *filepath) {
     BY_HANDLE_FILE_INFORMATION file_info;
@@ -71,22 +98,15 @@ uint64_t generate_file_index(const char *filepath) {
                              NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
     
     if (hFile == INVALID_HANDLE_VALUE) {
-        // Fallback: use hash of filepath
-        uint64_t index = 0;
-        for (const char *p = filepath; *p; p++) {
-            index = index * 31 + *p;
-        }
-        return index;
+        return path_file_index(filepath);
     }
     
     GetFileInformationByHandle(hFile, &file_info);
     CloseHandle(hFile);
     
     // Combine volume serial number, file index high and low
-    uint64_t index = ((uint64_t)file_info.dwVolumeSerialNumber << 32) |
-                     ((uint64_t)file_info.nFileIndexHigh << 16) |
-                     file_info.nFileIndexLow;
-    return index;
+    return make_file_index(file_info.dwVolumeSerialNumber,
+                           file_info.nFileIndexHigh, file_info.nFileIndexLow);
 }
 
 // Remove a filepath from any duplicate group that contains it (called on file rename/delete)
@@ -97,7 +117,7 @@ void remove_filepath_from_ipc_groups(const char *filepath) {
 
     DuplicateGroup *affected_group = NULL;
     for (int i = 0; i < g_group_count; i++) {
-        DuplicateGroup *group = &g_duplicate_groups[i];
+        DuplicateGroup *group = g_duplicate_groups[i];
 
         for (int j = 0; j < group->file_count; j++) {
             if (strcmp(group->files[j].filepath, filepath) == 0) {
@@ -115,54 +135,188 @@ void remove_filepath_from_ipc_groups(const char *filepath) {
         if (affected_group) break;
     }
 
+    // Format under the lock (the files array may be reallocated), send after
+    char message[MAX_MESSAGE_SIZE];
+    char message_hash[65];
+    BOOL have_message = affected_group && g_pipe_server && g_pipe_server->client_connected &&
+                        format_duplicate_group(affected_group, message);
+    if (have_message) strcpy(message_hash, affected_group->filehash);
+    LeaveCriticalSection(&g_groups_lock);
+
+    if (have_message && send_message(message)) {
+        EnterCriticalSection(&g_groups_lock);
+        DuplicateGroup *group = find_group(message_hash);
+        if (group) group->sent_to_client = TRUE;
+        LeaveCriticalSection(&g_groups_lock);
+    }
+}
+
+// Rewrite paths below old_dir after a directory rename and resend the
+// groups that changed
+void rename_ipc_group_paths(const char *old_dir, const char *new_dir) {
+    if (!g_groups_initialized) return;
+
+    size_t old_len = strlen(old_dir);
+    char (*changed)[65] = NULL;
+    int changed_count = 0;
+
+    EnterCriticalSection(&g_groups_lock);
+    for (int i = 0; i < g_group_count; i++) {
+        DuplicateGroup *group = g_duplicate_groups[i];
+        BOOL touched = FALSE;
+
+        for (int j = 0; j < group->file_count; j++) {
+            char *path = group->files[j].filepath;
+            if (strncmp(path, old_dir, old_len) != 0 || path[old_len] != '\\') continue;
+
+            char renamed[MAX_PATH];
+            if (snprintf(renamed, MAX_PATH, "%s%s", new_dir, path + old_len) >= MAX_PATH) continue;
+            strcpy(path, renamed);
+            touched = TRUE;
+        }
+
+        if (touched) {
+            group->sent_to_client = FALSE;
+            char (*grown)[65] = realloc(changed, sizeof(*changed) * (changed_count + 1));
+            if (grown) {
+                changed = grown;
+                strcpy(changed[changed_count++], group->filehash);
+            }
+        }
+    }
     LeaveCriticalSection(&g_groups_lock);
-    if (affected_group && g_pipe_server && g_pipe_server->client_connected) {
-        BOOL send_ok = send_duplicate_group(affected_group);
-        if (send_ok) {
+
+    for (int i = 0; i < changed_count; i++) {
+        if (!g_pipe_server || !g_pipe_server->client_connected) break;
+
+        char message[MAX_MESSAGE_SIZE];
+        EnterCriticalSection(&g_groups_lock);
+        DuplicateGroup *group = find_group(changed[i]);
+        BOOL have_message = group && format_duplicate_group(group, message);
+        LeaveCriticalSection(&g_groups_lock);
+
+        if (have_message && send_message(message)) {
             EnterCriticalSection(&g_groups_lock);
-            affected_group->sent_to_client = TRUE;
+            group = find_group(changed[i]);
+            if (group) group->sent_to_client = TRUE;
             LeaveCriticalSection(&g_groups_lock);
         }
     }
+    free(changed);
 }
 
-// Find existing group by hash or create new one
-static DuplicateGroup* find_or_create_group(const char *filehash) {
-    // Search for existing group
-    for (int i = 0; i < g_group_count; i++) {
-        if (strcmp(g_duplicate_groups[i].filehash, filehash) == 0) {
-            return &g_duplicate_groups[i];
-        }
+static uint64_t group_hash(const char *filehash) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int c;
+    while ((c = (unsigned char)*filehash++)) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
     }
-    
-    // Create new group if we have space
-    if (g_group_count < MAX_HISTORY_ALERTS) {
-        DuplicateGroup *group = &g_duplicate_groups[g_group_count];
-        memset(group, 0, sizeof(DuplicateGroup));
-        strncpy(group->filehash, filehash, 64);
-        group->filehash[64] = '\0';
-        group->file_count = 0;
-        group->sent_to_client = FALSE;
-        g_group_count++;
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static BOOL group_matches(uint32_t value, const void *key, void *ctx) {
+    return strcmp(g_duplicate_groups[value]->filehash, (const char*)key) == 0;
+}
+
+static uint64_t group_rehash(uint32_t value, void *ctx) {
+    return group_hash(g_duplicate_groups[value]->filehash);
+}
+
+// Find existing group by hash (g_groups_lock held).  Callers that drop the
+// lock look the group up again rather than keep the pointer, since
+// clear_ipc_state frees every group.
+static DuplicateGroup* find_group(const char *filehash) {
+    if (!g_group_index.table) return NULL;
+    uint32_t found = flat_index_find(&g_group_index, group_hash(filehash),
+                                     group_matches, filehash, NULL);
+    return found != FLAT_INDEX_NONE ? g_duplicate_groups[found] : NULL;
+}
+
+// Find existing group by hash or create new one (g_groups_lock held)
+static DuplicateGroup* find_or_create_group(const char *filehash) {
+    DuplicateGroup *group = find_group(filehash);
+    if (group) {
         return group;
     }
+    if (!g_group_index.table && !flat_index_init(&g_group_index, 0)) {
+        return NULL;
+    }
     
-    return NULL;
+    if (g_group_count == g_group_capacity) {
+        int capacity = g_group_capacity ? g_group_capacity * 2 : 256;
+        DuplicateGroup **grown = realloc(g_duplicate_groups, sizeof(DuplicateGroup*) * capacity);
+        if (!grown) return NULL;
+        g_duplicate_groups = grown;
+        g_group_capacity = capacity;
+    }
+
+    group = calloc(1, sizeof(DuplicateGroup));
+    if (!group) return NULL;
+    strncpy(group->filehash, filehash, 64);
+    group->filehash[64] = '\0';
+    group->sent_to_client = FALSE;
+
+    g_duplicate_groups[g_group_count] = group;
+    if (!flat_index_insert(&g_group_index, group_hash(filehash), (uint32_t)g_group_count,
+                           group_rehash, NULL)) {
+        free(group);
+        return NULL;
+    }
+    // Lookups here are all under g_groups_lock, so drained tables can go now
+    flat_index_reclaim(&g_group_index);
+    g_group_count++;
+    return group;
 }
 
-// Send a duplicate group to the GUI; returns TRUE if the message was written to the pipe
-static BOOL send_duplicate_group(DuplicateGroup *group) {
+// Append a file, growing the group's array (capped at MAX_DUPLICATES + 1)
+static BOOL append_group_file(DuplicateGroup *group, const FileInfo *file) {
+    if (group->file_count >= MAX_DUPLICATES + 1) {
+        return FALSE;
+    }
+    if (group->file_count == group->file_capacity) {
+        int capacity = group->file_capacity ? group->file_capacity * 2 : 2;
+        if (capacity > MAX_DUPLICATES + 1) capacity = MAX_DUPLICATES + 1;
+        FileInfo *grown = realloc(group->files, sizeof(FileInfo) * capacity);
+        if (!grown) return FALSE;
+        group->files = grown;
+        group->file_capacity = capacity;
+    }
+    memcpy(&group->files[group->file_count], file, sizeof(FileInfo));
+    group->file_count++;
+    return TRUE;
+}
+
+// Release every stored group (g_groups_lock held)
+static void free_duplicate_groups(void) {
+    for (int i = 0; i < g_group_count; i++) {
+        free(g_duplicate_groups[i]->files);
+        free(g_duplicate_groups[i]);
+    }
+    free(g_duplicate_groups);
+    g_duplicate_groups = NULL;
+    g_group_count = 0;
+    g_group_capacity = 0;
+    flat_index_free(&g_group_index);
+}
+
+// Build the DUPLICATE_DETECTED message for a group into message
+// (MAX_MESSAGE_SIZE bytes); FALSE if it is no longer a duplicate group.
+// Called under g_groups_lock so the files array cannot move underneath.
+static BOOL format_duplicate_group(const DuplicateGroup *group, char *message) {
     if (group->file_count < 2) {
         return FALSE;  // Not a duplicate group anymore
     }
     
-    char message[MAX_MESSAGE_SIZE];
     char *ptr = message;
     int remaining = MAX_MESSAGE_SIZE;
     int written;
     
     // Use first file as trigger
-    FileInfo *trigger = &group->files[0];
+    const FileInfo *trigger = &group->files[0];
     
     written = snprintf(ptr, remaining,
         "{\"type\":\"ALERT\",\"event\":\"DUPLICATE_DETECTED\","
@@ -204,12 +358,16 @@ static BOOL send_duplicate_group(DuplicateGroup *group) {
         remaining -= written;
     }
     
+    // Partial: some root is still being scanned and may hold more copies.
+    // It follows the timestamp because the GUI finds the end of the
+    // duplicates array by "],\"timestamp\"".
     written = snprintf(ptr, remaining,
-        "],\"timestamp\":\"%s\"}\n",
-        group->last_updated
+        "],\"timestamp\":\"%s\",\"partial\":%s}\n",
+        group->last_updated,
+        roots_covered() ? "false" : "true"
     );
     
-    return send_message(message);
+    return TRUE;
 }
 
 // Initialize pipe server
@@ -287,15 +445,20 @@ void shutdown_pipe_server(void) {
     g_pipe_server = NULL;
     
     if (g_groups_initialized) {
+        free_duplicate_groups();
         DeleteCriticalSection(&g_groups_lock);
         g_groups_initialized = FALSE;
-        g_group_count = 0;
-        g_empty_record_count = 0;
     }
     
     safe_printf("[IPC] Pipe server shut down\n");
 }
 
+static void resend_empty_file(const char *filepath, const FileMeta *meta, void *ctx) {
+    char last_mod[32];
+    format_file_time(meta->mtime, last_mod, sizeof(last_mod));
+    send_alert_empty_file(filepath, 0, last_mod, (const char*)ctx);
+}
+
 // Send all duplicate groups to newly connected client
 BOOL send_alert_history_to_client(void) {
     if (!g_pipe_server || !g_pipe_server->client_connected) {
@@ -306,19 +469,22 @@ BOOL send_alert_history_to_client(void) {
     
     safe_printf("[IPC] Sending %d duplicate groups to client...\n", g_group_count);
     
+    // Each group is one pipe message; WriteFile blocks while the GUI's
+    // buffer is full, so no pacing is needed between them
+    char message[MAX_MESSAGE_SIZE];
     for (int i = 0; i < g_group_count; i++) {
-        DuplicateGroup *group = &g_duplicate_groups[i];
+        DuplicateGroup *group = g_duplicate_groups[i];
         
         // Always resend every valid group on reconnect — the GUI starts fresh
         // each connection, so it needs the full current state regardless of
         // whether we sent this group to a previous client session.
-        if (group->file_count >= 2) {
+        if (format_duplicate_group(group, message)) {
             LeaveCriticalSection(&g_groups_lock);
-            BOOL send_ok = send_duplicate_group(group);
-            Sleep(50);
+            BOOL send_ok = send_message(message);
             EnterCriticalSection(&g_groups_lock);
             
-            if (send_ok) {
+            // The list may have been cleared while unlocked
+            if (send_ok && i < g_group_count && g_duplicate_groups[i] == group) {
                 group->sent_to_client = TRUE;
             }
         }
@@ -328,33 +494,22 @@ BOOL send_alert_history_to_client(void) {
     
     safe_printf("[IPC] Finished sending duplicate groups\n");
 
-    // Resend known empty files
-    EnterCriticalSection(&g_groups_lock);
-    int empty_count = g_empty_record_count;
-    EmptyFileRecord snapshot[MAX_EMPTY_FILE_RECORDS];
-    if (empty_count > 0) {
-        memcpy(snapshot, g_empty_records, sizeof(EmptyFileRecord) * empty_count);
-    }
-    LeaveCriticalSection(&g_groups_lock);
+    send_empty_files_to_client();
+    return TRUE;
+}
 
-    if (empty_count > 0) {
-        safe_printf("[IPC] Sending %d empty files to client...\n", empty_count);
-        for (int i = 0; i < empty_count; i++) {
-            char message[MAX_PATH + 512];
-            snprintf(message, sizeof(message),
-                "{\"type\":\"ALERT\",\"event\":\"EMPTY_FILE\","
-                "\"filepath\":\"%s\",\"filesize\":%llu,"
-                "\"last_mod\":\"%s\",\"timestamp\":\"%s\"}\n",
-                snapshot[i].filepath,
-                (unsigned long long)snapshot[i].filesize,
-                snapshot[i].last_modified,
-                snapshot[i].timestamp);
-            send_message(message);
-            Sleep(20);
+void send_empty_files_to_client(void) {
+    // The index is their only record
+    HashTable *table = hash_table_acquire();
+    if (table && g_pipe_server && g_pipe_server->client_connected) {
+        char timestamp[32];
+        get_iso8601_timestamp(timestamp, sizeof(timestamp));
+        int empty_count = hash_table_visit_empty(table, resend_empty_file, timestamp);
+        if (empty_count > 0) {
+            safe_printf("[IPC] Sent %d empty files to client\n", empty_count);
         }
     }
-
-    return TRUE;
+    hash_table_release();
 }
 
 // Pipe server thread
@@ -432,18 +587,15 @@ static DWORD WINAPI pipe_server_thread(LPVOID param) {
     return 0;
 }
 
-// Parse and queue a CHANGE_DIRECTORY command from a JSON buffer
-static void handle_change_directory_command(const char *json) {
-    if (!strstr(json, "\"CHANGE_DIRECTORY\"")) return;
-
+// Extract and unescape the "path" field of a JSON command
+static BOOL parse_command_path(const char *json, char *clean) {
     const char *pp = strstr(json, "\"path\":\"");
-    if (!pp) return;
+    if (!pp) return FALSE;
     pp += 8;
     const char *pe = strchr(pp, '"');
-    if (!pe || (pe - pp) >= MAX_PATH) return;
+    if (!pe || (pe - pp) >= MAX_PATH) return FALSE;
 
     // Unescape \\ → single backslash
-    char clean[MAX_PATH] = {0};
     int wi = 0;
     for (const char *ri = pp; ri < pe && wi < MAX_PATH - 1; ri++) {
         if (*ri == '\\' && *(ri+1) == '\\') {
@@ -455,7 +607,15 @@ static void handle_change_directory_command(const char *json) {
     }
     clean[wi] = '\0';
 
-    if (clean[0] == '\0') return;
+    return clean[0] != '\0';
+}
+
+// Parse and queue a CHANGE_DIRECTORY command from a JSON buffer
+static void handle_change_directory_command(const char *json) {
+    if (!strstr(json, "\"CHANGE_DIRECTORY\"")) return;
+
+    char clean[MAX_PATH] = {0};
+    if (!parse_command_path(json, clean)) return;
 
     EnterCriticalSection(&g_groups_lock);
     strncpy(g_pending_dir, clean, MAX_PATH - 1);
@@ -466,6 +626,137 @@ static void handle_change_directory_command(const char *json) {
     safe_printf("[IPC] Directory change queued: %s\n", clean);
 }
 
+// Parse and queue an ADD_ROOT / REMOVE_ROOT command; the main loop applies
+// it.  Returns the error to answer with, or NULL.
+static const char* handle_root_command(const char *json) {
+    RootCommand command;
+    if (strstr(json, "\"ADD_ROOT\"")) {
+        const char *rp = strstr(json, "\"reference\":");
+        if (rp) {
+            rp += 12;
+            while (*rp == ' ') rp++;
+        }
+        command = rp && strncmp(rp, "true", 4) == 0 ? ROOT_CMD_ADD_REFERENCE : ROOT_CMD_ADD;
+    } else if (strstr(json, "\"REMOVE_ROOT\"")) {
+        command = ROOT_CMD_REMOVE;
+    } else {
+        return NULL;
+    }
+
+    char clean[MAX_PATH] = {0};
+    if (!parse_command_path(json, clean)) return NULL;
+
+    if (!roots_queue_command(command, clean)) {
+        return "Too many root commands pending, try again later";
+    }
+    safe_printf("[IPC] Root %s queued: %s\n",
+                command == ROOT_CMD_REMOVE ? "removal" :
+                command == ROOT_CMD_ADD_REFERENCE ? "add (reference)" : "add", clean);
+    return NULL;
+}
+
+// Rows a query answers with at most, so the response fits one message
+#define QUERY_MAX_ROWS 50
+
+// Read the "limit" field of a JSON command (default when absent), clamped
+// to QUERY_MAX_ROWS
+static int parse_command_limit(const char *json, int fallback) {
+    const char *lp = strstr(json, "\"limit\":");
+    int limit = lp ? atoi(lp + 8) : fallback;
+    if (limit < 1) limit = 1;
+    return limit > QUERY_MAX_ROWS ? QUERY_MAX_ROWS : limit;
+}
+
+// Answer TOP_GROUPS / DIRECTORY_ROLLUP from the aggregates the index keeps
+// up to date, so it costs O(limit) and works mid-scan.  FALSE if json is
+// not a query.
+static BOOL handle_query_command(const char *json, char *response, size_t size) {
+    BOOL top = strstr(json, "\"TOP_GROUPS\"") != NULL;
+    if (!top && !strstr(json, "\"DIRECTORY_ROLLUP\"")) return FALSE;
+
+    char timestamp[32];
+    get_iso8601_timestamp(timestamp, sizeof(timestamp));
+    int limit = parse_command_limit(json, 10);
+    size_t used = 0;
+
+    // Held until the answer is built, so a CHANGE_DIRECTORY swap waits
+    HashTable *table = hash_table_acquire();
+    if (!table) {
+        hash_table_release();
+        snprintf(response, size,
+            "{\"type\":\"RESPONSE\",\"status\":\"FAILED\",\"message\":\"Index not ready\","
+            "\"timestamp\":\"%s\"}\n", timestamp);
+        return TRUE;
+    }
+
+    if (top) {
+        WastedGroup groups[QUERY_MAX_ROWS];
+        int count = hash_table_top_groups(table, groups, limit);
+        used += snprintf(response, size,
+            "{\"type\":\"RESPONSE\",\"action\":\"TOP_GROUPS\",\"status\":\"OK\",\"groups\":[");
+        for (int i = 0; i < count && used < size; i++) {
+            used += snprintf(response + used, size - used,
+                "%s{\"filehash\":\"%s\",\"filesize\":%llu,\"count\":%u,\"wasted_bytes\":%llu}",
+                i > 0 ? "," : "", groups[i].hash, (unsigned long long)groups[i].filesize,
+                groups[i].count, (unsigned long long)groups[i].wasted_bytes);
+        }
+    } else {
+        // No path: the top-level directories of every root
+        char clean[MAX_PATH] = {0};
+        parse_command_path(json, clean);
+        size_t len = strlen(clean);
+        while (len > 0 && clean[len - 1] == '\\') clean[--len] = '\0';
+
+        PathRollup self;
+        PathRollup *children = malloc(sizeof(PathRollup) * limit);
+        int count = children ? path_tree_rollup(&table->tree, clean, len,
+                                                &self, children, limit) : -1;
+        if (count < 0) {
+            hash_table_release();
+            free(children);
+            snprintf(response, size,
+                "{\"type\":\"RESPONSE\",\"action\":\"DIRECTORY_ROLLUP\",\"status\":\"FAILED\","
+                "\"message\":\"Directory not indexed\",\"path\":\"%s\",\"timestamp\":\"%s\"}\n",
+                clean, timestamp);
+            return TRUE;
+        }
+        used += snprintf(response, size,
+            "{\"type\":\"RESPONSE\",\"action\":\"DIRECTORY_ROLLUP\",\"status\":\"OK\","
+            "\"path\":\"%s\",\"duplicate_files\":%llu,\"duplicate_bytes\":%llu,\"children\":[",
+            clean, (unsigned long long)self.duplicate_files,
+            (unsigned long long)self.duplicate_bytes);
+        for (int i = 0; i < count && used < size; i++) {
+            used += snprintf(response + used, size - used,
+                "%s{\"path\":\"%s\",\"duplicate_files\":%llu,\"duplicate_bytes\":%llu}",
+                i > 0 ? "," : "", children[i].path,
+                (unsigned long long)children[i].duplicate_files,
+                (unsigned long long)children[i].duplicate_bytes);
+        }
+        free(children);
+    }
+    hash_table_release();
+
+    if (used < size) {
+        snprintf(response + used, size - used, "],\"timestamp\":\"%s\",\"partial\":%s}\n",
+                 timestamp, roots_covered() ? "false" : "true");
+    }
+    return TRUE;
+}
+
+// Write the answer to one command: error if it was rejected, else a
+// query's result or an acknowledgement
+static void respond_to_command(HANDLE pipe, const char *json, const char *error) {
+    char response[MAX_MESSAGE_SIZE];
+    if (error) {
+        snprintf(response, sizeof(response),
+                 "{\"type\":\"RESPONSE\",\"status\":\"ERROR\",\"message\":\"%s\"}\n", error);
+    } else if (!handle_query_command(json, response, sizeof(response))) {
+        strcpy(response, "{\"type\":\"RESPONSE\",\"status\":\"OK\",\"message\":\"Command received\"}\n");
+    }
+    DWORD bytes_written;
+    WriteFile(pipe, response, strlen(response), &bytes_written, NULL);
+}
+
 // Handle incoming commands from GUI client
 static void handle_client_commands(HANDLE pipe) {
     char buffer[PIPE_BUFFER_SIZE];
@@ -489,9 +780,7 @@ static void handle_client_commands(HANDLE pipe) {
             buffer[bytes_read] = '\0';
             safe_printf("[IPC] Received command: %s\n", buffer);
             handle_change_directory_command(buffer);
-            const char *response = "{\"type\":\"RESPONSE\",\"status\":\"OK\",\"message\":\"Command received\"}\n";
-            DWORD bytes_written;
-            WriteFile(pipe, response, strlen(response), &bytes_written, NULL);
+            respond_to_command(pipe, buffer, handle_root_command(buffer));
             continue;
         }
 
@@ -510,9 +799,7 @@ static void handle_client_commands(HANDLE pipe) {
         buffer[bytes_read] = '\0';
         safe_printf("[IPC] Received command: %s\n", buffer);
         handle_change_directory_command(buffer);
-        const char *response = "{\"type\":\"RESPONSE\",\"status\":\"OK\",\"message\":\"Command received\"}\n";
-        DWORD bytes_written;
-        WriteFile(pipe, response, strlen(response), &bytes_written, NULL);
+        respond_to_command(pipe, buffer, handle_root_command(buffer));
     }
 
     CancelIo(pipe);
@@ -574,7 +861,7 @@ BOOL send_alert_duplicate_detected(
     
     if (!group) {
         LeaveCriticalSection(&g_groups_lock);
-        safe_printf("[IPC] Failed to create duplicate group (limit reached)\n");
+        safe_printf("[IPC] Failed to create duplicate group (out of memory)\n");
         return FALSE;
     }
     
@@ -595,9 +882,8 @@ BOOL send_alert_duplicate_detected(
     }
     
     // Add trigger file if not already in group
-    if (!trigger_exists && group->file_count < (MAX_DUPLICATES + 1)) {
-        memcpy(&group->files[group->file_count], trigger_file, sizeof(FileInfo));
-        group->file_count++;
+    if (!trigger_exists) {
+        append_group_file(group, trigger_file);
     }
     
     // Add duplicate files that aren't already in group
@@ -611,8 +897,7 @@ BOOL send_alert_duplicate_detected(
         }
         
         if (!exists) {
-            memcpy(&group->files[group->file_count], &duplicates[i], sizeof(FileInfo));
-            group->file_count++;
+            append_group_file(group, &duplicates[i]);
         }
     }
     
@@ -628,32 +913,37 @@ BOOL send_alert_duplicate_detected(
     
     // Track if this was already sent
     BOOL was_sent = group->sent_to_client;
+    int file_count = group->file_count;
     
-    LeaveCriticalSection(&g_groups_lock);
+    // Format while the files array cannot move; send after unlocking
+    char message[MAX_MESSAGE_SIZE];
+    BOOL have_message = g_pipe_server && g_pipe_server->client_connected &&
+                        format_duplicate_group(group, message);
     
     // Send the complete updated group only if client is connected
-    if (g_pipe_server && g_pipe_server->client_connected) {
-        BOOL send_ok = send_duplicate_group(group);
+    if (have_message) {
+        LeaveCriticalSection(&g_groups_lock);
+        BOOL send_ok = send_message(message);
         
         EnterCriticalSection(&g_groups_lock);
         // Only mark as sent if the write actually reached the pipe buffer;
         // if it failed (broken connection) leave sent_to_client=FALSE so the
         // next reconnect's send_alert_history_to_client will resend it.
-        if (send_ok) {
+        group = find_group(trigger_file->filehash);
+        if (send_ok && group) {
             group->sent_to_client = TRUE;
         }
         LeaveCriticalSection(&g_groups_lock);
         
         if (was_sent) {
             safe_printf("[IPC] Updated duplicate group for hash %.8s... (now %d files)\n", 
-                       trigger_file->filehash, group->file_count);
+                       trigger_file->filehash, file_count);
         } else {
             safe_printf("[IPC] Created new duplicate group for hash %.8s... (%d files)\n", 
-                       trigger_file->filehash, group->file_count);
+                       trigger_file->filehash, file_count);
         }
     } else {
         // Mark as not sent so it will be sent when client connects
-        EnterCriticalSection(&g_groups_lock);
         group->sent_to_client = FALSE;
         LeaveCriticalSection(&g_groups_lock);
     }
@@ -686,38 +976,36 @@ BOOL send_alert_error(const char *error_message, const char *timestamp) {
     return send_message(message);
 }
 
-// Send empty file detected alert (also tracked for resend on reconnect)
-BOOL send_alert_empty_file(const char *filepath, uint64_t filesize,
-                           const char *last_modified, const char *timestamp) {
-    if (!g_groups_initialized) {
-        InitializeCriticalSection(&g_groups_lock);
-        g_groups_initialized = TRUE;
+// Send duplicate directory alert (not kept for resend; the next scan reports it again)
+BOOL send_alert_duplicate_directory(const char *const *paths, int count,
+                                    uint64_t files, uint64_t bytes, const char *timestamp) {
+    if (!g_pipe_server || !g_pipe_server->client_connected) {
+        return FALSE;
     }
 
-    EnterCriticalSection(&g_groups_lock);
-
-    // De-dup: skip if already tracked
-    BOOL exists = FALSE;
-    for (int i = 0; i < g_empty_record_count; i++) {
-        if (strcmp(g_empty_records[i].filepath, filepath) == 0) {
-            exists = TRUE;
-            break;
-        }
-    }
+    char message[MAX_MESSAGE_SIZE];
+    int remaining = sizeof(message);
+    char *ptr = message;
+    int written = snprintf(ptr, remaining,
+        "{\"type\":\"ALERT\",\"event\":\"DUPLICATE_DIRECTORY\","
+        "\"files\":%llu,\"filesize\":%llu,\"directories\":[",
+        (unsigned long long)files, (unsigned long long)bytes);
+    ptr += written;
+    remaining -= written;
 
-    if (!exists && g_empty_record_count < MAX_EMPTY_FILE_RECORDS) {
-        EmptyFileRecord *r = &g_empty_records[g_empty_record_count++];
-        strncpy(r->filepath, filepath, MAX_PATH - 1);
-        r->filepath[MAX_PATH - 1] = '\0';
-        r->filesize = filesize;
-        strncpy(r->last_modified, last_modified ? last_modified : "", 31);
-        r->last_modified[31] = '\0';
-        strncpy(r->timestamp, timestamp ? timestamp : "", 31);
-        r->timestamp[31] = '\0';
+    for (int i = 0; i < count && remaining > MAX_PATH + 64; i++) {
+        written = snprintf(ptr, remaining, "%s\"%s\"", i > 0 ? "," : "", paths[i]);
+        ptr += written;
+        remaining -= written;
     }
 
-    LeaveCriticalSection(&g_groups_lock);
+    snprintf(ptr, remaining, "],\"timestamp\":\"%s\"}\n", timestamp ? timestamp : "");
+    return send_message(message);
+}
 
+// Send empty file detected alert (the index keeps the file for resend on reconnect)
+BOOL send_alert_empty_file(const char *filepath, uint64_t filesize,
+                           const char *last_modified, const char *timestamp) {
     if (!g_pipe_server || !g_pipe_server->client_connected) {
         return FALSE;
     }
@@ -735,15 +1023,12 @@ BOOL send_alert_empty_file(const char *filepath, uint64_t filesize,
     return send_message(message);
 }
 
-// Clear all stored duplicate groups and empty-file records for a directory rescan
+// Clear all stored duplicate groups for a directory rescan
 void clear_ipc_state(void) {
     if (!g_groups_initialized) return;
 
     EnterCriticalSection(&g_groups_lock);
-    memset(g_duplicate_groups, 0, sizeof(g_duplicate_groups));
-    g_group_count = 0;
-    memset(g_empty_records, 0, sizeof(g_empty_records));
-    g_empty_record_count = 0;
+    free_duplicate_groups();
     LeaveCriticalSection(&g_groups_lock);
 }
 
@@ -1,11 +1,17 @@
 //main.c
 #include "utils.h"
 #include "hash_table.h"
-#include "empty_files.h"
 #include "scanner.h"
 #include "monitor.h"
+#include "roots.h"
 #include "ipc_pipe.h"
+#include "digest_store.h"
+#include "dir_summary.h"
+#include "scan_progress.h"
+#include "visited_set.h"
+#include "batch_audit.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <windows.h>
 
@@ -21,130 +27,282 @@ BOOL WINAPI console_ctrl_handler(DWORD ctrl_type) {
     return FALSE;
 }
 
-// One full pass: scan + optionally watch.  Returns TRUE if a directory change
-// was requested while running so the caller can loop.
-static BOOL run_scan_and_watch(const char *directory, int watch_mode) {
-    strncpy(g_monitor_path, directory, MAX_PATH - 1);
-    g_monitor_path[MAX_PATH - 1] = '\0';
-    g_stop_monitoring   = 0;
-    g_scanning_complete = 0;
-    g_dir_change_pending = FALSE;
+static void send_directory_changed(const char *path) {
+    char ts[32];
+    get_iso8601_timestamp(ts, sizeof(ts));
+    char msg[MAX_PATH + 256];
+    snprintf(msg, sizeof(msg),
+        "{\"type\":\"ALERT\",\"event\":\"DIRECTORY_CHANGED\","
+        "\"path\":\"%s\",\"timestamp\":\"%s\"}\n",
+        path, ts);
+    send_raw_notification(msg);
+}
 
-    safe_printf("=== File Duplicate Detector with Real-time Monitoring ===\n");
-    safe_printf("Directory: %s\n", directory);
-    safe_printf("Mode: %s\n\n", watch_mode ? "Scan + Watch" : "Scan Only");
+// ── CHANGE_DIRECTORY ────────────────────────────────────────────────────
 
-    // Clear internal state so new scan is fresh
-    clear_ipc_state();
+// The root and index being built for the last CHANGE_DIRECTORY while the
+// live ones keep serving (main thread only)
+static MonitorRoot *g_staged_root = NULL;
 
-    // Free and re-create hash table
-    if (g_hash_table) {
-        free_hash_table(g_hash_table);
-        g_hash_table = NULL;
-    }
-    g_hash_table = create_hash_table(10007);
+static void abandon_reroot(void) {
+    if (!g_staged_root) return;
+    HashTable *table = g_staged_root->table;
+    roots_discard(g_staged_root);
+    free_hash_table(table);
+    g_staged_root = NULL;
+}
 
-    // Re-initialise empty files list
-    free_empty_files_list();
-    init_empty_files_list();
+// Start building the index for g_pending_dir behind the live one.  Parts
+// the live roots have already scanned are copied rather than rescanned.
+static void begin_reroot(void) {
+    g_dir_change_pending = FALSE;
+    char path[MAX_PATH];
+    strncpy(path, g_pending_dir, MAX_PATH - 1);
+    path[MAX_PATH - 1] = '\0';
 
-    // Notify the GUI *before* starting the scanner so the UI clears its
-    // state and shows "Scanning in progress..." while the scan runs.
-    if (watch_mode) {
+    // A newer change replaces one still building
+    abandon_reroot();
+
+    HashTable *table = create_hash_table(hash_table_count(g_hash_table));
+    MonitorRoot *root = roots_stage(path, table);
+    if (!root || !root_start(root)) {
         char ts[32];
+        char err[MAX_PATH + 64];
         get_iso8601_timestamp(ts, sizeof(ts));
-        char msg[MAX_PATH + 256];
-        snprintf(msg, sizeof(msg),
-            "{\"type\":\"ALERT\",\"event\":\"DIRECTORY_CHANGED\","
-            "\"path\":\"%s\",\"timestamp\":\"%s\"}\n",
-            directory, ts);
-        send_raw_notification(msg);
+        snprintf(err, sizeof(err), "Cannot change directory to %s", path);
+        send_alert_error(err, ts);
+        if (root) roots_discard(root);
+        free_hash_table(table);
+        return;
     }
+    g_staged_root = root;
+    safe_printf("[MAIN] Building index for %s; the current one serves until it is ready\n",
+                root->path);
+}
 
-    HANDLE hMonitorThread = CreateThread(NULL, 0, monitor_thread_func,
-                                         g_monitor_path, 0, NULL);
-    if (!hMonitorThread) {
-        safe_printf("Failed to create monitor thread\n");
-        return FALSE;
+// Make the staged root and its index live and retire the old ones.
+// Reference roots carry over, loaded into the new index from the digest
+// store.
+static void complete_reroot(void) {
+    MonitorRoot *root = g_staged_root;
+    g_staged_root = NULL;
+
+    static char references[MAX_ROOTS][MAX_PATH];
+    int reference_count = roots_reference_paths(references);
+
+    roots_stop_all();
+    HashTable *old = hash_table_swap(root->table);
+    roots_adopt(root);
+    free_hash_table(old);
+
+    safe_printf("[MAIN] Now monitoring %s\n", root->path);
+    for (int i = 0; i < reference_count; i++) {
+        MonitorRoot *reference = roots_add(references[i], TRUE);
+        if (reference) root_start(reference);
     }
+    // The staged index sent no alerts: the GUI starts over from here, and
+    // finish_initial_scan sends the groups
+    clear_ipc_state();
+    send_directory_changed(root->path);
+    send_empty_files_to_client();
+}
 
-    Sleep(200);
+// Scan every root and, with watch_mode, keep monitoring until stopped.
+// CHANGE_DIRECTORY swaps in a new root and index without stopping.
+static void run_scan_and_watch(char directories[][MAX_PATH], const BOOL *references,
+                               int directory_count, int watch_mode) {
+    g_stop_monitoring   = 0;
+    g_scanning_complete = 0;
+    g_dir_change_pending = FALSE;
 
-    HANDLE hScannerThread = CreateThread(NULL, 0, scanner_thread_func,
-                                         NULL, 0, NULL);
-    if (!hScannerThread) {
-        safe_printf("Failed to create scanner thread\n");
-        g_stop_monitoring = 1;
-        WaitForSingleObject(hMonitorThread, INFINITE);
-        CloseHandle(hMonitorThread);
-        return FALSE;
+    safe_printf("=== File Duplicate Detector with Real-time Monitoring ===\n");
+    for (int i = 0; i < directory_count; i++) {
+        safe_printf("%s: %s\n", references[i] ? "Reference" : "Directory", directories[i]);
     }
+    safe_printf("Mode: %s\n\n", g_lazy_index ? "Watch + Background Scan" :
+                                watch_mode ? "Scan + Watch" : "Scan Only");
 
-    WaitForSingleObject(hScannerThread, INFINITE);
-    CloseHandle(hScannerThread);
+    // Every root shares this one index.  The digest store's record count
+    // is the best first guess at its size; the enumeration estimate grows
+    // it further once known.
+    clear_ipc_state();
+    free_hash_table(hash_table_swap(create_hash_table(g_digest_store ? g_digest_store->count : 0)));
 
+    // Notify the GUI *before* starting the scanner so the UI clears its
+    // state and shows "Scanning in progress..." while the scan runs.
     if (watch_mode) {
-        safe_printf("\n=== Continuing to monitor (Press Ctrl+C to stop) ===\n\n");
+        for (int i = 0; i < directory_count; i++) {
+            if (references[i]) continue;
+            send_directory_changed(directories[i]);
+            break;
+        }
+    }
+
+    // Each root gets its own monitor and scanner thread
+    int started = 0;
+    for (int i = 0; i < directory_count; i++) {
+        MonitorRoot *root = roots_add(directories[i], references[i]);
+        if (root && root_start(root)) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        safe_printf("No root could be started\n");
+        roots_stop_all();
+        return;
+    }
+
+    // Root changes requested over IPC are applied here, even mid-scan.
+    // Lazy mode watches at once and lets the scans finish behind it.
+    BOOL reported = FALSE;   // finish_initial_scan has run for the live index
+    BOOL watching = FALSE;
+    while (!g_stop_monitoring) {
+        roots_process_pending();
+        if (g_dir_change_pending) {
+            begin_reroot();
+        }
+        if (g_staged_root && root_scan_finished(g_staged_root)) {
+            complete_reroot();
+            g_scanning_complete = 0;
+            reported = FALSE;
+        }
+        scan_progress_tick();
 
-        // Wait for monitor thread, but break early if directory change requested
-        while (!g_dir_change_pending) {
-            if (WaitForSingleObject(hMonitorThread, 500) == WAIT_OBJECT_0)
-                break;
+        if (!reported && !g_staged_root && !roots_scans_running()) {
+            scan_progress_tick();
+            finish_initial_scan();
+            reported = TRUE;
+        }
+        if (!watch_mode) {
+            if (reported) break;
+        } else if (!watching && (reported || g_lazy_index)) {
+            safe_printf(g_lazy_index && !reported ?
+                "\n=== Monitoring; existing files are indexed in the background (Press Ctrl+C to stop) ===\n\n" :
+                "\n=== Continuing to monitor (Press Ctrl+C to stop) ===\n\n");
+            watching = TRUE;
+        } else if (watching && !g_staged_root && !roots_monitors_running()) {
+            break;
         }
+        Sleep(reported ? 500 : 200);
     }
 
     g_stop_monitoring = 1;
     signal_monitor_stop();
-    WaitForSingleObject(hMonitorThread, INFINITE);
-    CloseHandle(hMonitorThread);
-
-    BOOL changed = g_dir_change_pending;
-    return changed;
+    abandon_reroot();
+    roots_stop_all();
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 2 || argc > 3) {
-        printf("Usage: %s <directory> [--watch]\n", argv[0]);
+    static char directories[MAX_ROOTS][MAX_PATH];
+    static BOOL references[MAX_ROOTS];
+    int directory_count = 0;
+    int reference_count = 0;
+    int watch_mode = 0;
+    int full_rescan = 0;
+    int audit_mode = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--watch") == 0) {
+            watch_mode = 1;
+        } else if (strcmp(argv[i], "--lazy") == 0) {
+            g_lazy_index = 1;
+            watch_mode = 1;
+        } else if (strcmp(argv[i], "--full-rescan") == 0) {
+            full_rescan = 1;
+        } else if (strcmp(argv[i], "--audit") == 0) {
+            audit_mode = 1;
+        } else if (strcmp(argv[i], "--reparse") == 0 && i + 1 < argc) {
+            const char *policy = argv[++i];
+            if (strcmp(policy, "skip") == 0) {
+                g_reparse_policy = REPARSE_SKIP;
+            } else if (strcmp(policy, "follow") == 0) {
+                g_reparse_policy = REPARSE_FOLLOW;
+            } else {
+                printf("Unknown --reparse policy: %s (use follow or skip)\n", policy);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            long megabytes = strtol(argv[++i], NULL, 10);
+            if (megabytes <= 0) {
+                printf("Invalid --memory-budget: %s (megabytes, above 0)\n", argv[i]);
+                return 1;
+            }
+            g_index_memory_budget = (size_t)megabytes * 1024 * 1024;
+        } else if (directory_count < MAX_ROOTS) {
+            // --reference <dir>: the next argument is a reference root
+            BOOL reference = strcmp(argv[i], "--reference") == 0;
+            if (reference && ++i >= argc) break;
+            strncpy(directories[directory_count], argv[i], MAX_PATH - 1);
+            directories[directory_count][MAX_PATH - 1] = '\0';
+            references[directory_count] = reference;
+            reference_count += reference;
+            directory_count++;
+        }
+    }
+
+    if (directory_count == reference_count) {
+        printf("Usage: %s <directory> [<directory>...] [--watch] [--lazy] [--full-rescan]\n"
+               "       [--reparse follow|skip] [--reference <directory>]...\n"
+               "       [--memory-budget <MB>] [--audit]\n", argv[0]);
         printf(" --watch: Continue monitoring after initial scan\n");
+        printf(" --lazy: Watch at once and index existing files by a background scan;\n"
+               "         alerts are marked partial until it finishes (implies --watch)\n");
+        printf(" --full-rescan: Enumerate every directory, ignoring saved directory summaries\n");
+        printf(" --reparse: Follow symlinks/junctions/mount points (default, each directory\n"
+               "            is scanned once however it is reached) or skip them\n");
+        printf(" --reference: Match new files against a read-only archive without alerting\n"
+               "              on its own duplicates; loaded from the digest store after its\n"
+               "              first scan (--full-rescan scans it again)\n");
+        printf(" --memory-budget: Keep the index within this many megabytes by spilling\n"
+               "                  files with no duplicate to sorted runs on disk\n");
+        printf(" --audit: Report every duplicate once and exit, sorting on disk instead of\n"
+               "          indexing, so memory stays within --memory-budget (default %d MB)\n"
+               "          however many files there are; reference directories are audited\n"
+               "          like the others\n", (int)(AUDIT_DEFAULT_BUDGET / (1024 * 1024)));
+        printf(" Several directories share one index, so duplicates across them are found.\n");
         return 1;
     }
 
-    char directory[MAX_PATH];
-    strncpy(directory, argv[1], MAX_PATH - 1);
-    directory[MAX_PATH - 1] = '\0';
-    int watch_mode = (argc == 3 && strcmp(argv[2], "--watch") == 0);
-
     init_utils();
+    init_roots();
     SetConsoleCtrlHandler(console_ctrl_handler, TRUE);
 
-    // Initialize IPC pipe server once; it persists across directory changes
-    if (!init_pipe_server()) {
-        safe_printf("[WARNING] Failed to initialize IPC server. GUI alerts will not work.\n");
+    // A batch audit needs none of the index, digest store or IPC server
+    if (audit_mode) {
+        size_t budget = g_index_memory_budget ? g_index_memory_budget : AUDIT_DEFAULT_BUDGET;
+        BOOL audited = run_batch_audit(directories, directory_count, budget);
+        free_roots();
+        cleanup_utils();
+        return audited ? 0 : 1;
     }
 
-    g_hash_table = NULL;   // run_scan_and_watch creates it
-
-    // Main run loop – re-enters when user requests a directory change
-    while (1) {
-        BOOL dir_changed = run_scan_and_watch(directory, watch_mode);
-
-        if (!dir_changed) break;   // normal exit or scan-only mode
+    // Digests persist across runs so resumed and repeated scans skip hashing
+    char store_path[MAX_PATH];
+    get_state_file_path(DIGEST_STORE_FILENAME, store_path, sizeof(store_path));
+    if (!digest_store_open(store_path)) {
+        safe_printf("[WARNING] Digest store unavailable. Every scan will rehash all files.\n");
+    }
 
-        // Pick up the new directory from scanner globals
-        strncpy(directory, (const char*)g_pending_dir, MAX_PATH - 1);
-        directory[MAX_PATH - 1] = '\0';
-        g_dir_change_pending = FALSE;
+    // Directory summaries let start-up skip subtrees that have not changed
+    if (!full_rescan && g_digest_store) {
+        char summary_path[MAX_PATH];
+        get_state_file_path(DIR_SUMMARY_FILENAME, summary_path, sizeof(summary_path));
+        dir_summary_open(summary_path);
+    }
 
-        safe_printf("[MAIN] Restarting with new directory: %s\n", directory);
+    // Initialize IPC pipe server once; it persists across directory changes
+    if (!init_pipe_server()) {
+        safe_printf("[WARNING] Failed to initialize IPC server. GUI alerts will not work.\n");
     }
 
+    run_scan_and_watch(directories, references, directory_count, watch_mode);
+
     // Cleanup
     shutdown_pipe_server();
-    if (g_hash_table) {
-        free_hash_table(g_hash_table);
-        g_hash_table = NULL;
-    }
-    free_empty_files_list();
+    free_hash_table(hash_table_swap(NULL));
+    free_roots();
+    dir_summary_close();
+    digest_store_close();
     cleanup_utils();
 
     safe_printf("\nProgram terminated.\n");
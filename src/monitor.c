@@ -1,20 +1,18 @@
 //monitor.c
 #include "monitor.h"
+#include "roots.h"
 #include "scanner.h"
 #include "hash_table.h"
 #include "file_ops.h"
-#include "empty_files.h"
+#include "digest_store.h"
+#include "visited_set.h"
 #include "ipc_pipe.h"
 #include "utils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <wchar.h>
 #include <windows.h>
 
-// Global stop event for clean termination
-static HANDLE g_stop_event = NULL;
-static CRITICAL_SECTION g_stop_event_lock;
-static BOOL g_monitor_initialized = FALSE;
-
 // Helper function to count files in a directory (non-recursive)
 static int count_files_in_directory(const char *dir_path) {
     WIN32_FIND_DATA find_data;
@@ -75,11 +73,32 @@ static BOOL wait_for_directory_stable(const char *dir_path, int max_wait_seconds
     return TRUE;
 }
 
-// Helper function to recursively scan a newly created/copied directory
-static void scan_new_directory(const char *dir_path) {
+// Helper function to recursively scan a newly created/copied directory.
+// Plain directories are always entered (a moved-in tree keeps its identity);
+// links are entered only if no root has scanned their target yet.
+static void scan_new_directory_walk(MonitorRoot *root, const char *dir_path,
+                                    BOOL is_link, VisitedSet *walk) {
     WIN32_FIND_DATA find_data;
     HANDLE hFind;
     char search_path[MAX_PATH];
+    DirIdentity identity;
+    uint64_t dir_mtime;
+
+    if (is_link && g_reparse_policy == REPARSE_SKIP) {
+        safe_printf("[SKIP] %s (link not followed)\n", dir_path);
+        return;
+    }
+    if (get_directory_identity(dir_path, &identity, &dir_mtime) == 0) {
+        if (!visited_insert(walk, &identity)) {
+            return;   // Loop within this walk
+        }
+        if (is_link && !roots_claim_directory(root, &identity)) {
+            safe_printf("[LINK] %s was already scanned through another path, skipping\n",
+                        dir_path);
+            return;
+        }
+        visited_insert(&root->visited, &identity);
+    }
     
     snprintf(search_path, MAX_PATH, "%s\\*", dir_path);
     
@@ -99,11 +118,11 @@ static void scan_new_directory(const char *dir_path) {
         
         if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
             // Recursively scan subdirectories
-            scan_new_directory(full_path);
+            scan_new_directory_walk(root, full_path, is_link_entry(&find_data), walk);
         } else {
             // Process file
             if (!should_ignore_file(find_data.cFileName)) {
-                process_file(full_path, "ADDED");
+                process_file(root->table, full_path, "ADDED");
             }
         }
     } while (FindNextFile(hFind, &find_data));
@@ -111,7 +130,14 @@ static void scan_new_directory(const char *dir_path) {
     FindClose(hFind);
 }
 
-static void scan_for_new_files_in_dir(const char *dir_path) {
+static void scan_new_directory(MonitorRoot *root, const char *dir_path) {
+    VisitedSet walk;
+    visited_init(&walk);
+    scan_new_directory_walk(root, dir_path, is_link_path(dir_path), &walk);
+    visited_free(&walk);
+}
+
+static void scan_for_new_files_in_dir(MonitorRoot *root, const char *dir_path) {
     WIN32_FIND_DATA find_data;
     char search_path[MAX_PATH];
     snprintf(search_path, MAX_PATH, "%s\\*", dir_path);
@@ -130,9 +156,9 @@ static void scan_for_new_files_in_dir(const char *dir_path) {
 
         // Only process files not already in the hash table — these are the
         // rename targets that Windows never sent a RENAMED_NEW event for.
-        if (!filepath_in_hash_table(g_hash_table, full_path)) {
+        if (!filepath_in_hash_table(root->table, full_path)) {
             Sleep(50);
-            process_file(full_path, "RENAMED TO");
+            process_file(root->table, full_path, "RENAMED TO");
         }
     } while (FindNextFile(hFind, &find_data));
 
@@ -140,16 +166,13 @@ static void scan_for_new_files_in_dir(const char *dir_path) {
 }
 
 DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
-    const char *dir_path = (const char*)lpParam;
-    
-    // Initialize stop event lock
-    InitializeCriticalSection(&g_stop_event_lock);
-    
-    // Create stop event
-    EnterCriticalSection(&g_stop_event_lock);
-    g_stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
-    g_monitor_initialized = TRUE;
-    LeaveCriticalSection(&g_stop_event_lock);
+    MonitorRoot *root = (MonitorRoot*)lpParam;
+    const char *dir_path = root->path;
+
+    // An archive's changes only keep the index current, nothing waits on them
+    if (root->reference) {
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    }
     
     HANDLE hDir = CreateFile(
         dir_path,
@@ -163,31 +186,30 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
     
     if (hDir == INVALID_HANDLE_VALUE) {
         safe_printf("Failed to open directory for monitoring: %s\n", dir_path);
-        EnterCriticalSection(&g_stop_event_lock);
-        if (g_stop_event) {
-            CloseHandle(g_stop_event);
-            g_stop_event = NULL;
-        }
-        g_monitor_initialized = FALSE;
-        LeaveCriticalSection(&g_stop_event_lock);
-        DeleteCriticalSection(&g_stop_event_lock);
         return 1;
     }
     
-    safe_printf("\n=== File System Monitor Started ===\n");
-    safe_printf("Watching for changes during scan and after...\n\n");
-    
     // 65536 bytes — large enough to absorb bursts of events from indexers/AV
     // without triggering ERROR_NOTIFY_ENUM_DIR (buffer-overflow) drops.
-    // Declared static so it lives in the data segment, not the stack.
-    static char buffer[65536];
+    // Heap-allocated per root so it stays off the stack and each monitor
+    // thread has its own.
+    const DWORD buffer_size = 65536;
+    char *buffer = malloc(buffer_size);
+    if (!buffer) {
+        CloseHandle(hDir);
+        return 1;
+    }
+    
+    safe_printf("\n=== File System Monitor Started: %s ===\n", dir_path);
+    safe_printf("Watching for changes during scan and after...\n\n");
+    
     DWORD bytes_returned;
     OVERLAPPED overlapped = {0};
     overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     
     BOOL pending_read = FALSE;
     
-    while (!g_stop_monitoring) {
+    while (!g_stop_monitoring && !root->stopping) {
         if (!pending_read) {
             ResetEvent(overlapped.hEvent);
             
@@ -195,7 +217,7 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
             BOOL result = ReadDirectoryChangesW(
                 hDir,
                 buffer,
-                sizeof(buffer),
+                buffer_size,
                 TRUE,
                 FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | 
                 FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE,
@@ -215,10 +237,10 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
         }
         
         // Wait for either file system change or stop signal
-        HANDLE handles[2] = { overlapped.hEvent, g_stop_event };
+        HANDLE handles[2] = { overlapped.hEvent, root->stop_event };
         DWORD waitResult = WaitForMultipleObjects(2, handles, FALSE, 500);
         
-        if (waitResult == WAIT_OBJECT_0 + 1 || g_stop_monitoring) {
+        if (waitResult == WAIT_OBJECT_0 + 1 || g_stop_monitoring || root->stopping) {
             // Stop event signaled - cancel pending operation
             if (pending_read) {
                 CancelIo(hDir);
@@ -290,18 +312,18 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
                     switch (fni->Action) {
                         case FILE_ACTION_RENAMED_OLD_NAME:
                             safe_printf("[RENAMED FROM] %s\n", full_path);
-                            remove_file_from_table(g_hash_table, full_path);
-                            remove_empty_file(full_path);
+                            remove_file_from_table(root->table, full_path);
                             remove_filepath_from_ipc_groups(full_path);
+                            digest_store_remove(full_path);
                             break;
 
                         case FILE_ACTION_REMOVED: {
                             DWORD attrs = GetFileAttributes(full_path);
                             if (attrs == INVALID_FILE_ATTRIBUTES) {
                                 safe_printf("[DELETED] %s\n", full_path);
-                                remove_file_from_table(g_hash_table, full_path);
-                                remove_empty_file(full_path);
+                                remove_file_from_table(root->table, full_path);
                                 remove_filepath_from_ipc_groups(full_path);
+                                digest_store_remove(full_path);
                             }
                             break;
                         }
@@ -313,9 +335,9 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
                             DWORD attrs = GetFileAttributes(full_path);
                             if (attrs == INVALID_FILE_ATTRIBUTES) {
                                 safe_printf("[RENAMED FROM] %s\n", full_path);
-                                remove_file_from_table(g_hash_table, full_path);
-                                remove_empty_file(full_path);
+                                remove_file_from_table(root->table, full_path);
                                 remove_filepath_from_ipc_groups(full_path);
+                                digest_store_remove(full_path);
                             }
                             break;
                         }
@@ -330,6 +352,9 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
             } while (1);
 
             // ── PASS 2: additions / modifications ────────────────────────────
+            // A rename arrives as OLD_NAME then NEW_NAME; remember the old
+            // path so a renamed directory can be relinked instead of rescanned.
+            char rename_from[MAX_PATH] = "";
             fni = (FILE_NOTIFY_INFORMATION*)buffer;
             do {
                 WCHAR filename_w[MAX_PATH];
@@ -355,14 +380,14 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
                                     safe_printf("[DIRECTORY ADDED] %s - Waiting for copy to complete...\n", full_path);
                                     if (wait_for_directory_stable(full_path, 60)) {
                                         safe_printf("[DIRECTORY STABLE] %s - Scanning contents...\n", full_path);
-                                        scan_new_directory(full_path);
+                                        scan_new_directory(root, full_path);
                                     } else {
                                         safe_printf("[DIRECTORY TIMEOUT] %s - Scanning anyway...\n", full_path);
-                                        scan_new_directory(full_path);
+                                        scan_new_directory(root, full_path);
                                     }
                                 } else {
                                     Sleep(100);
-                                    process_file(full_path, "ADDED");
+                                    process_file(root->table, full_path, "ADDED");
                                 }
                             }
                             break;
@@ -377,34 +402,44 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
                                 // The old name was already removed in pass 1, so
                                 // files[0] is already the correct promoted trigger.
                                 Sleep(100);
-                                scan_for_new_files_in_dir(full_path);
+                                scan_for_new_files_in_dir(root, full_path);
                             } else {
                                 Sleep(100);
                                 safe_printf("[MODIFIED] %s - Reprocessing...\n", full_path);
-                                remove_file_from_table(g_hash_table, full_path);
-                                remove_empty_file(full_path);
-                                process_file(full_path, "MODIFIED");
+                                remove_file_from_table(root->table, full_path);
+                                process_file(root->table, full_path, "MODIFIED");
                             }
                             break;
                         }
 
+                        case FILE_ACTION_RENAMED_OLD_NAME:
+                            strcpy(rename_from, full_path);
+                            break;
+
                         case FILE_ACTION_RENAMED_NEW_NAME: {
                             DWORD attrs = GetFileAttributes(full_path);
                             if (attrs != INVALID_FILE_ATTRIBUTES) {
-                                if (attrs & FILE_ATTRIBUTE_DIRECTORY) {
+                                if ((attrs & FILE_ATTRIBUTE_DIRECTORY) && rename_from[0] &&
+                                    hash_table_rename_directory(root->table, rename_from, full_path)) {
+                                    // Same files under a new name: nothing to rehash
+                                    safe_printf("[DIRECTORY RENAMED] %s -> %s\n", rename_from, full_path);
+                                    rename_ipc_group_paths(rename_from, full_path);
+                                    digest_store_rename_under(rename_from, full_path);
+                                } else if (attrs & FILE_ATTRIBUTE_DIRECTORY) {
                                     safe_printf("[DIRECTORY RENAMED TO] %s - Waiting for stability...\n", full_path);
                                     if (wait_for_directory_stable(full_path, 60)) {
                                         safe_printf("[DIRECTORY STABLE] %s - Scanning contents...\n", full_path);
-                                        scan_new_directory(full_path);
+                                        scan_new_directory(root, full_path);
                                     } else {
                                         safe_printf("[DIRECTORY TIMEOUT] %s - Scanning anyway...\n", full_path);
-                                        scan_new_directory(full_path);
+                                        scan_new_directory(root, full_path);
                                     }
                                 } else {
                                     Sleep(100);
-                                    process_file(full_path, "RENAMED TO");
+                                    process_file(root->table, full_path, "RENAMED TO");
                                 }
                             }
+                            rename_from[0] = '\0';
                             break;
                         }
 
@@ -427,25 +462,13 @@ DWORD WINAPI monitor_thread_func(LPVOID lpParam) {
     
     CloseHandle(overlapped.hEvent);
     CloseHandle(hDir);
+    free(buffer);
     
-    EnterCriticalSection(&g_stop_event_lock);
-    if (g_stop_event) {
-        CloseHandle(g_stop_event);
-        g_stop_event = NULL;
-    }
-    g_monitor_initialized = FALSE;
-    LeaveCriticalSection(&g_stop_event_lock);
-    DeleteCriticalSection(&g_stop_event_lock);
-    
-    safe_printf("\n=== File System Monitor Stopped ===\n");
+    safe_printf("\n=== File System Monitor Stopped: %s ===\n", dir_path);
     return 0;
 }
 
-// Function to signal monitor thread to stop
+// Function to signal every monitor thread to stop
 void signal_monitor_stop(void) {
-    EnterCriticalSection(&g_stop_event_lock);
-    if (g_stop_event && g_monitor_initialized) {
-        SetEvent(g_stop_event);
-    }
-    LeaveCriticalSection(&g_stop_event_lock);
+    roots_signal_stop_all();
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+//path_arena.c
+#include "path_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Compact only when at least this many dead bytes have built up, so a
+// small table does not rebuild on every few deletes
+#define PATH_ARENA_MIN_DEAD (4 * PATH_ARENA_BLOCK_SIZE)
+
+void path_arena_init(PathArena *arena) {
+    memset(arena, 0, sizeof(PathArena));
+}
+
+char* path_arena_store(PathArena *arena, const char *path) {
+    return path_arena_store_len(arena, path, strlen(path));
+}
+
+char* path_arena_store_len(PathArena *arena, const char *text, size_t text_len) {
+    size_t len = text_len + 1;
+    PathArenaBlock *block = arena->blocks;
+
+    if (!block || block->size - block->used < len) {
+        size_t size = len > PATH_ARENA_BLOCK_SIZE ? len : PATH_ARENA_BLOCK_SIZE;
+        PathArenaBlock *fresh = malloc(sizeof(PathArenaBlock) + size);
+        if (!fresh) return NULL;
+        fresh->size = size;
+        fresh->used = 0;
+        fresh->next = arena->blocks;
+        arena->blocks = fresh;
+        arena->block_count++;
+        block = fresh;
+    }
+
+    char *copy = block->data + block->used;
+    memcpy(copy, text, text_len);
+    copy[text_len] = '\0';
+    block->used += len;
+    arena->live_bytes += len;
+    return copy;
+}
+
+void path_arena_release(PathArena *arena, const char *path) {
+    size_t len = strlen(path) + 1;
+    arena->live_bytes -= len;
+    arena->dead_bytes += len;
+}
+
+BOOL path_arena_wants_compaction(const PathArena *arena) {
+    return arena->dead_bytes >= PATH_ARENA_MIN_DEAD &&
+           arena->dead_bytes > arena->live_bytes;
+}
+
+PathArenaBlock* path_arena_detach(PathArena *arena) {
+    PathArenaBlock *blocks = arena->blocks;
+    path_arena_init(arena);
+    return blocks;
+}
+
+void path_arena_free_blocks(PathArenaBlock *blocks) {
+    while (blocks) {
+        PathArenaBlock *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+}
+
+void path_arena_free(PathArena *arena) {
+    path_arena_free_blocks(arena->blocks);
+    path_arena_init(arena);
+}
@@ -0,0 +1,616 @@
+//path_tree.c
+#include "path_tree.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A component being looked up: not yet a node, so compared field by field
+typedef struct ComponentKey {
+    uint32_t parent;
+    const char *name;
+    size_t len;
+} ComponentKey;
+
+static uint64_t component_hash(uint32_t parent, const char *name, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ parent;
+    hash *= 0x100000001b3ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Digest lanes are kept apart by seeding each from a different constant
+static void name_weight(const char *name, size_t len, uint64_t *weight) {
+    uint64_t hash = component_hash(PATH_TREE_NONE, name, len);
+    weight[0] = mix64(hash ^ 0x9e3779b97f4a7c15ULL) | 1;
+    weight[1] = mix64(hash ^ 0xc2b2ae3d27d4eb4fULL) | 1;
+}
+
+static void file_leaf(const char *name, const uint8_t *content, size_t content_len,
+                      uint64_t *leaf) {
+    // Fold the content digest into two words, alternating 8-byte words
+    uint64_t words[2] = { 0, 0 };
+    for (size_t i = 0; i + 8 <= content_len; i += 8) {
+        uint64_t word;
+        memcpy(&word, content + i, sizeof(word));
+        words[(i / 8) & 1] = mix64(words[(i / 8) & 1] ^ word);
+    }
+    uint64_t hash = component_hash(PATH_TREE_NONE - 1, name, strlen(name));
+    leaf[0] = mix64(words[0] ^ hash);
+    leaf[1] = mix64(words[1] ^ mix64(hash));
+}
+
+static BOOL component_matches(uint32_t value, const void *key, void *ctx) {
+    const PathNode *node = &((PathTree*)ctx)->nodes[value];
+    const ComponentKey *k = (const ComponentKey*)key;
+    return node->parent == k->parent && node->name_len == k->len &&
+           memcmp(node->name, k->name, k->len) == 0;
+}
+
+static uint64_t component_rehash(uint32_t value, void *ctx) {
+    return ((PathTree*)ctx)->nodes[value].hash;
+}
+
+BOOL path_tree_init(PathTree *tree) {
+    memset(tree, 0, sizeof(PathTree));
+    InitializeSRWLock(&tree->lock);
+    tree->first_root = PATH_TREE_NONE;
+    path_arena_init(&tree->names);
+    return flat_index_init(&tree->children, 0);
+}
+
+void path_tree_free(PathTree *tree) {
+    free(tree->nodes);
+    flat_index_free(&tree->children);
+    path_arena_free(&tree->names);
+    memset(tree, 0, sizeof(PathTree));
+}
+
+static uint32_t* child_list(PathTree *tree, uint32_t parent) {
+    return parent != PATH_TREE_NONE ? &tree->nodes[parent].first_child : &tree->first_root;
+}
+
+// Put id at the head of its parent's child list (lock held exclusively)
+static void link_sibling(PathTree *tree, uint32_t id) {
+    PathNode *node = &tree->nodes[id];
+    uint32_t *head = child_list(tree, node->parent);
+    node->prev_sibling = PATH_TREE_NONE;
+    node->next_sibling = *head;
+    if (*head != PATH_TREE_NONE) tree->nodes[*head].prev_sibling = id;
+    *head = id;
+}
+
+static void unlink_sibling(PathTree *tree, uint32_t id) {
+    PathNode *node = &tree->nodes[id];
+    if (node->prev_sibling != PATH_TREE_NONE) {
+        tree->nodes[node->prev_sibling].next_sibling = node->next_sibling;
+    } else {
+        *child_list(tree, node->parent) = node->next_sibling;
+    }
+    if (node->next_sibling != PATH_TREE_NONE) {
+        tree->nodes[node->next_sibling].prev_sibling = node->prev_sibling;
+    }
+}
+
+static uint32_t find_child(PathTree *tree, uint32_t parent, const char *name, size_t len) {
+    ComponentKey key = { parent, name, len };
+    return flat_index_find(&tree->children, component_hash(parent, name, len),
+                           component_matches, &key, tree);
+}
+
+// Add one component below parent (lock held exclusively)
+static uint32_t add_child(PathTree *tree, uint32_t parent, const char *name, size_t len) {
+    if (tree->count == tree->capacity) {
+        uint32_t capacity = tree->capacity ? tree->capacity * 2 : 1024;
+        PathNode *grown = realloc(tree->nodes, sizeof(PathNode) * capacity);
+        if (!grown) return PATH_TREE_NONE;
+        tree->nodes = grown;
+        tree->capacity = capacity;
+    }
+
+    const char *copy = path_arena_store_len(&tree->names, name, len);
+    if (!copy) return PATH_TREE_NONE;
+
+    uint32_t id = tree->count;
+    PathNode *node = &tree->nodes[id];
+    node->parent = parent;
+    node->name = copy;
+    node->name_len = (uint32_t)len;
+    node->hash = component_hash(parent, name, len);
+    node->entries = 0;
+    node->children = 0;
+    node->first_child = PATH_TREE_NONE;
+    node->dup_files = 0;
+    node->dup_bytes = 0;
+    name_weight(name, len, node->weight);
+    node->digest[0] = node->digest[1] = 0;
+    node->files = 0;
+    node->bytes = 0;
+    node->reference = parent != PATH_TREE_NONE && tree->nodes[parent].reference;
+    if (!flat_index_insert(&tree->children, node->hash, id, component_rehash, tree)) {
+        return PATH_TREE_NONE;
+    }
+    // Nobody else is inside while the lock is exclusive
+    flat_index_reclaim(&tree->children);
+
+    tree->count++;
+    link_sibling(tree, id);
+    if (parent != PATH_TREE_NONE) {
+        tree->nodes[parent].children++;
+    }
+    return id;
+}
+
+// Walk dir_path component by component, optionally adding missing ones
+static uint32_t walk(PathTree *tree, const char *dir_path, size_t len, BOOL create) {
+    uint32_t node = PATH_TREE_NONE;
+    size_t start = 0;
+    for (;;) {
+        size_t end = start;
+        while (end < len && dir_path[end] != '\\') end++;
+
+        uint32_t child = find_child(tree, node, dir_path + start, end - start);
+        if (child == PATH_TREE_NONE) {
+            if (!create) return PATH_TREE_NONE;
+            child = add_child(tree, node, dir_path + start, end - start);
+            if (child == PATH_TREE_NONE) return PATH_TREE_NONE;
+        }
+        node = child;
+
+        if (end >= len) return node;
+        start = end + 1;
+    }
+}
+
+uint32_t path_tree_find(PathTree *tree, const char *dir_path, size_t len) {
+    AcquireSRWLockShared(&tree->lock);
+    uint32_t node = walk(tree, dir_path, len, FALSE);
+    ReleaseSRWLockShared(&tree->lock);
+    return node;
+}
+
+uint32_t path_tree_intern(PathTree *tree, const char *dir_path, size_t len) {
+    // Almost always already there: files arrive a directory at a time
+    uint32_t node = path_tree_find(tree, dir_path, len);
+    if (node != PATH_TREE_NONE) return node;
+
+    AcquireSRWLockExclusive(&tree->lock);
+    node = walk(tree, dir_path, len, TRUE);
+    ReleaseSRWLockExclusive(&tree->lock);
+    return node;
+}
+
+size_t path_tree_format(PathTree *tree, uint32_t node, char *buffer, size_t size) {
+    AcquireSRWLockShared(&tree->lock);
+
+    size_t length = 0;
+    for (uint32_t n = node; n != PATH_TREE_NONE; n = tree->nodes[n].parent) {
+        length += tree->nodes[n].name_len;
+        if (tree->nodes[n].parent != PATH_TREE_NONE) length++;
+    }
+
+    if (node == PATH_TREE_NONE || length + 1 > size) {
+        length = 0;
+    } else {
+        // Fill from the end, leaf first
+        buffer[length] = '\0';
+        size_t end = length;
+        for (uint32_t n = node; n != PATH_TREE_NONE; n = tree->nodes[n].parent) {
+            const PathNode *p = &tree->nodes[n];
+            end -= p->name_len;
+            memcpy(buffer + end, p->name, p->name_len);
+            if (p->parent != PATH_TREE_NONE) buffer[--end] = '\\';
+        }
+    }
+
+    ReleaseSRWLockShared(&tree->lock);
+    return length;
+}
+
+static BOOL is_under_locked(PathTree *tree, uint32_t node, uint32_t ancestor) {
+    for (uint32_t n = node; n != PATH_TREE_NONE; n = tree->nodes[n].parent) {
+        if (n == ancestor) return TRUE;
+    }
+    return FALSE;
+}
+
+BOOL path_tree_is_under(PathTree *tree, uint32_t node, uint32_t ancestor) {
+    AcquireSRWLockShared(&tree->lock);
+    BOOL under = is_under_locked(tree, node, ancestor);
+    ReleaseSRWLockShared(&tree->lock);
+    return under;
+}
+
+// Set the reference mark on id's whole subtree, walking the child lists
+// without a stack (lock held exclusively)
+static void mark_subtree(PathTree *tree, uint32_t id, BOOL reference) {
+    uint32_t n = id;
+    for (;;) {
+        tree->nodes[n].reference = reference;
+        if (tree->nodes[n].first_child != PATH_TREE_NONE) {
+            n = tree->nodes[n].first_child;
+            continue;
+        }
+        while (n != id && tree->nodes[n].next_sibling == PATH_TREE_NONE) {
+            n = tree->nodes[n].parent;
+        }
+        if (n == id) return;
+        n = tree->nodes[n].next_sibling;
+    }
+}
+
+BOOL path_tree_set_reference(PathTree *tree, const char *dir_path, size_t len, BOOL reference) {
+    uint32_t node = path_tree_intern(tree, dir_path, len);
+    if (node == PATH_TREE_NONE) return FALSE;
+    AcquireSRWLockExclusive(&tree->lock);
+    mark_subtree(tree, node, reference);
+    ReleaseSRWLockExclusive(&tree->lock);
+    return TRUE;
+}
+
+BOOL path_tree_is_reference(PathTree *tree, uint32_t node) {
+    if (node == PATH_TREE_NONE) return FALSE;
+    AcquireSRWLockShared(&tree->lock);
+    BOOL reference = tree->nodes[node].reference;
+    ReleaseSRWLockShared(&tree->lock);
+    return reference;
+}
+
+void path_tree_add_entries(PathTree *tree, uint32_t node, LONG delta) {
+    if (node == PATH_TREE_NONE) return;
+    AcquireSRWLockShared(&tree->lock);
+    InterlockedExchangeAdd(&tree->nodes[node].entries, delta);
+    ReleaseSRWLockShared(&tree->lock);
+}
+
+void path_tree_add_duplicates(PathTree *tree, uint32_t node, LONG files, LONGLONG bytes) {
+    AcquireSRWLockShared(&tree->lock);
+    for (uint32_t n = node; n != PATH_TREE_NONE; n = tree->nodes[n].parent) {
+        InterlockedExchangeAdd64(&tree->nodes[n].dup_files, files);
+        InterlockedExchangeAdd64(&tree->nodes[n].dup_bytes, bytes);
+    }
+    ReleaseSRWLockShared(&tree->lock);
+}
+
+void path_tree_add_file(PathTree *tree, uint32_t node, const char *name,
+                        const uint8_t *content, size_t content_len, uint64_t size, LONG sign) {
+    if (node == PATH_TREE_NONE) return;
+    uint64_t term[2];
+    file_leaf(name, content, content_len, term);
+
+    AcquireSRWLockShared(&tree->lock);
+    for (uint32_t n = node; n != PATH_TREE_NONE; n = tree->nodes[n].parent) {
+        PathNode *p = &tree->nodes[n];
+        for (int lane = 0; lane < 2; lane++) {
+            InterlockedExchangeAdd64(&p->digest[lane],
+                                     (LONGLONG)(sign > 0 ? term[lane] : 0 - term[lane]));
+            term[lane] *= p->weight[lane];
+        }
+        InterlockedExchangeAdd64(&p->files, sign);
+        InterlockedExchangeAdd64(&p->bytes, sign * (LONGLONG)size);
+    }
+    ReleaseSRWLockShared(&tree->lock);
+}
+
+// Move a subtree's digest and totals onto or off the directories above it
+// (lock held exclusively)
+static void carry_totals(PathTree *tree, uint32_t id, LONGLONG sign) {
+    const PathNode *node = &tree->nodes[id];
+    uint64_t term[2];
+    for (int lane = 0; lane < 2; lane++) {
+        term[lane] = (uint64_t)node->digest[lane] * node->weight[lane];
+        if (sign < 0) term[lane] = 0 - term[lane];
+    }
+    for (uint32_t n = node->parent; n != PATH_TREE_NONE; n = tree->nodes[n].parent) {
+        PathNode *p = &tree->nodes[n];
+        p->dup_files += sign * node->dup_files;
+        p->dup_bytes += sign * node->dup_bytes;
+        p->files += sign * node->files;
+        p->bytes += sign * node->bytes;
+        for (int lane = 0; lane < 2; lane++) {
+            p->digest[lane] = (LONGLONG)((uint64_t)p->digest[lane] + term[lane]);
+            term[lane] *= p->weight[lane];
+        }
+    }
+}
+
+// Take a node out of the child index and its parent's list (lock held
+// exclusively)
+static void unlink_node(PathTree *tree, uint32_t id) {
+    PathNode *node = &tree->nodes[id];
+    unlink_sibling(tree, id);
+    flat_index_erase(&tree->children, node->hash, id, component_rehash, tree);
+    if (node->parent != PATH_TREE_NONE) {
+        tree->nodes[node->parent].children--;
+    }
+}
+
+BOOL path_tree_rename(PathTree *tree, const char *old_path, const char *new_path) {
+    const char *sep = strrchr(new_path, '\\');
+    if (!sep) return FALSE;
+    const char *name = sep + 1;
+    size_t name_len = strlen(name);
+
+    // Takes the lock itself; any components it adds stay if the rename fails
+    uint32_t new_parent = path_tree_intern(tree, new_path, (size_t)(sep - new_path));
+    if (new_parent == PATH_TREE_NONE) return FALSE;
+
+    AcquireSRWLockExclusive(&tree->lock);
+
+    uint32_t id = walk(tree, old_path, strlen(old_path), FALSE);
+    BOOL ok = id != PATH_TREE_NONE && !is_under_locked(tree, new_parent, id);
+
+    if (ok) {
+        uint32_t existing = find_child(tree, new_parent, name, name_len);
+        if (existing == id) {
+            ReleaseSRWLockExclusive(&tree->lock);
+            return TRUE;
+        }
+        if (existing != PATH_TREE_NONE) {
+            // A directory seen there before: only an empty one can be replaced
+            const PathNode *target = &tree->nodes[existing];
+            if (target->entries == 0 && target->children == 0) {
+                unlink_node(tree, existing);
+            } else {
+                ok = FALSE;
+            }
+        }
+    }
+
+    const char *copy = ok ? path_arena_store_len(&tree->names, name, name_len) : NULL;
+    if (copy) {
+        carry_totals(tree, id, -1);
+        unlink_node(tree, id);
+        PathNode *node = &tree->nodes[id];
+        node->parent = new_parent;
+        node->name = copy;
+        node->name_len = (uint32_t)name_len;
+        node->hash = component_hash(new_parent, name, name_len);
+        name_weight(name, name_len, node->weight);
+        flat_index_insert(&tree->children, node->hash, id, component_rehash, tree);
+        flat_index_reclaim(&tree->children);
+        tree->nodes[new_parent].children++;
+        link_sibling(tree, id);
+        carry_totals(tree, id, 1);
+        // Moved into or out of a reference root
+        if (node->reference != tree->nodes[new_parent].reference) {
+            mark_subtree(tree, id, tree->nodes[new_parent].reference);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&tree->lock);
+    return copy != NULL;
+}
+
+// Node's path and totals (lock held)
+static void fill_rollup(PathTree *tree, uint32_t id, PathRollup *rollup) {
+    // Same walk as path_tree_format, which would take the lock again
+    size_t length = 0;
+    for (uint32_t n = id; n != PATH_TREE_NONE; n = tree->nodes[n].parent) {
+        length += tree->nodes[n].name_len + (tree->nodes[n].parent != PATH_TREE_NONE);
+    }
+    if (length + 1 > sizeof(rollup->path)) {
+        rollup->path[0] = '\0';
+    } else {
+        rollup->path[length] = '\0';
+        for (uint32_t n = id; n != PATH_TREE_NONE; n = tree->nodes[n].parent) {
+            const PathNode *p = &tree->nodes[n];
+            length -= p->name_len;
+            memcpy(rollup->path + length, p->name, p->name_len);
+            if (p->parent != PATH_TREE_NONE) rollup->path[--length] = '\\';
+        }
+    }
+    rollup->duplicate_files = (uint64_t)tree->nodes[id].dup_files;
+    rollup->duplicate_bytes = (uint64_t)tree->nodes[id].dup_bytes;
+}
+
+int path_tree_rollup(PathTree *tree, const char *dir_path, size_t len,
+                     PathRollup *self, PathRollup *children, int max) {
+    AcquireSRWLockShared(&tree->lock);
+
+    uint32_t id = PATH_TREE_NONE;
+    if (len > 0) {
+        id = walk(tree, dir_path, len, FALSE);
+        if (id == PATH_TREE_NONE) {
+            ReleaseSRWLockShared(&tree->lock);
+            return -1;
+        }
+    }
+    uint32_t first = id != PATH_TREE_NONE ? tree->nodes[id].first_child : tree->first_root;
+
+    // Whole tree: the sum of the top-level directories
+    memset(self, 0, sizeof(PathRollup));
+    if (id != PATH_TREE_NONE) {
+        fill_rollup(tree, id, self);
+    } else {
+        for (uint32_t c = first; c != PATH_TREE_NONE; c = tree->nodes[c].next_sibling) {
+            self->duplicate_files += tree->nodes[c].dup_files;
+            self->duplicate_bytes += tree->nodes[c].dup_bytes;
+        }
+    }
+
+    // Keep the max largest children, sorted, by insertion
+    uint32_t *picked = max > 0 ? malloc(sizeof(uint32_t) * max) : NULL;
+    int count = 0;
+    for (uint32_t c = first; picked && c != PATH_TREE_NONE; c = tree->nodes[c].next_sibling) {
+        LONGLONG bytes = tree->nodes[c].dup_bytes;
+        if (bytes <= 0 || (count == max && bytes <= tree->nodes[picked[count - 1]].dup_bytes)) {
+            continue;
+        }
+        int pos = count < max ? count++ : max - 1;
+        while (pos > 0 && tree->nodes[picked[pos - 1]].dup_bytes < bytes) {
+            picked[pos] = picked[pos - 1];
+            pos--;
+        }
+        picked[pos] = c;
+    }
+    for (int i = 0; i < count; i++) {
+        fill_rollup(tree, picked[i], &children[i]);
+    }
+
+    ReleaseSRWLockShared(&tree->lock);
+    free(picked);
+    return count;
+}
+
+// ── Duplicate directories ──────────────────────────────────────────────
+
+typedef struct DigestRow {
+    uint64_t digest[2];
+    uint64_t files;
+    uint64_t bytes;
+    uint32_t node;
+} DigestRow;
+
+static int compare_digest_rows(const void *a, const void *b) {
+    const DigestRow *x = (const DigestRow*)a, *y = (const DigestRow*)b;
+    if (x->digest[0] != y->digest[0]) return x->digest[0] < y->digest[0] ? -1 : 1;
+    if (x->digest[1] != y->digest[1]) return x->digest[1] < y->digest[1] ? -1 : 1;
+    if (x->files != y->files) return x->files < y->files ? -1 : 1;
+    if (x->bytes != y->bytes) return x->bytes < y->bytes ? -1 : 1;
+    return x->node < y->node ? -1 : x->node > y->node;
+}
+
+static BOOL same_tree(const DigestRow *x, const DigestRow *y) {
+    return x->digest[0] == y->digest[0] && x->digest[1] == y->digest[1] &&
+           x->files == y->files && x->bytes == y->bytes;
+}
+
+// Resolve covered[] for id and the unresolved directories above it: the
+// innermost group found on the way to the root wins (lock held)
+static void resolve_covered(PathTree *tree, uint32_t id, const uint32_t *member_of,
+                            uint32_t *covered, uint8_t *resolved, uint32_t *stack) {
+    uint32_t depth = 0;
+    uint32_t n = id;
+    while (n != PATH_TREE_NONE && !resolved[n]) {
+        stack[depth++] = n;
+        n = tree->nodes[n].parent;
+    }
+    uint32_t above = n != PATH_TREE_NONE ? covered[n] : 0;
+    while (depth > 0) {
+        n = stack[--depth];
+        covered[n] = member_of[n] ? member_of[n] : above;
+        resolved[n] = 1;
+        above = covered[n];
+    }
+}
+
+BOOL path_tree_duplicate_directories(PathTree *tree, uint64_t min_files,
+                                     DirectoryDuplicates *dups) {
+    memset(dups, 0, sizeof(DirectoryDuplicates));
+    AcquireSRWLockShared(&tree->lock);
+
+    uint32_t count = tree->count;
+    DigestRow *rows = malloc(sizeof(DigestRow) * (count ? count : 1));
+    uint32_t *member_of = calloc(count ? count : 1, sizeof(uint32_t));
+    uint8_t *resolved = calloc(count ? count : 1, 1);
+    uint32_t *stack = malloc(sizeof(uint32_t) * (count ? count : 1));
+    dups->covered = calloc(count ? count : 1, sizeof(uint32_t));
+    dups->nodes = malloc(sizeof(uint32_t) * (count ? count : 1));
+    dups->groups = malloc(sizeof(DirectoryGroup) * (count / 2 + 1));
+    dups->node_count = count;
+    if (!rows || !member_of || !resolved || !stack || !dups->covered ||
+        !dups->nodes || !dups->groups) {
+        ReleaseSRWLockShared(&tree->lock);
+        free(rows);
+        free(member_of);
+        free(resolved);
+        free(stack);
+        path_tree_free_duplicates(dups);
+        return FALSE;
+    }
+
+    uint32_t row_count = 0;
+    for (uint32_t id = 0; id < count; id++) {
+        const PathNode *node = &tree->nodes[id];
+        if ((uint64_t)node->files < min_files) continue;
+        DigestRow *row = &rows[row_count++];
+        row->digest[0] = (uint64_t)node->digest[0];
+        row->digest[1] = (uint64_t)node->digest[1];
+        row->files = (uint64_t)node->files;
+        row->bytes = (uint64_t)node->bytes;
+        row->node = id;
+    }
+    qsort(rows, row_count, sizeof(DigestRow), compare_digest_rows);
+
+    // Every run of two or more identical trees is a candidate group
+    uint32_t candidates = 0;
+    for (uint32_t i = 0; i < row_count;) {
+        uint32_t end = i + 1;
+        while (end < row_count && same_tree(&rows[i], &rows[end])) end++;
+        if (end - i >= 2) {
+            candidates++;
+            for (uint32_t r = i; r < end; r++) member_of[rows[r].node] = candidates;
+        }
+        i = end;
+    }
+
+    // Keep a group unless each copy's parent is a copy of something too
+    uint32_t *kept = calloc(candidates + 1, sizeof(uint32_t));
+    uint32_t node_total = 0;
+    for (uint32_t i = 0; kept && i < row_count;) {
+        uint32_t end = i + 1;
+        while (end < row_count && same_tree(&rows[i], &rows[end])) end++;
+        if (end - i >= 2) {
+            BOOL implied = TRUE;
+            for (uint32_t r = i; r < end && implied; r++) {
+                uint32_t parent = tree->nodes[rows[r].node].parent;
+                implied = parent != PATH_TREE_NONE && member_of[parent] != 0;
+            }
+            if (!implied) {
+                DirectoryGroup *group = &dups->groups[dups->group_count++];
+                group->files = rows[i].files;
+                group->bytes = rows[i].bytes;
+                group->first = node_total;
+                group->count = end - i;
+                kept[member_of[rows[i].node]] = dups->group_count;
+                for (uint32_t r = i; r < end; r++) dups->nodes[node_total++] = rows[r].node;
+            }
+        }
+        i = end;
+    }
+
+    // Members of dropped groups count as covered by whatever holds them
+    for (uint32_t id = 0; kept && id < count; id++) {
+        member_of[id] = kept[member_of[id]];
+    }
+    for (uint32_t id = 0; kept && id < count; id++) {
+        if (!resolved[id]) resolve_covered(tree, id, member_of, dups->covered, resolved, stack);
+    }
+
+    ReleaseSRWLockShared(&tree->lock);
+    free(rows);
+    free(member_of);
+    free(resolved);
+    free(stack);
+    if (!kept) {
+        path_tree_free_duplicates(dups);
+        return FALSE;
+    }
+    free(kept);
+    return TRUE;
+}
+
+void path_tree_free_duplicates(DirectoryDuplicates *dups) {
+    free(dups->groups);
+    free(dups->nodes);
+    free(dups->covered);
+    memset(dups, 0, sizeof(DirectoryDuplicates));
+}
+
+uint32_t path_tree_count(PathTree *tree) {
+    return tree->count;
+}
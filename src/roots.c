@@ -0,0 +1,413 @@
+//roots.c
+#include "roots.h"
+#include "hash_table.h"
+#include "scanner.h"
+#include "monitor.h"
+#include "ipc_pipe.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PENDING_ROOT_COMMANDS 64
+
+RootList g_roots;
+
+typedef struct PendingRootCommand {
+    RootCommand command;
+    char path[MAX_PATH];
+} PendingRootCommand;
+
+static PendingRootCommand g_pending_commands[MAX_PENDING_ROOT_COMMANDS];
+static int g_pending_count = 0;
+static CRITICAL_SECTION g_pending_lock;
+
+void init_roots(void) {
+    memset(g_roots.roots, 0, sizeof(g_roots.roots));
+    g_roots.count = 0;
+    InitializeCriticalSection(&g_roots.lock);
+    InitializeCriticalSection(&g_pending_lock);
+    g_pending_count = 0;
+}
+
+void free_roots(void) {
+    roots_stop_all();
+    DeleteCriticalSection(&g_pending_lock);
+    DeleteCriticalSection(&g_roots.lock);
+}
+
+// Strip a trailing separator so "D:\share\" and "D:\share" compare equal
+static void normalize_root_path(const char *path, char *out) {
+    strncpy(out, path, MAX_PATH - 1);
+    out[MAX_PATH - 1] = '\0';
+    size_t len = strlen(out);
+    while (len > 3 && out[len - 1] == '\\') {
+        out[--len] = '\0';
+    }
+}
+
+// TRUE if path equals dir or lies below it (case-insensitive, like NTFS)
+static BOOL path_is_within(const char *path, const char *dir) {
+    size_t len = strlen(dir);
+    if (_strnicmp(path, dir, len) != 0) return FALSE;
+    return path[len] == '\0' || path[len] == '\\' ||
+           (len > 0 && dir[len - 1] == '\\');
+}
+
+static int find_root_index(const char *path) {
+    for (int i = 0; i < g_roots.count; i++) {
+        if (_stricmp(g_roots.roots[i]->path, path) == 0) return i;
+    }
+    return -1;
+}
+
+static BOOL is_directory(const char *path) {
+    DWORD attrs = GetFileAttributes(path);
+    if (attrs == INVALID_FILE_ATTRIBUTES || !(attrs & FILE_ATTRIBUTE_DIRECTORY)) {
+        safe_printf("[ROOTS] Not a directory: %s\n", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static MonitorRoot* root_create(const char *clean, HashTable *table) {
+    MonitorRoot *root = calloc(1, sizeof(MonitorRoot));
+    if (!root) return NULL;
+    strcpy(root->path, clean);
+    root->table = table;
+    root->stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!root->stop_event) {
+        // A root that cannot be told to stop must not be started
+        safe_printf("[ROOTS] Cannot create stop event for %s (error %lu)\n",
+                    clean, GetLastError());
+        free(root);
+        return NULL;
+    }
+    visited_init(&root->visited);
+    return root;
+}
+
+MonitorRoot* roots_add(const char *path, BOOL reference) {
+    char clean[MAX_PATH];
+    normalize_root_path(path, clean);
+    if (!is_directory(clean)) return NULL;
+
+    EnterCriticalSection(&g_roots.lock);
+
+    if (g_roots.count >= MAX_ROOTS) {
+        LeaveCriticalSection(&g_roots.lock);
+        safe_printf("[ROOTS] Root limit (%d) reached, cannot add %s\n", MAX_ROOTS, clean);
+        return NULL;
+    }
+
+    // Nested roots would index the same files twice
+    for (int i = 0; i < g_roots.count; i++) {
+        const char *existing = g_roots.roots[i]->path;
+        if (path_is_within(clean, existing) || path_is_within(existing, clean)) {
+            LeaveCriticalSection(&g_roots.lock);
+            safe_printf("[ROOTS] %s overlaps existing root %s\n", clean, existing);
+            return NULL;
+        }
+    }
+
+    MonitorRoot *root = root_create(clean, g_hash_table);
+    if (root) {
+        root->reference = reference;
+        g_roots.roots[g_roots.count++] = root;
+    }
+
+    LeaveCriticalSection(&g_roots.lock);
+
+    // Before its threads start, so no file of it is ever alerted on
+    if (root && reference && !hash_table_set_reference(root->table, clean, TRUE)) {
+        safe_printf("[ROOTS] Out of memory marking reference root %s\n", clean);
+    }
+    return root;
+}
+
+MonitorRoot* roots_stage(const char *path, HashTable *table) {
+    char clean[MAX_PATH];
+    normalize_root_path(path, clean);
+    if (!is_directory(clean)) return NULL;
+
+    MonitorRoot *root = root_create(clean, table);
+    if (!root) return NULL;
+    root->reuse_from = g_hash_table;
+
+    // A live root's entries stay current through its monitor, so whatever
+    // it has covered can be copied as is
+    EnterCriticalSection(&g_roots.lock);
+    for (int i = 0; i < g_roots.count; i++) {
+        MonitorRoot *live = g_roots.roots[i];
+        if (!live->covered) continue;
+        if (path_is_within(clean, live->path)) {
+            strcpy(root->reused[root->reused_count++], clean);
+            break;
+        }
+        if (path_is_within(live->path, clean)) {
+            strcpy(root->reused[root->reused_count++], live->path);
+        }
+    }
+    LeaveCriticalSection(&g_roots.lock);
+    return root;
+}
+
+BOOL root_start(MonitorRoot *root) {
+    root->monitor_thread = CreateThread(NULL, 0, monitor_thread_func, root, 0, NULL);
+    if (!root->monitor_thread) {
+        safe_printf("Failed to create monitor thread for %s\n", root->path);
+        return FALSE;
+    }
+
+    // Let the monitor open its handle before the scan starts, so files
+    // created during the scan are not missed
+    Sleep(200);
+
+    root->scan_thread = CreateThread(NULL, 0, scanner_thread_func, root, 0, NULL);
+    if (!root->scan_thread) {
+        safe_printf("Failed to create scanner thread for %s\n", root->path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Stop a root's threads and release it.  Caller has removed it from the list.
+static void root_stop(MonitorRoot *root) {
+    root->stopping = TRUE;
+    SetEvent(root->stop_event);
+
+    if (root->scan_thread) {
+        WaitForSingleObject(root->scan_thread, INFINITE);
+        CloseHandle(root->scan_thread);
+    }
+    if (root->monitor_thread) {
+        WaitForSingleObject(root->monitor_thread, INFINITE);
+        CloseHandle(root->monitor_thread);
+    }
+    CloseHandle(root->stop_event);
+    visited_free(&root->visited);
+    free(root);
+}
+
+void roots_stop_all(void) {
+    EnterCriticalSection(&g_roots.lock);
+    int count = g_roots.count;
+    MonitorRoot *snapshot[MAX_ROOTS];
+    memcpy(snapshot, g_roots.roots, sizeof(MonitorRoot*) * count);
+    g_roots.count = 0;
+    LeaveCriticalSection(&g_roots.lock);
+
+    for (int i = 0; i < count; i++) {
+        root_stop(snapshot[i]);
+    }
+}
+
+int roots_reference_paths(char paths[][MAX_PATH]) {
+    int count = 0;
+    EnterCriticalSection(&g_roots.lock);
+    for (int i = 0; i < g_roots.count; i++) {
+        if (g_roots.roots[i]->reference) strcpy(paths[count++], g_roots.roots[i]->path);
+    }
+    LeaveCriticalSection(&g_roots.lock);
+    return count;
+}
+
+void roots_discard(MonitorRoot *root) {
+    root_stop(root);
+}
+
+void roots_adopt(MonitorRoot *root) {
+    EnterCriticalSection(&g_roots.lock);
+    g_roots.roots[g_roots.count++] = root;
+    LeaveCriticalSection(&g_roots.lock);
+}
+
+BOOL root_scan_finished(MonitorRoot *root) {
+    return !root->scan_thread || WaitForSingleObject(root->scan_thread, 0) != WAIT_TIMEOUT;
+}
+
+void roots_signal_stop_all(void) {
+    EnterCriticalSection(&g_roots.lock);
+    for (int i = 0; i < g_roots.count; i++) {
+        SetEvent(g_roots.roots[i]->stop_event);
+    }
+    LeaveCriticalSection(&g_roots.lock);
+}
+
+static BOOL any_thread_running(BOOL monitors) {
+    BOOL running = FALSE;
+    EnterCriticalSection(&g_roots.lock);
+    for (int i = 0; i < g_roots.count && !running; i++) {
+        HANDLE h = monitors ? g_roots.roots[i]->monitor_thread
+                            : g_roots.roots[i]->scan_thread;
+        if (h && WaitForSingleObject(h, 0) == WAIT_TIMEOUT) {
+            running = TRUE;
+        }
+    }
+    LeaveCriticalSection(&g_roots.lock);
+    return running;
+}
+
+BOOL roots_scans_running(void) {
+    return any_thread_running(FALSE);
+}
+
+BOOL roots_monitors_running(void) {
+    return any_thread_running(TRUE);
+}
+
+void root_mark_covered(MonitorRoot *root) {
+    root->covered = TRUE;
+}
+
+BOOL roots_covered(void) {
+    BOOL covered = TRUE;
+    EnterCriticalSection(&g_roots.lock);
+    for (int i = 0; i < g_roots.count && covered; i++) {
+        covered = g_roots.roots[i]->covered;
+    }
+    LeaveCriticalSection(&g_roots.lock);
+    return covered;
+}
+
+// Only roots feeding the same index can index a directory twice
+static BOOL seen_by_other_root(const MonitorRoot *root, const DirIdentity *id) {
+    for (int i = 0; i < g_roots.count; i++) {
+        MonitorRoot *other = g_roots.roots[i];
+        if (other != root && other->table == root->table &&
+            visited_contains(&other->visited, id)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+BOOL roots_claim_directory(MonitorRoot *root, const DirIdentity *id) {
+    // Held across check and insert so two roots cannot both claim one target
+    EnterCriticalSection(&g_roots.lock);
+    BOOL claimed = !seen_by_other_root(root, id) && visited_insert(&root->visited, id);
+    LeaveCriticalSection(&g_roots.lock);
+    return claimed;
+}
+
+BOOL roots_queue_command(RootCommand command, const char *path) {
+    EnterCriticalSection(&g_pending_lock);
+    BOOL queued = g_pending_count < MAX_PENDING_ROOT_COMMANDS;
+    if (queued) {
+        PendingRootCommand *p = &g_pending_commands[g_pending_count++];
+        p->command = command;
+        strncpy(p->path, path, MAX_PATH - 1);
+        p->path[MAX_PATH - 1] = '\0';
+    }
+    LeaveCriticalSection(&g_pending_lock);
+
+    if (!queued) {
+        safe_printf("[ROOTS] %d root commands already pending, dropping command for %s\n",
+                    MAX_PENDING_ROOT_COMMANDS, path);
+    }
+    return queued;
+}
+
+static void send_root_event(const char *event, const char *path) {
+    char ts[32];
+    get_iso8601_timestamp(ts, sizeof(ts));
+    char msg[MAX_PATH + 256];
+    snprintf(msg, sizeof(msg),
+        "{\"type\":\"ALERT\",\"event\":\"%s\","
+        "\"path\":\"%s\",\"timestamp\":\"%s\"}\n",
+        event, path, ts);
+    send_raw_notification(msg);
+}
+
+static void send_root_error(const char *what, const char *path) {
+    char ts[32];
+    char err[MAX_PATH + 64];
+    get_iso8601_timestamp(ts, sizeof(ts));
+    snprintf(err, sizeof(err), "%s: %s", what, path);
+    send_alert_error(err, ts);
+}
+
+// Take the root at clean out of the list.  NULL if it is not a root.
+static MonitorRoot* roots_detach(const char *clean) {
+    EnterCriticalSection(&g_roots.lock);
+    int index = find_root_index(clean);
+    MonitorRoot *root = NULL;
+    if (index >= 0) {
+        root = g_roots.roots[index];
+        for (int i = index; i < g_roots.count - 1; i++) {
+            g_roots.roots[i] = g_roots.roots[i + 1];
+        }
+        g_roots.roots[--g_roots.count] = NULL;
+    }
+    LeaveCriticalSection(&g_roots.lock);
+    return root;
+}
+
+// Stop a detached root; only its entries leave the shared index
+static void root_release(MonitorRoot *root) {
+    char removed_path[MAX_PATH];
+    strcpy(removed_path, root->path);
+    HashTable *table = root->table;
+    BOOL reference = root->reference;
+    root_stop(root);
+
+    remove_files_under_path(table, removed_path);
+    if (reference) {
+        hash_table_set_reference(table, removed_path, FALSE);
+    }
+}
+
+static void apply_add(const char *path, BOOL reference) {
+    MonitorRoot *root = roots_add(path, reference);
+    if (!root) {
+        send_root_error("Cannot add root", path);
+        return;
+    }
+
+    safe_printf("[ROOTS] Adding %sroot %s\n", reference ? "reference " : "", root->path);
+    // A root whose scan never runs would never be covered and would leave
+    // every alert and query partial, so it is removed again
+    if (!root_start(root)) {
+        char failed_path[MAX_PATH];
+        strcpy(failed_path, root->path);
+        root_release(roots_detach(failed_path));
+        send_root_error("Cannot start root", failed_path);
+        return;
+    }
+    send_root_event("ROOT_ADDED", root->path);
+}
+
+static void apply_remove(const char *path) {
+    char clean[MAX_PATH];
+    normalize_root_path(path, clean);
+
+    MonitorRoot *root = roots_detach(clean);
+    if (!root) {
+        safe_printf("[ROOTS] Not a monitored root: %s\n", clean);
+        return;
+    }
+
+    safe_printf("[ROOTS] Removing root %s\n", root->path);
+    char removed_path[MAX_PATH];
+    strcpy(removed_path, root->path);
+    root_release(root);
+    send_root_event("ROOT_REMOVED", removed_path);
+}
+
+void roots_process_pending(void) {
+    PendingRootCommand batch[MAX_PENDING_ROOT_COMMANDS];
+
+    EnterCriticalSection(&g_pending_lock);
+    int count = g_pending_count;
+    memcpy(batch, g_pending_commands, sizeof(PendingRootCommand) * count);
+    g_pending_count = 0;
+    LeaveCriticalSection(&g_pending_lock);
+
+    for (int i = 0; i < count; i++) {
+        if (batch[i].command == ROOT_CMD_ADD || batch[i].command == ROOT_CMD_ADD_REFERENCE) {
+            apply_add(batch[i].path, batch[i].command == ROOT_CMD_ADD_REFERENCE);
+        } else if (batch[i].command == ROOT_CMD_REMOVE) {
+            apply_remove(batch[i].path);
+        }
+    }
+}
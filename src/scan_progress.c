@@ -0,0 +1,281 @@
+//scan_progress.c
+#include "scan_progress.h"
+#include "scanner.h"
+#include "checkpoint.h"
+#include "file_ops.h"
+#include "visited_set.h"
+#include "ipc_pipe.h"
+#include "hash_table.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static volatile LONGLONG g_stage_files[PROGRESS_STAGE_COUNT];
+static volatile LONGLONG g_stage_bytes[PROGRESS_STAGE_COUNT];
+static volatile LONG g_active_scans = 0;
+static volatile LONG g_pending_estimates = 0;
+static volatile LONG g_failed_estimates = 0;   // Walks this session cut short by memory
+static volatile LONG g_session = 0;
+static volatile ULONGLONG g_session_start = 0;
+
+static const char *g_stage_names[PROGRESS_STAGE_COUNT] = {
+    "enumerated", "hashed", "skipped", "estimate"
+};
+
+void scan_progress_add(ProgressStage stage, uint64_t filesize) {
+    InterlockedIncrement64(&g_stage_files[stage]);
+    InterlockedExchangeAdd64(&g_stage_bytes[stage], (LONGLONG)filesize);
+}
+
+static BOOL estimate_cancelled(const MonitorRoot *root) {
+    return root->estimate_cancel || root->stopping || g_stop_monitoring;
+}
+
+// Walk the root counting files and sizes from the directory entries only.
+// Runs at low priority beside the real scan to give the ETA a total, and
+// grows the index once the total is known.
+static DWORD WINAPI estimate_thread_func(LPVOID lpParam) {
+    MonitorRoot *root = (MonitorRoot*)lpParam;
+    ScanFrontier pending;
+    VisitedSet visited;
+    size_t indexed_before = hash_table_count(root->table);
+    size_t files_found = 0;
+    frontier_init(&pending);
+    visited_init(&visited);
+    BOOL walked = frontier_push(&pending, root->path);
+
+    while (walked && pending.count > 0 && !estimate_cancelled(root)) {
+        char *dir_path = frontier_pop(&pending);
+        char search_path[MAX_PATH];
+        WIN32_FIND_DATA find_data;
+        DirIdentity identity;
+        uint64_t dir_mtime;
+
+        if (get_directory_identity(dir_path, &identity, &dir_mtime) == 0 &&
+            !visited_insert(&visited, &identity)) {
+            free(dir_path);
+            continue;
+        }
+
+        snprintf(search_path, MAX_PATH, "%s\\*", dir_path);
+        HANDLE hFind = FindFirstFile(search_path, &find_data);
+        if (hFind != INVALID_HANDLE_VALUE) {
+            do {
+                if (strcmp(find_data.cFileName, ".") == 0 ||
+                    strcmp(find_data.cFileName, "..") == 0) {
+                    continue;
+                }
+                if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                    if (!should_descend(&find_data)) continue;
+                    char full_path[MAX_PATH];
+                    snprintf(full_path, MAX_PATH, "%s\\%s", dir_path, find_data.cFileName);
+                    if (!frontier_push(&pending, full_path)) {
+                        walked = FALSE;
+                        break;
+                    }
+                } else if (!should_ignore_file(find_data.cFileName)) {
+                    files_found++;
+                    scan_progress_add(PROGRESS_ESTIMATED,
+                        ((uint64_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow);
+                }
+            } while (FindNextFile(hFind, &find_data) && !estimate_cancelled(root));
+            FindClose(hFind);
+        }
+        free(dir_path);
+    }
+
+    // A walk that lost directories would undercount: the estimate stays
+    // incomplete and the index is not sized from it.  Files this root
+    // already put in the index are counted twice, so a full walk errs on
+    // the large side.
+    if (!walked) {
+        InterlockedIncrement(&g_failed_estimates);
+    } else if (!estimate_cancelled(root)) {
+        hash_table_reserve(root->table, indexed_before + files_found);
+    }
+
+    frontier_free(&pending);
+    visited_free(&visited);
+    InterlockedDecrement(&g_pending_estimates);
+    return 0;
+}
+
+void scan_progress_begin(MonitorRoot *root) {
+    if (InterlockedIncrement(&g_active_scans) == 1) {
+        for (int i = 0; i < PROGRESS_STAGE_COUNT; i++) {
+            InterlockedExchange64(&g_stage_files[i], 0);
+            InterlockedExchange64(&g_stage_bytes[i], 0);
+        }
+        InterlockedExchange(&g_failed_estimates, 0);
+        g_session_start = GetTickCount64();
+        InterlockedIncrement(&g_session);
+    }
+
+    root->estimate_cancel = FALSE;
+    InterlockedIncrement(&g_pending_estimates);
+    root->estimate_thread = CreateThread(NULL, 0, estimate_thread_func, root, 0, NULL);
+    if (root->estimate_thread) {
+        SetThreadPriority(root->estimate_thread, THREAD_PRIORITY_LOWEST);
+    } else {
+        InterlockedDecrement(&g_pending_estimates);
+    }
+}
+
+void scan_progress_end(MonitorRoot *root) {
+    if (root->estimate_thread) {
+        root->estimate_cancel = TRUE;
+        WaitForSingleObject(root->estimate_thread, INFINITE);
+        CloseHandle(root->estimate_thread);
+        root->estimate_thread = NULL;
+    }
+    InterlockedDecrement(&g_active_scans);
+}
+
+void scan_progress_tick(void) {
+    // Only the main thread ticks, so the interval state needs no lock
+    static LONG last_session = 0;
+    static BOOL was_active = FALSE;
+    static ULONGLONG last_emit = 0;
+    static LONGLONG last_files[PROGRESS_STAGE_COUNT];
+    static LONGLONG last_bytes[PROGRESS_STAGE_COUNT];
+
+    LONG active = g_active_scans;
+    ULONGLONG now = GetTickCount64();
+
+    // A scan shorter than one tick still gets its final report
+    if (g_session != last_session) {
+        last_session = g_session;
+        last_emit = g_session_start;
+        was_active = TRUE;
+        memset(last_files, 0, sizeof(last_files));
+        memset(last_bytes, 0, sizeof(last_bytes));
+    }
+    if (active == 0 && !was_active) return;
+    // The final report goes out as soon as the last scan ends
+    if (active > 0 && now - last_emit < SCAN_PROGRESS_INTERVAL_MS) return;
+
+    LONGLONG files[PROGRESS_STAGE_COUNT], bytes[PROGRESS_STAGE_COUNT];
+    unsigned long long files_rate[PROGRESS_STAGE_COUNT], bytes_rate[PROGRESS_STAGE_COUNT];
+    ULONGLONG interval = now > last_emit ? now - last_emit : 1;
+    for (int i = 0; i < PROGRESS_STAGE_COUNT; i++) {
+        files[i] = g_stage_files[i];
+        bytes[i] = g_stage_bytes[i];
+        files_rate[i] = (unsigned long long)(files[i] - last_files[i]) * 1000 / interval;
+        bytes_rate[i] = (unsigned long long)(bytes[i] - last_bytes[i]) * 1000 / interval;
+        last_files[i] = files[i];
+        last_bytes[i] = bytes[i];
+    }
+    last_emit = now;
+    was_active = active > 0;
+
+    // ETA from the average throughput so far against the estimated total;
+    // bytes dominate when hashing, files when digests are mostly reused
+    BOOL estimate_complete = (g_pending_estimates == 0 && g_failed_estimates == 0);
+    ULONGLONG elapsed = now - g_session_start;
+    LONGLONG done_files = files[PROGRESS_HASHED] + files[PROGRESS_SKIPPED];
+    LONGLONG done_bytes = bytes[PROGRESS_HASHED] + bytes[PROGRESS_SKIPPED];
+    long long eta_seconds = -1;
+    if (active == 0) {
+        eta_seconds = 0;
+    } else if (estimate_complete && elapsed > 0) {
+        LONGLONG est_files = files[PROGRESS_ESTIMATED];
+        LONGLONG est_bytes = bytes[PROGRESS_ESTIMATED];
+        double by_files = done_files > 0
+            ? (double)(est_files > done_files ? est_files - done_files : 0) *
+              elapsed / done_files / 1000.0 : -1.0;
+        double by_bytes = done_bytes > 0
+            ? (double)(est_bytes > done_bytes ? est_bytes - done_bytes : 0) *
+              elapsed / done_bytes / 1000.0 : -1.0;
+        double eta = by_bytes > by_files ? by_bytes : by_files;
+        if (eta >= 0) eta_seconds = (long long)eta;
+    }
+
+    char counters[1024];
+    char rates[1024];
+    int clen = 0, rlen = 0;
+    for (int i = 0; i < PROGRESS_STAGE_COUNT; i++) {
+        clen += snprintf(counters + clen, sizeof(counters) - clen,
+            "\"%s_files\":%lld,\"%s_bytes\":%lld,",
+            g_stage_names[i], (long long)files[i], g_stage_names[i], (long long)bytes[i]);
+        if (i == PROGRESS_ESTIMATED) continue;
+        rlen += snprintf(rates + rlen, sizeof(rates) - rlen,
+            "%s\"%s_files_per_sec\":%llu,\"%s_bytes_per_sec\":%llu",
+            rlen ? "," : "", g_stage_names[i], files_rate[i],
+            g_stage_names[i], bytes_rate[i]);
+    }
+
+    // Index contention since the table was created
+    IndexStats index_stats = {0};
+    if (g_hash_table) {
+        hash_table_get_stats(g_hash_table, &index_stats);
+    }
+
+    char timestamp[32];
+    get_iso8601_timestamp(timestamp, sizeof(timestamp));
+    char msg[3072];
+    snprintf(msg, sizeof(msg),
+        "{\"type\":\"ALERT\",\"event\":\"SCAN_PROGRESS\","
+        "\"scans_running\":%ld,\"elapsed_ms\":%llu,%s"
+        "\"estimate_complete\":%s,\"rates\":{%s},"
+        "\"index\":{\"lock_acquisitions\":%lld,\"lock_contended\":%lld,"
+        "\"reads\":%lld,\"read_retries\":%lld,\"read_fallbacks\":%lld,"
+        "\"filter_rejects\":%lld,\"filter_false_positives\":%lld,"
+        "\"memory_bytes\":%llu,\"spilled_files\":%lld,\"spill_runs\":%lld,"
+        "\"spill_probes\":%lld,\"lookup_p50_ns\":%llu,\"lookup_p99_ns\":%llu,"
+        "\"lookup_p999_ns\":%llu,\"disk_p99_ns\":%llu},"
+        "\"eta_seconds\":%lld,\"timestamp\":\"%s\"}\n",
+        (long)active, (unsigned long long)elapsed, counters,
+        estimate_complete ? "true" : "false", rates,
+        (long long)index_stats.lock_acquisitions, (long long)index_stats.lock_contended,
+        (long long)index_stats.reads, (long long)index_stats.read_retries,
+        (long long)index_stats.read_fallbacks,
+        (long long)index_stats.filter_rejects, (long long)index_stats.filter_false_positives,
+        (unsigned long long)index_stats.memory_bytes, (long long)index_stats.spilled_files,
+        (long long)index_stats.spill_runs, (long long)index_stats.spill_probes,
+        (unsigned long long)index_stats.lookup_p50_ns, (unsigned long long)index_stats.lookup_p99_ns,
+        (unsigned long long)index_stats.lookup_p999_ns, (unsigned long long)index_stats.disk_p99_ns,
+        eta_seconds, timestamp);
+    send_raw_notification(msg);
+
+    char eta_text[32];
+    if (eta_seconds < 0) {
+        strcpy(eta_text, "unknown");
+    } else {
+        snprintf(eta_text, sizeof(eta_text), "%llds", eta_seconds);
+    }
+    safe_printf("[PROGRESS] %lld/%lld%s files (%lld hashed, %lld skipped), "
+                "%llu files/s, %.1f MB/s hashed, ETA %s\n",
+                (long long)done_files, (long long)files[PROGRESS_ESTIMATED],
+                estimate_complete ? "" : "+",
+                (long long)files[PROGRESS_HASHED], (long long)files[PROGRESS_SKIPPED],
+                files_rate[PROGRESS_HASHED] + files_rate[PROGRESS_SKIPPED],
+                bytes_rate[PROGRESS_HASHED] / (1024.0 * 1024.0), eta_text);
+
+    if (active == 0) {
+        LONGLONG acquisitions = index_stats.lock_acquisitions;
+        safe_printf("[INDEX] %lld shard lock acquisitions, %lld contended (%.2f%%); "
+                    "%lld lock-free reads, %lld retried, %lld fell back to the lock\n",
+                    (long long)acquisitions, (long long)index_stats.lock_contended,
+                    acquisitions ? 100.0 * index_stats.lock_contended / acquisitions : 0.0,
+                    (long long)index_stats.reads, (long long)index_stats.read_retries,
+                    (long long)index_stats.read_fallbacks);
+        LONGLONG probes = index_stats.filter_rejects + index_stats.filter_false_positives;
+        safe_printf("[INDEX] Content filter answered %lld new digests without a probe, "
+                    "%lld false positives (%.2f%%)\n",
+                    (long long)index_stats.filter_rejects,
+                    (long long)index_stats.filter_false_positives,
+                    probes ? 100.0 * index_stats.filter_false_positives / probes : 0.0);
+        if (g_index_memory_budget > 0) {
+            safe_printf("[INDEX] %.1f of %.1f MB in memory, %lld files spilled in %lld runs; "
+                        "lookups p50 %.1f us, p99 %.1f us, p99.9 %.1f us "
+                        "(%lld read a run, p99 %.1f us)\n",
+                        index_stats.memory_bytes / (1024.0 * 1024.0),
+                        g_index_memory_budget / (1024.0 * 1024.0),
+                        (long long)index_stats.spilled_files, (long long)index_stats.spill_runs,
+                        index_stats.lookup_p50_ns / 1000.0, index_stats.lookup_p99_ns / 1000.0,
+                        index_stats.lookup_p999_ns / 1000.0, (long long)index_stats.spill_probes,
+                        index_stats.disk_p99_ns / 1000.0);
+        }
+    }
+}
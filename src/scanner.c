@@ -1,68 +1,528 @@
 //scanner.c
 #include "scanner.h"
 #include "file_ops.h"
-#include "empty_files.h"
+#include "digest_store.h"
+#include "checkpoint.h"
+#include "dir_summary.h"
+#include "scan_progress.h"
+#include "visited_set.h"
+#include "index_analytics.h"
+#include "ipc_pipe.h"
 #include "utils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <windows.h>
 
 volatile int g_scanning_complete = 0;
 volatile int g_stop_monitoring = 0;
-char g_monitor_path[MAX_PATH];
 volatile BOOL g_dir_change_pending = FALSE;
 char g_pending_dir[MAX_PATH];
+int g_lazy_index = 0;
 
-void scan_directory(const char *dir_path, HashTable *table, int *file_count) {
+// A scan is abandoned (and checkpointed) on Ctrl+C or when its root is
+// removed or replaced.  CHANGE_DIRECTORY leaves it running until the new
+// root's index is ready to take over.
+static int scan_interrupted(const MonitorRoot *root) {
+    return g_stop_monitoring || root->stopping;
+}
+
+// TRUE if dir_path was copied from the live index for this root
+static BOOL reused_directory(const MonitorRoot *root, const char *dir_path) {
+    for (int i = 0; i < root->reused_count; i++) {
+        if (_stricmp(root->reused[i], dir_path) == 0) return TRUE;
+    }
+    return FALSE;
+}
+
+// Files of a completed directory recovered from the digest store on resume
+typedef struct RestoreCandidate {
+    char *filepath;
+    uint64_t filesize;
+    uint64_t mtime;
+    char hash[HASH_SIZE * 2 + 1];
+} RestoreCandidate;
+
+typedef struct RestoreList {
+    RestoreCandidate *items;
+    int count;
+    int capacity;
+} RestoreList;
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static void collect_restore_candidate(const DigestRecord *record, void *ctx) {
+    RestoreList *list = (RestoreList*)ctx;
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 1024;
+        RestoreCandidate *items = realloc(list->items,
+                                          sizeof(RestoreCandidate) * new_capacity);
+        if (!items) return;
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+    char *filepath = _strdup(record->filepath);
+    if (!filepath) return;
+    RestoreCandidate *c = &list->items[list->count++];
+    c->filepath = filepath;
+    c->filesize = record->filesize;
+    c->mtime = record->mtime;
+    strcpy(c->hash, record->hash);
+}
+
+// TRUE if filepath lies below one of the (sorted) pending directories
+static BOOL under_pending_dir(const char *filepath, const char *root_path,
+                              char **pending, int pending_count) {
+    char parent[MAX_PATH];
+    size_t root_len = strlen(root_path);
+    strncpy(parent, filepath, MAX_PATH - 1);
+    parent[MAX_PATH - 1] = '\0';
+
+    char *sep;
+    while ((sep = strrchr(parent, '\\')) != NULL && (size_t)(sep - parent) >= root_len) {
+        *sep = '\0';
+        const char *key = parent;
+        if (bsearch(&key, pending, pending_count, sizeof(char*), compare_strings)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Re-populate the index with files from directories a previous run finished.
+// Their digests come from the store; only size and mtime are re-checked.
+// -1 if out of memory, with nothing restored.
+static int restore_completed_files(const MonitorRoot *root, const ScanFrontier *frontier,
+                                   HashTable *table) {
+    const char *root_path = root->path;
+    RestoreList list = {0};
+    digest_store_for_each_under(root_path, collect_restore_candidate, &list);
+
+    char **pending = malloc(sizeof(char*) * (frontier->count ? frontier->count : 1));
+    if (!pending) {
+        for (int i = 0; i < list.count; i++) free(list.items[i].filepath);
+        free(list.items);
+        return -1;
+    }
+    memcpy(pending, frontier->dirs, sizeof(char*) * frontier->count);
+    qsort(pending, frontier->count, sizeof(char*), compare_strings);
+
+    int restored = 0;
+    for (int i = 0; i < list.count; i++) {
+        RestoreCandidate *c = &list.items[i];
+        uint64_t filesize, mtime;
+
+        if (!scan_interrupted(root) &&
+            !under_pending_dir(c->filepath, root_path, pending, frontier->count) &&
+            get_file_stat(c->filepath, &filesize, &mtime) == 0 &&
+            filesize == c->filesize && mtime == c->mtime) {
+            // Not opened, so its file index is unknown
+            FileMeta meta = { filesize, mtime, 0 };
+            if (c->hash[0] == '\0') {
+                hash_table_add_empty(table, c->filepath, &meta);
+            } else {
+                add_file_hash(table, c->hash, c->filepath, &meta);
+            }
+            scan_progress_add(PROGRESS_ENUMERATED, filesize);
+            scan_progress_add(PROGRESS_SKIPPED, filesize);
+            restored++;
+        }
+        free(c->filepath);
+    }
+
+    free(pending);
+    free(list.items);
+    return restored;
+}
+
+typedef struct ReplayContext {
+    HashTable *table;
+    ScanFrontier subdirs;
+    int files;
+    BOOL queued;                 // FALSE once a subdirectory could not be queued
+} ReplayContext;
+
+static void replay_file(const char *path, uint64_t filesize, uint64_t mtime,
+                        const char *hash, void *ctx) {
+    ReplayContext *replay = (ReplayContext*)ctx;
+    scan_progress_add(PROGRESS_ENUMERATED, filesize);
+    scan_progress_add(PROGRESS_SKIPPED, filesize);
+    FileMeta meta = { filesize, mtime, 0 };
+    if (hash[0] == '\0') {
+        hash_table_add_empty(replay->table, path, &meta);
+    } else {
+        if (check_for_duplicate(replay->table, hash, path, &meta)) {
+            print_duplicates_for_file(replay->table, hash, path);
+        }
+        add_file_hash(replay->table, hash, path, &meta);
+    }
+    replay->files++;
+}
+
+static void replay_subdir(const char *path, uint64_t filesize, uint64_t mtime,
+                          const char *hash, void *ctx) {
+    (void)filesize;
+    (void)mtime;
+    (void)hash;
+    ReplayContext *replay = (ReplayContext*)ctx;
+    if (!frontier_push(&replay->subdirs, path)) replay->queued = FALSE;
+}
+
+// A directory whose mtime matches its summary has had no entry added,
+// removed or renamed, so its files come from the digest store and its
+// subdirectories from their summaries without enumerating it.  *queued is
+// FALSE if a subdirectory could not be queued (out of memory).
+static BOOL replay_unchanged_directory(HashTable *table, const char *dir_path,
+                                       uint64_t dir_mtime, ScanFrontier *frontier,
+                                       int *file_count, BOOL *queued) {
+    ReplayContext replay = {0};
+    replay.table = table;
+    replay.queued = TRUE;
+    frontier_init(&replay.subdirs);
+
+    BOOL replayed = dir_summary_replay(dir_path, dir_mtime, replay_file,
+                                       replay_subdir, &replay);
+    if (replayed) {
+        for (int i = replay.subdirs.count - 1; i >= 0; i--) {
+            if (!frontier_push(frontier, replay.subdirs.dirs[i])) replay.queued = FALSE;
+        }
+        *file_count += replay.files;
+        frontier->files_processed += replay.files;
+    }
+    frontier_free(&replay.subdirs);
+    *queued = replay.queued;
+    return replayed;
+}
+
+// Enumerate one directory.  Files are processed immediately; subdirectories
+// are only pushed once the whole directory is done, so an interrupted
+// directory can be redone on resume without queueing its children twice.
+static BOOL scan_one_directory(MonitorRoot *root, const char *dir_path,
+                               ScanFrontier *frontier, ScanFrontier *deferred_links,
+                               int *file_count,
+                               ULONGLONG *last_checkpoint, int *dirs_skipped) {
     WIN32_FIND_DATA find_data;
     HANDLE hFind;
     char search_path[MAX_PATH];
-    
+    ScanFrontier subdirs;
+    ScanFrontier links;
+    BOOL completed = TRUE;
+    uint32_t entry_count = 0;
+    uint64_t child_hash = 0;
+
+    // Its files were copied from the live index, which kept them current
+    if (reused_directory(root, dir_path)) {
+        (*dirs_skipped)++;
+        return TRUE;
+    }
+
+    // Taken before enumerating, so a change made meanwhile leaves the
+    // recorded mtime stale and the directory is enumerated next time
+    DirIdentity identity;
+    uint64_t dir_mtime;
+    BOOL have_mtime = (get_directory_identity(dir_path, &identity, &dir_mtime) == 0);
+
+    // A link loop or a second path (junction, mount point, another root)
+    // to a directory already scanned would index the same files twice
+    if (have_mtime && !roots_claim_directory(root, &identity)) {
+        safe_printf("[LINK] %s was already scanned through another path, skipping\n",
+                    dir_path);
+        return TRUE;
+    }
+
+    // A subdirectory that could not be queued stops the scan, which
+    // checkpoints this directory to be redone
+    BOOL queued = TRUE;
+    if (have_mtime &&
+        replay_unchanged_directory(root->table, dir_path, dir_mtime, frontier, file_count,
+                                   &queued)) {
+        (*dirs_skipped)++;
+        return queued;
+    }
+
     snprintf(search_path, MAX_PATH, "%s\\*", dir_path);
-    
+
     hFind = FindFirstFile(search_path, &find_data);
     if (hFind == INVALID_HANDLE_VALUE) {
-        return;
+        return TRUE;
     }
-    
+
+    frontier_init(&subdirs);
+    frontier_init(&links);
+
     do {
-        if (g_stop_monitoring) break;
-        
-        if (strcmp(find_data.cFileName, ".") == 0 || 
+        if (scan_interrupted(root)) {
+            completed = FALSE;
+            break;
+        }
+
+        if (strcmp(find_data.cFileName, ".") == 0 ||
             strcmp(find_data.cFileName, "..") == 0) {
             continue;
         }
-        
+
         char full_path[MAX_PATH];
         snprintf(full_path, MAX_PATH, "%s\\%s", dir_path, find_data.cFileName);
-        
+
         if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            scan_directory(full_path, table, file_count);
+            if (!should_descend(&find_data)) {
+                safe_printf("[SKIP] %s (link not followed)\n", full_path);
+                continue;
+            }
+            // Links wait until the real tree is done, so a directory
+            // reachable both ways is indexed under its real path
+            if (!frontier_push(is_link_entry(&find_data) ? &links : &subdirs, full_path)) {
+                queued = FALSE;
+            }
+            entry_count++;
+            child_hash += dir_summary_child_hash(find_data.cFileName, TRUE);
         } else {
             if (should_ignore_file(find_data.cFileName)) {
                 safe_printf("[SKIP] %s\n", full_path);
                 continue;
             }
-            
-            process_file(full_path, "SCAN");
+
+            uint64_t filesize = ((uint64_t)find_data.nFileSizeHigh << 32) |
+                                find_data.nFileSizeLow;
+            scan_progress_add(PROGRESS_ENUMERATED, filesize);
+
+            int result = process_file(root->table, full_path, "SCAN");
+            if (result == PROCESS_HASHED) {
+                scan_progress_add(PROGRESS_HASHED, filesize);
+            } else if (result != PROCESS_FAILED) {
+                scan_progress_add(PROGRESS_SKIPPED, filesize);
+            }
+            entry_count++;
+            child_hash += dir_summary_child_hash(find_data.cFileName, FALSE);
             (*file_count)++;
+            frontier->files_processed++;
+
+            ULONGLONG now = GetTickCount64();
+            if (now - *last_checkpoint >= CHECKPOINT_INTERVAL_MS) {
+                digest_store_flush();
+                checkpoint_save(root->path, frontier, deferred_links, dir_path);
+                *last_checkpoint = now;
+            }
         }
     } while (FindNextFile(hFind, &find_data));
-    
+
     FindClose(hFind);
+
+    if (completed) {
+        // Push in reverse so subdirectories pop in enumeration order
+        for (int i = subdirs.count - 1; i >= 0 && queued; i--) {
+            queued = frontier_push(frontier, subdirs.dirs[i]);
+        }
+        for (int i = links.count - 1; i >= 0 && queued; i--) {
+            queued = frontier_push(deferred_links, links.dirs[i]);
+        }
+        completed = queued;
+    }
+    if (completed && have_mtime) {
+        dir_summary_record(dir_path, dir_mtime, entry_count, child_hash);
+    }
+    frontier_free(&subdirs);
+    frontier_free(&links);
+    return completed;
+}
+
+BOOL scan_directory(MonitorRoot *root, HashTable *table, int *file_count) {
+    const char *dir_path = root->path;
+    ScanFrontier frontier;
+    frontier_init(&frontier);
+    BOOL completed = TRUE;
+
+    if (checkpoint_load(dir_path, &frontier)) {
+        safe_printf("[RESUME] Resuming scan of %s (%llu directories done, %d pending)\n",
+                    dir_path, (unsigned long long)frontier.dirs_completed,
+                    frontier.count);
+        int restored = restore_completed_files(root, &frontier, table);
+        if (restored >= 0) {
+            safe_printf("[RESUME] Restored %d files from the digest store\n", restored);
+            *file_count += restored;
+        } else {
+            // Finished directories are only known by what is still pending
+            safe_printf("[ERROR] Out of memory restoring %s; scanning it from the start\n",
+                        dir_path);
+            frontier_free(&frontier);
+            frontier_init(&frontier);
+            completed = frontier_push(&frontier, dir_path);
+        }
+    } else {
+        completed = frontier_push(&frontier, dir_path);
+    }
+
+    dir_summary_prepare(dir_path);
+    uint64_t dirs_at_start = frontier.dirs_completed;
+
+    ULONGLONG last_checkpoint = GetTickCount64();
+    int dirs_skipped = 0;
+    ScanFrontier deferred_links;
+    frontier_init(&deferred_links);
+
+    while (frontier.count > 0 || deferred_links.count > 0) {
+        char *current = frontier.count > 0 ? frontier_pop(&frontier)
+                                           : frontier_pop(&deferred_links);
+
+        if (!scan_one_directory(root, current, &frontier, &deferred_links,
+                                file_count, &last_checkpoint, &dirs_skipped)) {
+            frontier_push(&frontier, current);
+            free(current);
+            completed = FALSE;
+            break;
+        }
+
+        frontier.dirs_completed++;
+        free(current);
+    }
+
+    digest_store_flush();
+    dir_summary_release(dir_path);
+    dir_summary_save(completed ? dir_path : NULL);
+    if (g_dir_summaries) {
+        safe_printf("[RECONCILE] %s: %d unchanged directories skipped, %llu enumerated\n",
+                    dir_path, dirs_skipped,
+                    (unsigned long long)(frontier.dirs_completed - dirs_at_start - dirs_skipped));
+    }
+
+    if (completed) {
+        checkpoint_delete(dir_path);
+    } else if (checkpoint_save(dir_path, &frontier, &deferred_links, NULL)) {
+        safe_printf("[CHECKPOINT] Scan of %s interrupted, %d directories saved for resume\n",
+                    dir_path, frontier.count + deferred_links.count);
+    }
+
+    frontier_free(&deferred_links);
+    frontier_free(&frontier);
+    return completed;
+}
+
+// A reference root scanned to the end before is taken from the digest
+// store as it stands, without opening or even listing a directory, so a
+// huge archive costs one pass over the store at start-up.  Its monitor
+// keeps the store current while the engine runs; --full-rescan walks it
+// again.  FALSE if it has to be scanned; TRUE even if stopped part-way,
+// as the next start loads it again from the top.
+static BOOL load_reference_root(MonitorRoot *root, int *file_count) {
+    if (!dir_summary_known(root->path)) return FALSE;
+
+    ScanFrontier frontier;
+    frontier_init(&frontier);
+    BOOL interrupted = checkpoint_load(root->path, &frontier);
+    frontier_free(&frontier);
+    if (interrupted) return FALSE;
+
+    size_t capacity = REFERENCE_LOAD_BATCH;
+    DigestCopy *batch = malloc(sizeof(DigestCopy) * capacity);
+    if (!batch) return FALSE;
+
+    // Copied out a batch at a time and indexed without the store's lock,
+    // so the other roots' lookups and puts wait for one copy at most
+    DigestStoreCursor cursor = { 0, 0 };
+    int files = 0;
+    size_t count;
+    BOOL failed = FALSE;
+    while (!scan_interrupted(root) &&
+           (count = digest_store_copy_under(root->path, &cursor, &batch,
+                                            &capacity, &failed)) > 0) {
+        for (size_t i = 0; i < count && !scan_interrupted(root); i++) {
+            // Empty files are never matched against
+            if (batch[i].hash[0] == '\0') continue;
+            FileMeta meta = { batch[i].filesize, batch[i].mtime, 0 };
+            add_file_hash(root->table, batch[i].hash, batch[i].filepath, &meta);
+            files++;
+        }
+    }
+    free(batch);
+
+    // Walked instead; the files loaded so far are already indexed
+    if (failed) {
+        safe_printf("[ERROR] Out of memory loading %s from the digest store; scanning it\n",
+                    root->path);
+        return FALSE;
+    }
+
+    safe_printf("[REFERENCE] Loaded %d files of %s from the digest store\n",
+                files, root->path);
+    *file_count += files;
+    return TRUE;
 }
 
 DWORD WINAPI scanner_thread_func(LPVOID lpParam) {
+    MonitorRoot *root = (MonitorRoot*)lpParam;
     int file_count = 0;
-    scan_directory(g_monitor_path, g_hash_table, &file_count);
-    
-    safe_printf("\n=== Initial Scan Complete ===\n");
+
+    // Background mode lowers I/O priority as well as CPU, so the trickle
+    // scan (or an archive's first scan) yields the disk to on-demand
+    // hashing of changed files
+    if (g_lazy_index || root->reference) {
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    }
+
+    BOOL completed;
+    if (root->reference && load_reference_root(root, &file_count)) {
+        completed = !scan_interrupted(root);
+    } else {
+        scan_progress_begin(root);
+
+        // A staged root first takes over what the live index already covers
+        for (int i = 0; i < root->reused_count && !scan_interrupted(root); i++) {
+            size_t copied = hash_table_copy_under(root->table, root->reuse_from, root->reused[i]);
+            safe_printf("[REROOT] Reused %llu indexed files under %s\n",
+                        (unsigned long long)copied, root->reused[i]);
+            file_count += (int)copied;
+        }
+
+        completed = scan_directory(root, root->table, &file_count);
+        scan_progress_end(root);
+    }
+    root->file_count = file_count;
+
+    if (!completed) {
+        safe_printf("\n=== Scan Interrupted: %s ===\n", root->path);
+        safe_printf("Processed %d files before stopping.\n", file_count);
+        return 0;
+    }
+
+    safe_printf("\n=== Scan Complete: %s ===\n", root->path);
     safe_printf("Processed %d files.\n", file_count);
-    
+    root_mark_covered(root);
+
+    // Roots added after start-up report on their own; duplicates against
+    // the other roots were already alerted as each file was indexed.  A
+    // staged root's index is reported when it is swapped in.
+    if (g_scanning_complete && root->table == g_hash_table) {
+        digest_store_compact();
+        char timestamp[32];
+        char msg[MAX_PATH + 256];
+        get_iso8601_timestamp(timestamp, sizeof(timestamp));
+        snprintf(msg, sizeof(msg),
+            "{\"type\":\"ALERT\",\"event\":\"ROOT_SCAN_COMPLETE\","
+            "\"path\":\"%s\",\"total_files\":%d,\"timestamp\":\"%s\"}\n",
+            root->path, file_count, timestamp);
+        send_raw_notification(msg);
+    }
+
+    return 0;
+}
+
+void finish_initial_scan(void) {
+    int total_files = 0;
+    EnterCriticalSection(&g_roots.lock);
+    for (int i = 0; i < g_roots.count; i++) {
+        total_files += g_roots.roots[i]->file_count;
+    }
+    LeaveCriticalSection(&g_roots.lock);
+
+    safe_printf("\n=== Initial Scan Complete ===\n");
+    safe_printf("Processed %d files across %d root(s).\n", total_files, g_roots.count);
+
     g_scanning_complete = 1;
-    
+
+    digest_store_compact();
     find_duplicates(g_hash_table);
-    print_empty_files();
-    
-    return 0;
-}
\ No newline at end of file
+    print_index_analytics(g_hash_table);
+    print_empty_files(g_hash_table);
+}
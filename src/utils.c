@@ -2,6 +2,7 @@
 #include "utils.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 
 CRITICAL_SECTION g_print_lock;
 
@@ -21,4 +22,17 @@ void init_utils(void) {
 
 void cleanup_utils(void) {
     DeleteCriticalSection(&g_print_lock);
-}
\ No newline at end of file
+}
+
+void get_state_file_path(const char *filename, char *buffer, size_t buffer_size) {
+    char exe_path[MAX_PATH];
+    DWORD len = GetModuleFileName(NULL, exe_path, MAX_PATH);
+    char *sep = (len > 0 && len < MAX_PATH) ? strrchr(exe_path, '\\') : NULL;
+    
+    if (sep) {
+        *sep = '\0';
+        snprintf(buffer, buffer_size, "%s\\%s", exe_path, filename);
+    } else {
+        snprintf(buffer, buffer_size, "%s", filename);
+    }
+}
@@ -0,0 +1,140 @@
+//visited_set.c
+#include "visited_set.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define VISITED_INITIAL_CAPACITY 1024
+
+ReparsePolicy g_reparse_policy = REPARSE_FOLLOW;
+
+int get_directory_identity(const char *dir_path, DirIdentity *id, uint64_t *mtime) {
+    // Directories can only be opened with backup semantics; without
+    // FILE_FLAG_OPEN_REPARSE_POINT the handle refers to the link's target
+    HANDLE hDir = CreateFile(dir_path, 0,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (hDir == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL ok = GetFileInformationByHandle(hDir, &info);
+    CloseHandle(hDir);
+    if (!ok) {
+        return -1;
+    }
+
+    id->file_index = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    id->volume_serial = info.dwVolumeSerialNumber;
+    *mtime = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) |
+             info.ftLastWriteTime.dwLowDateTime;
+    return 0;
+}
+
+BOOL is_link_entry(const WIN32_FIND_DATA *find_data) {
+    // Cloud-file and dedup reparse points are ordinary directories; only
+    // name surrogates (symlinks, junctions, mount points) lead elsewhere
+    return (find_data->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+           (find_data->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) &&
+           IsReparseTagNameSurrogate(find_data->dwReserved0);
+}
+
+BOOL is_link_path(const char *path) {
+    WIN32_FIND_DATA find_data;
+    HANDLE hFind = FindFirstFile(path, &find_data);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+    FindClose(hFind);
+    return is_link_entry(&find_data);
+}
+
+BOOL should_descend(const WIN32_FIND_DATA *find_data) {
+    return g_reparse_policy != REPARSE_SKIP || !is_link_entry(find_data);
+}
+
+void visited_init(VisitedSet *set) {
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+    InitializeCriticalSection(&set->lock);
+}
+
+void visited_free(VisitedSet *set) {
+    free(set->slots);
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+    DeleteCriticalSection(&set->lock);
+}
+
+static size_t identity_slot(const DirIdentity *id, size_t capacity) {
+    uint64_t h = id->file_index ^ ((uint64_t)id->volume_serial << 29);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h & (capacity - 1);
+}
+
+// The all-zero identity marks an empty slot; no directory has file index 0
+static BOOL slot_empty(const DirIdentity *slot) {
+    return slot->file_index == 0 && slot->volume_serial == 0;
+}
+
+static BOOL same_identity(const DirIdentity *a, const DirIdentity *b) {
+    return a->file_index == b->file_index && a->volume_serial == b->volume_serial;
+}
+
+// Linear probe; returns the matching slot or the empty slot ending the run
+static DirIdentity* probe(DirIdentity *slots, size_t capacity, const DirIdentity *id) {
+    size_t i = identity_slot(id, capacity);
+    while (!slot_empty(&slots[i]) && !same_identity(&slots[i], id)) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &slots[i];
+}
+
+static BOOL grow(VisitedSet *set) {
+    size_t new_capacity = set->capacity ? set->capacity * 2 : VISITED_INITIAL_CAPACITY;
+    DirIdentity *slots = calloc(new_capacity, sizeof(DirIdentity));
+    if (!slots) return FALSE;
+
+    for (size_t i = 0; i < set->capacity; i++) {
+        if (!slot_empty(&set->slots[i])) {
+            *probe(slots, new_capacity, &set->slots[i]) = set->slots[i];
+        }
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = new_capacity;
+    return TRUE;
+}
+
+BOOL visited_insert(VisitedSet *set, const DirIdentity *id) {
+    if (slot_empty(id)) return TRUE;   // Unknown identity, cannot dedupe
+
+    EnterCriticalSection(&set->lock);
+    // Keep load below 3/4 so probe runs stay short
+    if ((set->count + 1) * 4 > set->capacity * 3 && !grow(set)) {
+        LeaveCriticalSection(&set->lock);
+        return TRUE;
+    }
+    DirIdentity *slot = probe(set->slots, set->capacity, id);
+    BOOL inserted = slot_empty(slot);
+    if (inserted) {
+        *slot = *id;
+        set->count++;
+    }
+    LeaveCriticalSection(&set->lock);
+    return inserted;
+}
+
+BOOL visited_contains(VisitedSet *set, const DirIdentity *id) {
+    if (slot_empty(id)) return FALSE;
+
+    EnterCriticalSection(&set->lock);
+    BOOL found = set->capacity > 0 &&
+                 !slot_empty(probe(set->slots, set->capacity, id));
+    LeaveCriticalSection(&set->lock);
+    return found;
+}